@@ -0,0 +1,45 @@
+#!/usr/bin/env bash
+
+# Expression parsing throughput: parse and AST teardown time of a generated program made almost
+# only of long expressions, which mix every precedence level, unary and user defined operators,
+# conditionals and calls, so most of the parser's time goes to operator dispatch.
+#
+# Usage: bench/expressions.sh [bench/parser binary]
+# Env:   MB    approximate size of the generated program in megabytes (default 4)
+#        RUNS  runs, the median is reported (default 10)
+
+set -e
+. "$(dirname "$0")/lib.sh"
+
+PARSER="${1:-bench/parser}"
+MB="${MB:-4}"
+
+require_binary "$PARSER" "parser benchmark binary"
+
+make_tmp
+src="$tmp/expressions.htk"
+
+#region Generate program
+# Every function is about 600 bytes of expressions.
+funcs=$((MB * 1024 * 1024 / 600))
+{
+    echo "func binary| 5 (a, b) { return a ? 1 : b ? 1 : 0; }"
+    echo "func binary> 10 (a, b) { return b < a; }"
+    echo "func unary-(v) { return 0 - v; }"
+    for ((i = 0; i < funcs; i++)); do
+        echo "func expr$i(a, b, c) {"
+        echo "    var x = a * $i + b / 2 - c * (a - b) / (c + 1) + -a * -b;"
+        echo "    var y = x < a + b * c | a > b * 2 - c | !(x < $i.5) ? a * b + c : b - c / a;"
+        echo "    x = (a + b) * (b + c) * (c + a) - a * b * c + x / (y + 1) - (x - y) * (x + y);"
+        echo "    y = y + x * a - b * -c + (a < b) * (b < c) + (a + 1) * (b + 2) * (c + 3) / 4;"
+        echo "    return x > y && a < b || !c ? expr$i(x - 1, y / 2, a + b * c) : x * y + a - b;"
+        echo "}"
+    done
+
+    echo "func main() {"
+    echo "    return expr0(1, 2, 3);"
+    echo "}"
+} > "$src"
+#endregion
+
+"$PARSER" "$src"
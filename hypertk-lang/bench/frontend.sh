@@ -0,0 +1,68 @@
+#!/usr/bin/env bash
+
+# Frontend throughput: median lex, parse and analyze time of a generated multi-megabyte program, and
+# the source bytes processed per second. `main` calls a single function, so the time
+# spent past the frontend stays small.
+#
+# Usage: bench/frontend.sh [hypertk binary]
+# Env:   MB    approximate size of the generated program in megabytes (default 8)
+#        RUNS  runs, the median is reported (default 10)
+
+set -e
+. "$(dirname "$0")/lib.sh"
+
+HYPERTK="${1:-./hypertk}"
+MB="${MB:-8}"
+RUNS="${RUNS:-10}"
+
+require_binary "$HYPERTK"
+
+make_tmp
+src="$tmp/large.htk"
+
+#region Generate program
+# Every function mixes identifiers, numbers, operators and comments, about 300 bytes each.
+# Negation is a user defined operator, defined first.
+funcs=$((MB * 1024 * 1024 / 300))
+{
+    echo "func unary-(v) { return 0 - v; }"
+    for ((i = 0; i < funcs; i++)); do
+        echo "// Function $i of $funcs, its locals shadow the ones of the others."
+        echo "func function$i(alpha, beta) {"
+        echo "    var total = alpha * $i.25 + beta;"
+        echo "    for index = 0, index < 16, 1 in"
+        echo "        total = total + (alpha - index) * 0.5 / (beta + 1);"
+        echo "    if (total < $i) return total; else return -total + alpha * beta;"
+        echo "}"
+    done
+
+    echo "func main() {"
+    echo "    return function0(1, 2);"
+    echo "}"
+} > "$src"
+#endregion
+
+bytes=$(wc -c < "$src")
+
+: > "$tmp/lex.txt"
+: > "$tmp/parse.txt"
+: > "$tmp/analyze.txt"
+for ((r = 0; r < RUNS; r++)); do
+    "$HYPERTK" --timing=json "$src" > /dev/null 2> "$tmp/timing.json"
+    phase lex "$tmp/timing.json" >> "$tmp/lex.txt"
+    phase parse "$tmp/timing.json" >> "$tmp/parse.txt"
+    phase analyze "$tmp/timing.json" >> "$tmp/analyze.txt"
+done
+
+lex=$(median "$tmp/lex.txt")
+parse=$(median "$tmp/parse.txt")
+analyze=$(median "$tmp/analyze.txt")
+
+frontend=$(calc "$lex + $parse + $analyze")
+
+echo "source: $bytes bytes, functions: $funcs, runs: $RUNS"
+printf "%-10s %12s %12s\n" "phase" "median ms" "MB/s"
+for name in lex parse analyze frontend; do
+    ms="${!name}"
+    printf "%-10s %12s %12.1f\n" "$name" "$ms" "$(calc "$bytes / 1048576 / ($ms / 1000)")"
+done
@@ -0,0 +1,78 @@
+// Lexer microbenchmark: tokens per second of lexing each given program, without parsing.
+// Every file is lexed over and over for at least `MIN_MS` (default 200) per run, the median
+// rate of `RUNS` runs (default 10) is reported.
+//
+// Usage: bench/lexer [program...]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "lexer.hpp"
+#include "token.hpp"
+
+static unsigned envOr(const char *name, unsigned fallback)
+{
+    const char *value = std::getenv(name);
+    return value ? (unsigned)std::atoi(value) : fallback;
+}
+
+/** @brief Lex `src` once, return the number of tokens */
+static size_t lex(const std::string &src)
+{
+    lexer::Lexer lexer_{src};
+    size_t tokens = 0;
+    while (lexer_.nextToken().type != token::TokenType::END_OF_FILE)
+        ++tokens;
+    return tokens;
+}
+
+int main(int argc, char **argv)
+{
+    const unsigned runs = envOr("RUNS", 10);
+    const double minSeconds = envOr("MIN_MS", 200) / 1e3;
+
+    std::printf("%-20s %10s %10s %14s %10s\n", "program", "bytes", "tokens", "Mtokens/s", "MB/s");
+    for (int i = 1; i < argc; ++i)
+    {
+        std::ifstream file(argv[i]);
+        if (!file)
+        {
+            std::fprintf(stderr, "Could not open file '%s'\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        const std::string src = buffer.str();
+        const size_t tokens = lex(src);
+
+        std::vector<double> rates;
+        for (unsigned r = 0; r < runs; ++r)
+        {
+            // Every pass copies the source into a new lexer, which owns it.
+            size_t passes = 0;
+            auto start = std::chrono::steady_clock::now();
+            double seconds = 0;
+            do
+            {
+                lex(src);
+                ++passes;
+                seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            } while (seconds < minSeconds);
+            rates.push_back(passes / seconds);
+        }
+        std::sort(rates.begin(), rates.end());
+        const double passesPerSecond = rates[(rates.size() - 1) / 2];
+
+        std::string name = argv[i];
+        name = name.substr(name.find_last_of('/') + 1);
+        std::printf("%-20s %10zu %10zu %14.2f %10.1f\n", name.c_str(), src.size(), tokens,
+                    passesPerSecond * tokens / 1e6, passesPerSecond * src.size() / (1 << 20));
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,48 @@
+# Helpers shared by the benchmark scripts, sourced after `set -e`:
+#
+#     . "$(dirname "$0")/lib.sh"
+#
+# Arithmetic goes through awk, the scripts need no `bc`.
+
+# Exit unless the binary `$1` exists, `$2` names it in the message (default "hypertk binary")
+require_binary() {
+    if [ ! -x "$1" ]; then
+        echo "Not found ${2:-hypertk binary}: $1" >&2
+        exit 1
+    fi
+}
+
+# Create the scratch directory `$tmp`, removed when the script exits
+make_tmp() {
+    tmp="$(mktemp -d)"
+    trap 'rm -rf "$tmp"' EXIT
+}
+
+# Print the median of the numbers, one per line, of the given files or of stdin
+median() {
+    sort -g "$@" | awk '{ t[NR] = $1 } END { printf "%.3f", t[int((NR + 1) / 2)] }'
+}
+
+# Print the smallest of the numbers, one per line, of the given files or of stdin
+minimum() {
+    sort -g "$@" | awk 'NR == 1 { printf "%.3f", $1 }'
+}
+
+# Print the number of field `$1` of the timing JSON `$2`, e.g. the time (ms) of a phase
+phase() {
+    grep -o "\"$1\": [-0-9.eE+]*" "$2" | head -n 1 | awk '{ print $2 }'
+}
+
+# Run a command, its output discarded, and print its wall time (ms)
+wall_ms() {
+    local start end
+    start=$(date +%s%N)
+    "$@" > /dev/null 2>&1
+    end=$(date +%s%N)
+    awk -v us=$(((end - start) / 1000)) 'BEGIN { printf "%.3f\n", us / 1000 }'
+}
+
+# Print the value of the awk expression `$1`, e.g. `calc "$a / $b"`, in the format `$2` (default %.3f)
+calc() {
+    awk "BEGIN { printf \"${2:-%.3f}\\n\", $1 }"
+}
@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+
+# Builtin `||` against the user defined `binary|` of the demo in `mandelconverger`'s escape test:
+# check both plot the same, then compare the execute phase at every optimization level.
+#
+# Usage: bench/logical_ops.sh [hypertk binary]
+# Env:   RUNS   runs per measurement (default 20)
+
+set -e
+. "$(dirname "$0")/lib.sh"
+
+HYPERTK="${1:-./hypertk}"
+export RUNS="${RUNS:-20}"
+
+require_binary "$HYPERTK"
+
+make_tmp
+
+# The same program, escape test through the non short-circuit operator function.
+cp bench/mandelbrot.htk "$tmp/builtin_or.htk"
+sed 's/iters > 255 || real\*real + imag\*imag > 4/iters > 255 | (real*real + imag*imag > 4)/' \
+    bench/mandelbrot.htk > "$tmp/user_or.htk"
+if cmp -s "$tmp/builtin_or.htk" "$tmp/user_or.htk"; then
+    echo "Escape test not found in bench/mandelbrot.htk"
+    exit 1
+fi
+
+for mode in --no-tiering ""; do
+    "$HYPERTK" $mode --output=stdout "$tmp/builtin_or.htk" > "$tmp/builtin_or.out"
+    "$HYPERTK" $mode --output=stdout "$tmp/user_or.htk" > "$tmp/user_or.out"
+    if ! cmp -s "$tmp/builtin_or.out" "$tmp/user_or.out"; then
+        echo "Plots differ (${mode:---tiered})"
+        exit 1
+    fi
+done
+
+echo "runs: $RUNS"
+printf "%-6s %-12s %10s %10s\n" "level" "escape test" "median ms" "p90 ms"
+for level in -O0 -O1 -O2 -O3; do
+    FLAGS="--no-tiering $level" bench/run.sh "$HYPERTK" "$tmp/builtin_or.htk" "$tmp/user_or.htk" |
+        awk -F, -v level="$level" '$2 == "execute" { printf "%-6s %-12s %10s %10s\n", level, $1, $4, $5 }'
+done
@@ -0,0 +1,44 @@
+#!/usr/bin/env bash
+
+# Loop microbenchmarks: median optimize and execute time of the nested loop programs at each
+# optimization level. -O1 rotates loops, -O2 and up also unroll and vectorize them.
+#
+# Usage: bench/loops.sh [hypertk binary] [program...]
+# Env:   RUNS  runs per measurement (default 10)
+
+set -e
+. "$(dirname "$0")/lib.sh"
+
+HYPERTK="${1:-./hypertk}"
+shift || true
+PROGRAMS=("$@")
+if [ ${#PROGRAMS[@]} -eq 0 ]; then
+    PROGRAMS=(bench/nested_loops.htk bench/arrays.htk bench/matmul.htk)
+fi
+RUNS="${RUNS:-10}"
+
+require_binary "$HYPERTK"
+
+make_tmp
+
+# Print `<median optimize ms> <median execute ms>` of hypertk run with the given arguments
+measure() {
+    : > "$tmp/optimize.txt"
+    : > "$tmp/execute.txt"
+    for ((r = 0; r < RUNS; r++)); do
+        "$HYPERTK" --no-tiering --timing=json "$@" > /dev/null 2> "$tmp/timing.json"
+        phase optimize "$tmp/timing.json" >> "$tmp/optimize.txt"
+        phase execute "$tmp/timing.json" >> "$tmp/execute.txt"
+    done
+    echo "$(median "$tmp/optimize.txt") $(median "$tmp/execute.txt")"
+}
+
+echo "runs: $RUNS"
+printf "%-14s %-4s %12s %12s\n" "program" "lvl" "optimize ms" "exec ms"
+for program in "${PROGRAMS[@]}"; do
+    name="$(basename "$program" .htk)"
+    for level in -O0 -O1 -O2 -O3; do
+        read -r optimize exec <<< "$(measure $level "$program")"
+        printf "%-14s %-4s %12s %12s\n" "$name" "$level" "$optimize" "$exec"
+    done
+done
@@ -0,0 +1,45 @@
+#!/usr/bin/env bash
+
+# Compile time vs run time of each optimization level on the mandelbrot program, from the
+# `--timing=json` phases: compile is IR generation, optimization and JIT linking, run is `main`,
+# total is the wall time of the process. Whole program JIT (`--no-tiering`) so every function goes
+# through the optimizer before `main` runs.
+#
+# Usage: bench/opt_levels.sh [hypertk binary] [program]
+# Env:   RUNS  runs per measurement, the median is reported (default 10)
+
+set -e
+. "$(dirname "$0")/lib.sh"
+
+HYPERTK="${1:-./hypertk}"
+PROGRAM="${2:-bench/mandelbrot.htk}"
+RUNS="${RUNS:-10}"
+
+require_binary "$HYPERTK"
+
+make_tmp
+json="$tmp/timing.json"
+
+# Print `<compile ms> <run ms> <total ms>`, the medians of `RUNS` runs of hypertk with the given arguments
+measure() {
+    : > "$tmp/compile.txt"
+    : > "$tmp/run.txt"
+    : > "$tmp/total.txt"
+    for ((r = 0; r < RUNS; r++)); do
+        start=$(date +%s%N)
+        "$HYPERTK" --no-tiering --timing=json "$@" > /dev/null 2> "$json"
+        end=$(date +%s%N)
+        calc "$(phase codegen "$json") + $(phase optimize "$json") + $(phase jit-link "$json") + $(phase emit "$json")" \
+            >> "$tmp/compile.txt"
+        phase execute "$json" >> "$tmp/run.txt"
+        calc "$(((end - start) / 1000)) / 1000" >> "$tmp/total.txt"
+    done
+    echo "$(median "$tmp/compile.txt") $(median "$tmp/run.txt") $(median "$tmp/total.txt")"
+}
+
+echo "program: $PROGRAM, runs: $RUNS"
+printf "%-6s %12s %12s %12s\n" "level" "compile ms" "run ms" "total ms"
+for level in -O0 -O1 -O2 -O3; do
+    read -r compile run total <<< "$(measure $level "$PROGRAM")"
+    printf "%-6s %12.2f %12.2f %12.2f\n" "$level" "$compile" "$run" "$total"
+done
@@ -0,0 +1,46 @@
+#!/usr/bin/env bash
+
+# Program output: write syscalls and median wall time of the mandelbrot plot written through per
+# call (`--output-buffer=0`, one write per character as unbuffered stderr did) against the
+# default per-thread buffer. Needs `strace` for the syscall counts.
+#
+# Usage: bench/output.sh [hypertk binary] [program]
+# Env:   RUNS  runs per measurement (default 10)
+
+set -e
+. "$(dirname "$0")/lib.sh"
+
+HYPERTK="${1:-./hypertk}"
+PROGRAM="${2:-bench/mandelbrot.htk}"
+RUNS="${RUNS:-10}"
+
+require_binary "$HYPERTK"
+if ! command -v strace > /dev/null; then
+    echo "strace not found"
+    exit 1
+fi
+
+make_tmp
+
+# Print the number of `write` syscalls of one run of hypertk with the given arguments
+count_writes() {
+    strace -f -c -e trace=write -o "$tmp/strace.txt" "$HYPERTK" --no-tiering "$@" > /dev/null 2>&1
+    awk '$NF == "write" { print $4 }' "$tmp/strace.txt"
+}
+
+# Print median wall time (ms) of `RUNS` runs of hypertk with the given arguments
+measure() {
+    for ((r = 0; r < RUNS; r++)); do
+        wall_ms "$HYPERTK" --no-tiering "$@"
+    done | median
+}
+
+echo "runs: $RUNS"
+printf "%-10s %-7s %10s %12s\n" "buffer" "stream" "writes" "wall ms"
+for stream in stderr stdout; do
+    for buffer in 0 65536; do
+        writes=$(count_writes --output=$stream --output-buffer=$buffer "$PROGRAM")
+        wall=$(measure --output=$stream --output-buffer=$buffer "$PROGRAM")
+        printf "%-10s %-7s %10s %12s\n" "$buffer" "$stream" "$writes" "$wall"
+    done
+done
@@ -0,0 +1,45 @@
+#!/usr/bin/env bash
+
+# Parallel loops: median execute time of a program at 1, 2, 4, ... threads up to the core count,
+# with the speedup over one thread. The printed total must be the same on every line, reductions
+# add the chunk sums in the same order whatever the number of threads.
+#
+# Usage: bench/parallel.sh [hypertk binary] [program]
+# Env:   RUNS     runs per thread count (default 10)
+#        THREADS  space separated thread counts (default powers of two up to `nproc`)
+
+set -e
+. "$(dirname "$0")/lib.sh"
+
+HYPERTK="${1:-./hypertk}"
+PROGRAM="${2:-bench/parallel.htk}"
+RUNS="${RUNS:-10}"
+
+require_binary "$HYPERTK"
+
+if [ -z "$THREADS" ]; then
+    cores=$(nproc)
+    for ((t = 1; t < cores; t *= 2)); do
+        THREADS="$THREADS $t"
+    done
+    THREADS="$THREADS $cores"
+fi
+
+make_tmp
+
+# Print median execute time (ms) of `RUNS` runs with `--threads=$1`, the program output goes to `$tmp/out.txt`
+measure() {
+    for ((r = 0; r < RUNS; r++)); do
+        "$HYPERTK" --no-tiering --timing=json --output=stdout --threads="$1" "$PROGRAM" 2> "$tmp/timing.json" > "$tmp/out.txt"
+        phase execute "$tmp/timing.json"
+    done | median
+}
+
+echo "runs: $RUNS"
+printf "%-8s %12s %8s  %s\n" "threads" "execute ms" "speedup" "output"
+base=""
+for t in $THREADS; do
+    ms=$(measure "$t")
+    base="${base:-$ms}"
+    printf "%-8s %12s %8s  %s\n" "$t" "$ms" "$(calc "$base / $ms" %.2f)" "$(tr '\n' ' ' < "$tmp/out.txt")"
+done
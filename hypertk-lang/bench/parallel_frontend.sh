@@ -0,0 +1,84 @@
+#!/usr/bin/env bash
+
+# Parallel frontend: median lex, parse and analyze time of a generated multi-megabyte program at
+# 1, 2, 4, ... threads up to the core count, with the speedup over one thread. The printed AST must
+# be the same at every thread count, the functions parsed apart are merged in source order.
+#
+# Usage: bench/parallel_frontend.sh [hypertk binary]
+# Env:   MB       approximate size of the generated program in megabytes (default 8)
+#        RUNS     runs per thread count (default 10)
+#        THREADS  space separated thread counts (default powers of two up to `nproc`)
+
+set -e
+. "$(dirname "$0")/lib.sh"
+
+HYPERTK="${1:-./hypertk}"
+MB="${MB:-8}"
+RUNS="${RUNS:-10}"
+
+require_binary "$HYPERTK"
+
+if [ -z "$THREADS" ]; then
+    cores=$(nproc)
+    for ((t = 1; t < cores; t *= 2)); do
+        THREADS="$THREADS $t"
+    done
+    THREADS="$THREADS $cores"
+fi
+
+make_tmp
+src="$tmp/large.htk"
+
+#region Generate program
+# Every function is about 300 bytes. `|` is defined halfway, the functions after it parse with
+# its precedence. Negation is a user defined operator too.
+funcs=$((MB * 1024 * 1024 / 300))
+{
+    echo "func binary> 10 (a, b) { return b < a; }"
+    echo "func unary-(v) { return 0 - v; }"
+    for ((i = 0; i < funcs; i++)); do
+        test="total < $i"
+        if ((i == funcs / 2)); then
+            echo "func binary| 5 (a, b) { return a ? 1 : b ? 1 : 0; }"
+        fi
+        if ((i >= funcs / 2)); then
+            test="total < $i | alpha > beta"
+        fi
+        echo "// Function $i of $funcs, its locals shadow the ones of the others."
+        echo "func function$i(alpha, beta) {"
+        echo "    var total = alpha * $i.25 + beta;"
+        echo "    for index = 0, index < 16, 1 in"
+        echo "        total = total + (alpha - index) * 0.5 / (beta + 1);"
+        echo "    if ($test) return total; else return -total + alpha * beta;"
+        echo "}"
+    done
+
+    echo "func main() {"
+    echo "    return function0(1, 2);"
+    echo "}"
+} > "$src"
+#endregion
+
+bytes=$(wc -c < "$src")
+
+# Print median lex + parse + analyze time (ms) of `RUNS` runs with `--threads=$1`
+measure() {
+    for ((r = 0; r < RUNS; r++)); do
+        "$HYPERTK" --timing=json --threads="$1" "$src" > /dev/null 2> "$tmp/timing.json"
+        calc "$(phase lex "$tmp/timing.json") + $(phase parse "$tmp/timing.json") + $(phase analyze "$tmp/timing.json")"
+    done | median
+}
+
+echo "source: $bytes bytes, functions: $funcs, runs: $RUNS"
+printf "%-8s %14s %8s %10s  %s\n" "threads" "frontend ms" "speedup" "MB/s" "AST"
+base=""
+for t in $THREADS; do
+    "$HYPERTK" --print-ast --threads="$t" "$src" > "$tmp/ast$t.txt" 2> /dev/null
+    base_ast="${base_ast:-$tmp/ast$t.txt}"
+    same=$(cmp -s "$base_ast" "$tmp/ast$t.txt" && echo "same" || echo "DIFFERENT")
+
+    ms=$(measure "$t")
+    base="${base:-$ms}"
+    printf "%-8s %14s %8s %10.1f  %s\n" "$t" "$ms" "$(calc "$base / $ms" %.2f)" \
+        "$(calc "$bytes / 1048576 / ($ms / 1000)")" "$same"
+done
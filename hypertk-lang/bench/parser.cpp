@@ -0,0 +1,98 @@
+// Parser microbenchmark: time to parse each given program into its AST, and to tear the AST
+// down again, measured apart. Every file is parsed and freed over and over for at least `MIN_MS`
+// (default 200) per run, the median time per pass of `RUNS` runs (default 10) is reported.
+// Large programs are parsed on `THREADS` threads (default 0, every core).
+//
+// Usage: bench/parser [program...]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "parser.hpp"
+#include "lexer.hpp"
+#include "ast.hpp"
+#include "error.hpp"
+#include "parallel.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static unsigned envOr(const char *name, unsigned fallback)
+{
+    const char *value = std::getenv(name);
+    return value ? (unsigned)std::atoi(value) : fallback;
+}
+
+static double since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static double median(std::vector<double> &values)
+{
+    std::sort(values.begin(), values.end());
+    return values[(values.size() - 1) / 2];
+}
+
+int main(int argc, char **argv)
+{
+    const unsigned runs = envOr("RUNS", 10);
+    const double minSeconds = envOr("MIN_MS", 200) / 1e3;
+    parallel::setThreadCount(envOr("THREADS", 0));
+
+    std::printf("%-20s %10s %12s %12s %12s %10s\n", "program", "bytes", "parse ms", "teardown ms", "total ms", "MB/s");
+    for (int i = 1; i < argc; ++i)
+    {
+        std::ifstream file(argv[i]);
+        if (!file)
+        {
+            std::fprintf(stderr, "Could not open file '%s'\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        const std::string src = buffer.str();
+
+        std::vector<double> parseTimes, teardownTimes;
+        for (unsigned r = 0; r < runs; ++r)
+        {
+            // The lexer copies the source before the clock starts, lexing it is part of the parse time.
+            size_t passes = 0;
+            double parseSeconds = 0, teardownSeconds = 0;
+            auto start = Clock::now();
+            do
+            {
+                parser::Parser parser_{lexer::Lexer{src}};
+
+                auto parseStart = Clock::now();
+                std::optional<ast::Program> program = parser_.parse();
+                parseSeconds += since(parseStart);
+                if (error::hasError() || !program.has_value())
+                {
+                    std::fprintf(stderr, "Could not parse '%s'\n", argv[i]);
+                    return EXIT_FAILURE;
+                }
+
+                auto teardownStart = Clock::now();
+                program.reset();
+                teardownSeconds += since(teardownStart);
+                ++passes;
+            } while (since(start) < minSeconds);
+            parseTimes.push_back(parseSeconds / passes);
+            teardownTimes.push_back(teardownSeconds / passes);
+        }
+        const double parse = median(parseTimes), teardown = median(teardownTimes);
+
+        std::string name = argv[i];
+        name = name.substr(name.find_last_of('/') + 1);
+        std::printf("%-20s %10zu %12.3f %12.3f %12.3f %10.1f\n", name.c_str(), src.size(), parse * 1e3,
+                    teardown * 1e3, (parse + teardown) * 1e3, src.size() / (parse + teardown) / (1 << 20));
+    }
+    return EXIT_SUCCESS;
+}
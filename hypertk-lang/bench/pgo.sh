@@ -0,0 +1,45 @@
+#!/usr/bin/env bash
+
+# Profile-guided optimization: median execute time of each program optimized without a profile,
+# instrumented by `--profile-generate` (the cost of the counters), and optimized with the
+# profile of the instrumented run by `--profile-use`.
+#
+# Usage: bench/pgo.sh [hypertk binary] [program...]
+# Env:   RUNS   runs per measurement (default 10)
+#        LEVEL  optimization level (default -O2)
+
+set -e
+. "$(dirname "$0")/lib.sh"
+
+HYPERTK="${1:-./hypertk}"
+shift || true
+PROGRAMS=("$@")
+if [ ${#PROGRAMS[@]} -eq 0 ]; then
+    PROGRAMS=(bench/fib.htk bench/mandelbrot.htk bench/nbody.htk bench/operators.htk bench/matmul.htk)
+fi
+RUNS="${RUNS:-10}"
+LEVEL="${LEVEL:--O2}"
+
+require_binary "$HYPERTK"
+
+make_tmp
+
+# Print median execute time (ms) of `RUNS` runs of hypertk with the given arguments
+measure() {
+    for ((r = 0; r < RUNS; r++)); do
+        "$HYPERTK" --no-tiering --timing=json $LEVEL "$@" > /dev/null 2> "$tmp/timing.json"
+        phase execute "$tmp/timing.json"
+    done | median
+}
+
+echo "runs: $RUNS level: $LEVEL"
+printf "%-14s %12s %14s %12s %8s\n" "program" "plain ms" "instrumented" "pgo ms" "speedup"
+for program in "${PROGRAMS[@]}"; do
+    name="$(basename "$program" .htk)"
+    profile="$tmp/$name.profile"
+    instrumented=$(measure --profile-generate="$profile" "$program")
+    plain=$(measure "$program")
+    pgo=$(measure --profile-use="$profile" "$program")
+    printf "%-14s %12s %14s %12s %8s\n" "$name" "$plain" "$instrumented" "$pgo" \
+        "$(calc "$plain / $pgo" %.2f)"
+done
@@ -0,0 +1,42 @@
+#!/usr/bin/env bash
+
+# Long REPL sessions: time per entry and peak memory against session length.
+# Stream a generated session of top-level expressions (plus a few definitions) through
+# `--repl`. With per-entry modules and freed anonymous functions both the time per entry
+# and the peak RSS should stay flat as the session grows.
+#
+# Usage: bench/repl_session.sh [hypertk binary]
+# Env:   SIZES   session lengths in entries (default "1000 10000 50000")
+
+set -e
+. "$(dirname "$0")/lib.sh"
+
+HYPERTK="${1:-./hypertk}"
+SIZES="${SIZES:-1000 10000 50000}"
+
+require_binary "$HYPERTK"
+if [ ! -x /usr/bin/time ]; then
+    echo "Not found /usr/bin/time, needed for the peak RSS"
+    exit 1
+fi
+
+make_tmp
+
+# Write a session of `$1` entries to stdout
+session() {
+    echo "func sq(x) { return x * x; }"
+    for ((i = 1; i < $1; i++)); do
+        if ((i % 100 == 0)); then
+            echo "func f$i(x) { return sq(x) + $i; }"
+        else
+            echo "sq($i) + $i * 2;"
+        fi
+    done
+}
+
+printf "%10s %10s %12s %12s\n" "entries" "total ms" "us/entry" "peak RSS KB"
+for n in $SIZES; do
+    session "$n" > "$tmp/session.htk"
+    ms=$(wall_ms /usr/bin/time -f "%M" -o "$tmp/rss" "$HYPERTK" --repl "$tmp/session.htk")
+    printf "%10d %10.2f %12.2f %12d\n" "$n" "$ms" "$(calc "$ms * 1000 / $n")" "$(cat "$tmp/rss")"
+done
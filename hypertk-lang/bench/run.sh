@@ -0,0 +1,72 @@
+#!/usr/bin/env bash
+
+# Benchmark harness: run each program repeatedly and report per-phase percentiles as CSV.
+# Phase times come from `--timing=json`:
+#   frontend  lex + parse + analyze
+#   irgen     AST to LLVM IR
+#   optimize  module optimization pipeline
+#   jit       JIT materialization: machine code generation and linking
+#   execute   running `main`
+#   wall      wall time of the whole process, measured outside
+# Whole program JIT (`--no-tiering`) by default so the phases don't interleave; with `--lazy`
+# functions are materialized while `main` runs and count as execute.
+#
+# Usage: bench/run.sh [hypertk binary] [program...]
+# Env:   RUNS   runs per program (default 20)
+#        FLAGS  extra flags for hypertk (default "--no-tiering")
+# Output: CSV on stdout, one row per program and phase, sorted, so results of two commits
+#         can be compared with `diff`.
+
+set -e
+. "$(dirname "$0")/lib.sh"
+
+HYPERTK="${1:-./hypertk}"
+shift || true
+PROGRAMS=("$@")
+if [ ${#PROGRAMS[@]} -eq 0 ]; then
+    PROGRAMS=(bench/fib.htk bench/mandelbrot.htk bench/nbody.htk bench/nested_loops.htk bench/operators.htk bench/arrays.htk bench/matmul.htk bench/math.htk bench/parallel.htk)
+fi
+RUNS="${RUNS:-20}"
+FLAGS="${FLAGS:---no-tiering}"
+
+require_binary "$HYPERTK"
+
+make_tmp
+
+# Print `runs,median,p90,p99,min,max` of the values (one per line) in file `$1`
+stats() {
+    sort -g "$1" | awk '
+        { v[NR] = $1 }
+        # nearest-rank percentile
+        function p(q,    i) { i = int(q * NR + 0.999999); if (i < 1) i = 1; return v[i] }
+        END { printf "%d,%.3f,%.3f,%.3f,%.3f,%.3f\n", NR, p(0.5), p(0.9), p(0.99), v[1], v[NR] }'
+}
+
+echo "program,phase,runs,median_ms,p90_ms,p99_ms,min_ms,max_ms"
+for program in "${PROGRAMS[@]}"; do
+    name="$(basename "$program" .htk)"
+    rm -f "$tmp"/*.txt
+
+    for ((r = 0; r < RUNS; r++)); do
+        start=$(date +%s%N)
+        # shellcheck disable=SC2086
+        if ! "$HYPERTK" $FLAGS --timing=json "$program" > /dev/null 2> "$tmp/timing.json"; then
+            echo "$program failed:" >&2
+            cat "$tmp/timing.json" >&2
+            exit 1
+        fi
+        end=$(date +%s%N)
+
+        calc "$(phase lex "$tmp/timing.json") + $(phase parse "$tmp/timing.json") + $(phase analyze "$tmp/timing.json")" \
+            >> "$tmp/frontend.txt"
+        phase codegen "$tmp/timing.json" >> "$tmp/irgen.txt"
+        phase optimize "$tmp/timing.json" >> "$tmp/optimize.txt"
+        phase jit-link "$tmp/timing.json" >> "$tmp/jit.txt"
+        phase execute "$tmp/timing.json" >> "$tmp/execute.txt"
+        calc "$(((end - start) / 1000)) / 1000" >> "$tmp/wall.txt"
+    done
+
+    for p in frontend irgen optimize jit execute wall; do
+        echo "$name,$p,$(stats "$tmp/$p.txt")"
+    done
+done
@@ -0,0 +1,57 @@
+#!/usr/bin/env bash
+
+# Startup latency of eager vs lazy JIT compilation.
+# Run a generated program with many functions where `main` only calls a few of them,
+# eager mode compiles every function before `main` runs, lazy mode only the called ones.
+#
+# Usage: bench/startup.sh [hypertk binary]
+# Env:   FUNCS   number of generated functions (default 500)
+#        CALLED  number of functions called by `main` (default 5)
+#        RUNS    runs per mode, the median is reported (default 10)
+
+set -e
+. "$(dirname "$0")/lib.sh"
+
+HYPERTK="${1:-./hypertk}"
+FUNCS="${FUNCS:-500}"
+CALLED="${CALLED:-5}"
+RUNS="${RUNS:-10}"
+
+require_binary "$HYPERTK"
+
+make_tmp
+src="$tmp/many_funcs.htk"
+
+#region Generate program
+{
+    for ((i = 0; i < FUNCS; i++)); do
+        echo "func f$i(x) {"
+        echo "    var y = x * $i;"
+        echo "    for j = 0, j < 16, 1 in"
+        echo "        y = y + j * x - y / 3;"
+        echo "    return y;"
+        echo "}"
+    done
+
+    echo "func main() {"
+    echo "    var sum = 0;"
+    for ((i = 0; i < CALLED; i++)); do
+        echo "    sum = sum + f$((i * FUNCS / CALLED))(1);"
+    done
+    echo "    return sum;"
+    echo "}"
+} > "$src"
+#endregion
+
+# Print median and min wall time (ms) of `RUNS` runs of hypertk with the given flags
+measure() {
+    for ((r = 0; r < RUNS; r++)); do
+        wall_ms "$HYPERTK" "$@" "$src"
+    done > "$tmp/wall.txt"
+    printf "%10.2f %10.2f\n" "$(median "$tmp/wall.txt")" "$(minimum "$tmp/wall.txt")"
+}
+
+echo "functions: $FUNCS, called: $CALLED, runs: $RUNS"
+printf "%-8s %10s %10s\n" "mode" "median ms" "min ms"
+printf "%-8s %s\n" "eager" "$(measure --no-tiering)"
+printf "%-8s %s\n" "lazy" "$(measure --no-tiering --lazy)"
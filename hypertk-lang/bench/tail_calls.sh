@@ -0,0 +1,79 @@
+#!/usr/bin/env bash
+
+# Tail calls: check that a million deep tail recursion runs at every optimization level,
+# then compare a tail recursive loop against the same loop written with `for`.
+#
+# Usage: bench/tail_calls.sh [hypertk binary]
+# Env:   ITERS  iterations of the compared loops (default 10000000)
+#        RUNS   runs per measurement, the median is reported (default 10)
+
+set -e
+. "$(dirname "$0")/lib.sh"
+
+HYPERTK="${1:-./hypertk}"
+ITERS="${ITERS:-10000000}"
+RUNS="${RUNS:-10}"
+
+require_binary "$HYPERTK"
+
+make_tmp
+
+#region Deep recursion
+failed=0
+for level in -O0 -O1 -O2 -O3; do
+    for mode in --no-tiering ""; do
+        out="$("$HYPERTK" $level $mode bench/deep_recursion.htk 2> /dev/null | tail -n 1)" || true
+        if [ "$out" = "Eval 1e+06" ]; then
+            status="ok"
+        else
+            status="FAILED (${out:-crashed})"
+            failed=1
+        fi
+        printf "deep recursion %-4s %-13s %s\n" "$level" "${mode:---tiered}" "$status"
+    done
+done
+if [ "$failed" -ne 0 ]; then
+    exit 1
+fi
+#endregion
+
+#region Recursion vs loop
+cat > "$tmp/recursive.htk" <<HTK
+func iterate(n, x) {
+    if (n < 1)
+        return x;
+    else
+        return iterate(n - 1, x * 0.999999 + 1);
+}
+
+func main() {
+    return iterate($ITERS, 0);
+}
+HTK
+
+cat > "$tmp/loop.htk" <<HTK
+func iterate(n, x) {
+    for i = 0, i < n, 1 in
+        x = x * 0.999999 + 1;
+    return x;
+}
+
+func main() {
+    return iterate($ITERS, 0);
+}
+HTK
+
+# Print median wall time (ms) of `RUNS` runs of hypertk with the given arguments
+measure() {
+    for ((r = 0; r < RUNS; r++)); do
+        wall_ms "$HYPERTK" --no-tiering "$@"
+    done | median
+}
+
+echo
+echo "iterations: $ITERS, runs: $RUNS"
+printf "%-6s %12s %12s\n" "level" "recursive ms" "loop ms"
+for level in -O0 -O1 -O2 -O3; do
+    printf "%-6s %12.2f %12.2f\n" "$level" "$(measure $level "$tmp/recursive.htk")" "$(measure $level "$tmp/loop.htk")"
+done
+#endregion
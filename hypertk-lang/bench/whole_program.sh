@@ -0,0 +1,47 @@
+#!/usr/bin/env bash
+
+# Whole-program mode against the default separate compilation: IR instructions left after the
+# optimizer (code size) and median execute time of each benchmark program.
+#
+# Usage: bench/whole_program.sh [hypertk binary] [program...]
+# Env:   RUNS   runs per measurement (default 10)
+# -O0 is not compared: without whole-program mode nothing runs the optimizer to count instructions.
+
+set -e
+. "$(dirname "$0")/lib.sh"
+
+HYPERTK="${1:-./hypertk}"
+shift || true
+PROGRAMS=("$@")
+if [ ${#PROGRAMS[@]} -eq 0 ]; then
+    PROGRAMS=(bench/mandelbrot.htk bench/operators.htk bench/fib.htk bench/nbody.htk bench/nested_loops.htk)
+fi
+RUNS="${RUNS:-10}"
+
+require_binary "$HYPERTK"
+
+make_tmp
+
+# Print `<instructions after optimization> <median execute ms>` of hypertk run with the given arguments
+measure() {
+    for ((r = 0; r < RUNS; r++)); do
+        "$HYPERTK" --no-tiering --timing=json "$@" > /dev/null 2> "$tmp/timing.json"
+        phase execute "$tmp/timing.json"
+    done > "$tmp/execute.txt"
+
+    # Functions left after the optimizer, their instruction counts add up to the module's.
+    instrs=$(sed -n '/"functions"/,$p' "$tmp/timing.json" |
+        grep -o '"instrs_after": [0-9]*' | awk '{ n += $2 } END { print n + 0 }')
+    echo "$instrs $(median "$tmp/execute.txt")"
+}
+
+echo "runs: $RUNS"
+printf "%-14s %-4s %12s %12s %12s %12s\n" "program" "lvl" "instrs" "wp instrs" "exec ms" "wp exec ms"
+for program in "${PROGRAMS[@]}"; do
+    name="$(basename "$program" .htk)"
+    for level in -O1 -O2 -O3; do
+        read -r instrs exec <<< "$(measure $level "$program")"
+        read -r wpInstrs wpExec <<< "$(measure $level --whole-program "$program")"
+        printf "%-14s %-4s %12s %12s %12s %12s\n" "$name" "$level" "$instrs" "$wpInstrs" "$exec" "$wpExec"
+    done
+done
@@ -0,0 +1,157 @@
+#include <cstddef>
+#include <iterator>
+#include <span>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "ast.hpp"
+#include "error.hpp"
+#include "symbol.hpp"
+
+namespace ast
+{
+    /** @brief Changes the references and symbols of nodes moved behind the nodes of an arena */
+    class Rebase
+    {
+    public:
+        explicit Rebase(std::span<const symbol::Symbol> symbols) : symbols_{symbols} {}
+
+        /** @brief Remember where the pool of the nodes of type `T` ends, the moved nodes start there */
+        template <typename T>
+        void pool(const std::vector<T> &nodes)
+        {
+            if constexpr (std::is_same_v<std::remove_cv_t<decltype(T::NodeKind)>, expression::Kind>)
+                exprs_[(size_t)T::NodeKind] = (uint32_t)nodes.size();
+            else
+                stmts_[(size_t)T::NodeKind] = (uint32_t)nodes.size();
+        }
+        /** @brief Remember where the list pool of `T` ends */
+        template <typename T>
+        void list(const std::vector<T> &items)
+        {
+            if constexpr (std::is_same_v<T, expression::ExprRef>)
+                exprLists_ = (uint32_t)items.size();
+            else if constexpr (std::is_same_v<T, statement::StmtRef>)
+                stmtLists_ = (uint32_t)items.size();
+            else
+                tokenLists_ = (uint32_t)items.size();
+        }
+
+        //> references
+        expression::ExprRef ref(expression::ExprRef ref) const { return ref.moved(exprs_[(size_t)ref.kind()]); }
+        statement::StmtRef ref(statement::StmtRef ref) const { return ref.moved(stmts_[(size_t)ref.kind()]); }
+        template <typename T>
+        Ref<T> ref(Ref<T> ref) const
+        {
+            if constexpr (std::is_same_v<std::remove_cv_t<decltype(T::NodeKind)>, expression::Kind>)
+                return {ref.Index + exprs_[(size_t)T::NodeKind]};
+            else
+                return {ref.Index + stmts_[(size_t)T::NodeKind]};
+        }
+        template <typename T>
+        std::optional<T> ref(std::optional<T> ref) const
+        {
+            return ref.has_value() ? std::optional<T>(this->ref(ref.value())) : std::nullopt;
+        }
+        List<expression::ExprRef> ref(List<expression::ExprRef> list) const { return {list.First + exprLists_, list.Size}; }
+        List<statement::StmtRef> ref(List<statement::StmtRef> list) const { return {list.First + stmtLists_, list.Size}; }
+        List<token::Token> ref(List<token::Token> list) const { return {list.First + tokenLists_, list.Size}; }
+        //<
+
+        //> nodes and list items
+        void fix(expression::Number &) const {}
+        void fix(expression::Variable &node) const { fix(node.Name); }
+        void fix(expression::Binary &node) const { node.LHS = ref(node.LHS), node.RHS = ref(node.RHS); }
+        void fix(expression::Unary &node) const { node.Operand = ref(node.Operand); }
+        void fix(expression::Conditional &node) const
+        {
+            node.Cond = ref(node.Cond), node.Then = ref(node.Then), node.Else = ref(node.Else);
+        }
+        void fix(expression::Call &node) const { node.Callee = ref(node.Callee), node.Args = ref(node.Args); }
+        void fix(expression::Index &node) const { node.Array = ref(node.Array), node.Idx = ref(node.Idx); }
+        void fix(expression::Length &node) const { node.Array = ref(node.Array); }
+
+        void fix(statement::Block &node) const { node.Statements = ref(node.Statements); }
+        void fix(statement::VarDecl &node) const
+        {
+            fix(node.VarName);
+            node.Initializer = ref(node.Initializer), node.Size = ref(node.Size);
+        }
+        /// @details Operator definitions too.
+        void fix(statement::Function &node) const
+        {
+            fix(node.Name);
+            node.Params = ref(node.Params), node.Body = ref(node.Body);
+        }
+        void fix(statement::Expression &node) const { node.Expr = ref(node.Expr); }
+        void fix(statement::Return &node) const { node.Expr = ref(node.Expr); }
+        void fix(statement::If &node) const
+        {
+            node.Cond = ref(node.Cond), node.Then = ref(node.Then), node.Else = ref(node.Else);
+        }
+        void fix(statement::For &node) const
+        {
+            fix(node.VarName);
+            node.Start = ref(node.Start), node.End = ref(node.End), node.Step = ref(node.Step);
+            node.Body = ref(node.Body), node.Reduce = ref(node.Reduce);
+        }
+
+        void fix(expression::ExprRef &item) const { item = ref(item); }
+        void fix(statement::StmtRef &item) const { item = ref(item); }
+        /// @details The lexeme of an identifier is its interned text, it moves to the process one.
+        void fix(token::Token &token) const
+        {
+            token.symbol = symbols_[token.symbol];
+            if (token.symbol != symbol::None)
+                token.lexeme = symbol::name(token.symbol);
+        }
+        //<
+
+    private:
+        std::span<const symbol::Symbol> symbols_;
+        uint32_t exprs_[(size_t)expression::Kind::LENGTH + 1] = {};
+        uint32_t stmts_[(size_t)statement::Kind::FOR + 1] = {};
+        uint32_t exprLists_ = 0;
+        uint32_t stmtLists_ = 0;
+        uint32_t tokenLists_ = 0;
+    };
+
+    void Arena::tooLarge()
+    {
+        if (tooLarge_)
+            return;
+        tooLarge_ = true;
+        error::error(0, "Program too large, it has more than " + std::to_string(MaxNodes) + " nodes of a kind.");
+    }
+
+    bool Arena::append(Arena &&other, std::span<const symbol::Symbol> symbols, std::vector<statement::StmtRef> &roots)
+    {
+        bool fits = true;
+        std::apply([&](const auto &...to) { ((fits = fits && to.size() + std::get<std::remove_cvref_t<decltype(to)>>(other.pools_).size() <= MaxNodes), ...); }, pools_);
+        if (!fits)
+        {
+            tooLarge();
+            return false;
+        }
+
+        Rebase rebase{symbols};
+        std::apply([&](const auto &...pool) { (rebase.pool(pool), ...); }, pools_);
+        std::apply([&](const auto &...list) { (rebase.list(list), ...); }, lists_);
+
+        auto move = [&rebase](auto &to, auto &from)
+        {
+            size_t first = to.size();
+            to.insert(to.end(), std::make_move_iterator(from.begin()), std::make_move_iterator(from.end()));
+            for (size_t i = first; i < to.size(); ++i)
+                rebase.fix(to[i]);
+            from.clear();
+        };
+        std::apply([&](auto &...to) { (move(to, std::get<std::remove_reference_t<decltype(to)>>(other.pools_)), ...); }, pools_);
+        std::apply([&](auto &...to) { (move(to, std::get<std::remove_reference_t<decltype(to)>>(other.lists_)), ...); }, lists_);
+
+        for (statement::StmtRef &root : roots)
+            root = rebase.ref(root);
+        return true;
+    }
+} // namespace ast
\ No newline at end of file
@@ -1,10 +1,12 @@
 #ifndef HYPERTK_AST_HPP
 #define HYPERTK_AST_HPP
 
+#include <cstdint>
+#include <optional>
+#include <span>
 #include <string>
+#include <tuple>
 #include <vector>
-#include <variant>
-#include <memory>
 
 #include "common.hpp"
 #include "token.hpp"
@@ -20,6 +22,10 @@ namespace ast
         DIV = (int)token::TokenType::SLASH,
         LESS = (int)token::TokenType::LESS,
         EQUAL = (int)token::TokenType::EQUAL,
+        /** @brief Short-circuit logical and, the RHS is only evaluated if the LHS is true */
+        AND = (int)token::TokenType::AMPERSAND_AMPERSAND,
+        /** @brief Short-circuit logical or, the RHS is only evaluated if the LHS is false */
+        OR = (int)token::TokenType::VERTICAL_BAR_VERTICAL_BAR,
         // Operators allow user to define custom behaviour
         GREATER = (int)token::TokenType::GREATER,
         EXCLAMATION = (int)token::TokenType::EXCLAMATION,
@@ -61,17 +67,43 @@ namespace ast
 
     enum class UnaryOp
     {
+        // Builtin operators
+        NOT = (int)token::TokenType::EXCLAMATION,
         // Operators allow user to define custom behaviour
         MINUS = (int)token::TokenType::MINUS,
-        EXCLAMATION = (int)token::TokenType::EXCLAMATION,
+        PLUS = (int)token::TokenType::PLUS,
+        STAR = (int)token::TokenType::STAR,
+        SLASH = (int)token::TokenType::SLASH,
+        LESS = (int)token::TokenType::LESS,
+        GREATER = (int)token::TokenType::GREATER,
+        EQUAL = (int)token::TokenType::EQUAL,
+        VERTICAL_BAR = (int)token::TokenType::VERTICAL_BAR,
+        AMPERSAND = (int)token::TokenType::AMPERSAND,
+        COLON = (int)token::TokenType::COLON,
     };
 
+    /** @brief Operators with a builtin meaning, they cannot be defined by the user */
+    constexpr bool isBuiltinUnaryOp(UnaryOp op)
+    {
+        return op == UnaryOp::NOT;
+    }
+
+    /** @brief Token can be a unary operator, the builtin `!` or one a `unary` definition defines */
     constexpr bool isUnaryOp(token::TokenType t)
     {
         switch (t)
         {
-        case token::TokenType::MINUS:
         case token::TokenType::EXCLAMATION:
+        case token::TokenType::MINUS:
+        case token::TokenType::PLUS:
+        case token::TokenType::STAR:
+        case token::TokenType::SLASH:
+        case token::TokenType::LESS:
+        case token::TokenType::GREATER:
+        case token::TokenType::EQUAL:
+        case token::TokenType::VERTICAL_BAR:
+        case token::TokenType::AMPERSAND:
+        case token::TokenType::COLON:
             return true;
         default:
             return false;
@@ -82,15 +114,51 @@ namespace ast
     {
         switch (op)
         {
+        case UnaryOp::NOT:
+            return '!';
         case UnaryOp::MINUS:
             return '-';
-        case UnaryOp::EXCLAMATION:
-            return '!';
+        case UnaryOp::PLUS:
+            return '+';
+        case UnaryOp::STAR:
+            return '*';
+        case UnaryOp::SLASH:
+            return '/';
+        case UnaryOp::LESS:
+            return '<';
+        case UnaryOp::GREATER:
+            return '>';
+        case UnaryOp::EQUAL:
+            return '=';
+        case UnaryOp::VERTICAL_BAR:
+            return '|';
+        case UnaryOp::AMPERSAND:
+            return '&';
+        case UnaryOp::COLON:
+            return ':';
         default:
             return '\0';
         }
     }
 
+    /**
+     * @brief Static type of a value, inferred by the semantic analyzer.
+     * @details The types form a chain `BOOL < INT < DOUBLE`, a value of a type converts losslessly
+     * to any wider type and the type of a variable is the join (the widest) of all values stored to it.
+     * Function parameters and return values are always `DOUBLE`.
+     */
+    enum class Type
+    {
+        BOOL,
+        INT,
+        DOUBLE,
+    };
+
+    constexpr Type join(Type a, Type b)
+    {
+        return a < b ? b : a;
+    }
+
     enum class FuncKind
     {
         FUNCTION,
@@ -98,132 +166,212 @@ namespace ast
         BINARY_OP,
     };
 
+    class Arena;
+
+    /**
+     * @brief Index of a node of type `T` in the pool of its kind in an `Arena`.
+     * @details Nodes refer to their children by index, not by pointer: a reference is 4 bytes
+     * and stays valid when the pools grow or the program is moved.
+     */
+    template <typename T>
+    struct Ref
+    {
+        uint32_t Index;
+    };
+
+    /** @brief Low bits of an `AnyRef` holding the kind of the node */
+    inline constexpr unsigned RefKindBits = 4;
+    /** @brief Most nodes of one kind an `Arena` holds, an `AnyRef` has 28 bits for the index */
+    inline constexpr size_t MaxNodes = size_t(1) << (32 - RefKindBits);
+
+    /**
+     * @brief Reference to a node of any kind of a family (expressions or statements): the kind
+     * of the node in the low 4 bits, its index in the pool of the kind in the other 28.
+     */
+    template <typename Kind>
+    class AnyRef
+    {
+    public:
+        template <typename T>
+        AnyRef(Ref<T> ref) : bits_{ref.Index << KindBits | (uint32_t)T::NodeKind} {}
+
+        Kind kind() const { return (Kind)(bits_ & KindMask); }
+        uint32_t index() const { return bits_ >> KindBits; }
+
+        /** @brief The node as a `Ref<T>`, the caller checked its kind is `T::NodeKind` */
+        template <typename T>
+        Ref<T> as() const { return {index()}; }
+
+        /** @brief The same node once the pool of its kind starts `by` nodes further, e.g. behind the nodes of another arena */
+        AnyRef moved(uint32_t by) const
+        {
+            AnyRef ref = *this;
+            ref.bits_ += by << KindBits;
+            return ref;
+        }
+
+    private:
+        static constexpr unsigned KindBits = RefKindBits;
+        static constexpr uint32_t KindMask = (1u << KindBits) - 1;
+        uint32_t bits_;
+    };
+
+    /** @brief Contiguous run of `Size` references in a list pool of an `Arena`, e.g. the arguments of a call */
+    template <typename T>
+    struct List
+    {
+        uint32_t First = 0;
+        uint32_t Size = 0;
+    };
+
     /** @brief Expression ast */
     namespace expression
     {
+        enum class Kind : uint8_t
+        {
+            NUMBER,
+            VARIABLE,
+            BINARY,
+            UNARY,
+            CONDITIONAL,
+            CALL,
+            INDEX,
+            LENGTH,
+        };
+
         struct Number;
         struct Variable;
         struct Binary;
         struct Unary;
         struct Conditional;
         struct Call;
-
-        using NumberPtr = std::unique_ptr<Number>;
-        using VariablePtr = std::unique_ptr<Variable>;
-        using BinaryPtr = std::unique_ptr<Binary>;
-        using UnaryPtr = std::unique_ptr<Unary>;
-        using ConditionalPtr = std::unique_ptr<Conditional>;
-        using CallPtr = std::unique_ptr<Call>;
-        using ExprPtr = std::variant<NumberPtr,
-                                     VariablePtr,
-                                     BinaryPtr,
-                                     UnaryPtr,
-                                     ConditionalPtr,
-                                     CallPtr>;
-
-        struct Number : private Uncopyable
+        struct Index;
+        struct Length;
+
+        using NumberRef = Ref<Number>;
+        using VariableRef = Ref<Variable>;
+        using BinaryRef = Ref<Binary>;
+        using UnaryRef = Ref<Unary>;
+        using ConditionalRef = Ref<Conditional>;
+        using CallRef = Ref<Call>;
+        using IndexRef = Ref<Index>;
+        using LengthRef = Ref<Length>;
+        using ExprRef = AnyRef<Kind>;
+
+        struct Number
         {
+            static constexpr Kind NodeKind = Kind::NUMBER;
+
             double Val;
+            /** @brief Literal was written without a fraction, e.g. `42` */
+            bool IsInteger;
+            mutable Type Ty = Type::DOUBLE;
 
-            explicit Number(double val) : Val{val} {}
+            explicit Number(double val, bool isInteger = false) : Val{val}, IsInteger{isInteger} {}
         };
 
-        struct Variable : private Uncopyable
+        struct Variable
         {
+            static constexpr Kind NodeKind = Kind::VARIABLE;
+
             token::Token Name;
+            mutable Type Ty = Type::DOUBLE;
 
             explicit Variable(token::Token name) : Name{std::move(name)} {}
         };
 
-        struct Binary : private Uncopyable
+        struct Binary
         {
+            static constexpr Kind NodeKind = Kind::BINARY;
+
             BinaryOp Op;
-            ExprPtr LHS, RHS;
+            ExprRef LHS, RHS;
+            mutable Type Ty = Type::DOUBLE;
 
-            Binary(BinaryOp Op, ExprPtr LHS, ExprPtr RHS)
-                : Op(Op), LHS(std::move(LHS)), RHS(std::move(RHS)) {}
+            Binary(BinaryOp Op, ExprRef LHS, ExprRef RHS)
+                : Op(Op), LHS(LHS), RHS(RHS) {}
         };
 
-        struct Unary : private Uncopyable
+        struct Unary
         {
+            static constexpr Kind NodeKind = Kind::UNARY;
+
             UnaryOp Op;
-            ExprPtr Operand;
+            ExprRef Operand;
+            mutable Type Ty = Type::DOUBLE;
 
-            Unary(UnaryOp op, ExprPtr operand)
-                : Op{op}, Operand{std::move(operand)} {}
+            Unary(UnaryOp op, ExprRef operand)
+                : Op{op}, Operand{operand} {}
         };
 
-        struct Conditional : private Uncopyable
+        struct Conditional
         {
-            ExprPtr Cond;
-            ExprPtr Then;
-            ExprPtr Else;
-
-            Conditional(ExprPtr cond, ExprPtr then_, ExprPtr else_)
-                : Cond{std::move(cond)},
-                  Then{std::move(then_)},
-                  Else{std::move(else_)} {}
+            static constexpr Kind NodeKind = Kind::CONDITIONAL;
+
+            ExprRef Cond;
+            ExprRef Then;
+            ExprRef Else;
+            mutable Type Ty = Type::DOUBLE;
+
+            Conditional(ExprRef cond, ExprRef then_, ExprRef else_)
+                : Cond{cond}, Then{then_}, Else{else_} {}
         };
 
-        struct Call : private Uncopyable
+        struct Call
         {
-            VariablePtr Callee;
-            std::vector<ExprPtr> Args;
+            static constexpr Kind NodeKind = Kind::CALL;
 
-            Call(VariablePtr Callee,
-                 std::vector<ExprPtr> Args)
-                : Callee{std::move(Callee)}, Args{std::move(Args)} {}
+            VariableRef Callee;
+            List<ExprRef> Args;
+            mutable Type Ty = Type::DOUBLE;
+
+            Call(VariableRef Callee, List<ExprRef> Args)
+                : Callee{Callee}, Args{Args} {}
         };
 
-        template <typename R>
-        class Visitor
+        /** @brief Element of an array, `a[i]`, also the destination of `a[i] = x` */
+        struct Index
         {
-        public:
-            /** @brief Visit expression node */
-            R visit(const ExprPtr &expr)
-            {
-                return std::visit(
-                    overloaded{
-                        [this](const NumberPtr &expr)
-                        {
-                            return visitNumberExpr(*expr);
-                        },
-                        [this](const VariablePtr &expr)
-                        {
-                            return visitVariableExpr(*expr);
-                        },
-                        [this](const BinaryPtr &expr)
-                        {
-                            return visitBinaryExpr(*expr);
-                        },
-                        [this](const UnaryPtr &expr)
-                        {
-                            return visitUnaryExpr(*expr);
-                        },
-                        [this](const ConditionalPtr &expr)
-                        {
-                            return visitConditionalExpr(*expr);
-                        },
-                        [this](const CallPtr &expr)
-                        {
-                            return visitCallExpr(*expr);
-                        }},
-                    expr);
-            }
+            static constexpr Kind NodeKind = Kind::INDEX;
 
-        protected:
-            virtual R visitNumberExpr(const Number &expr) = 0;
-            virtual R visitVariableExpr(const Variable &expr) = 0;
-            virtual R visitBinaryExpr(const Binary &expr) = 0;
-            virtual R visitUnaryExpr(const Unary &expr) = 0;
-            virtual R visitConditionalExpr(const Conditional &expr) = 0;
-            virtual R visitCallExpr(const Call &expr) = 0;
+            VariableRef Array;
+            ExprRef Idx;
+            /** @brief Emit a bounds check, cleared by the semantic analyzer where the index provably is in bounds */
+            mutable bool Checked = true;
+            mutable Type Ty = Type::DOUBLE;
+
+            Index(VariableRef array, ExprRef idx)
+                : Array{array}, Idx{idx} {}
+        };
+
+        /** @brief Number of elements of an array, `len(a)` */
+        struct Length
+        {
+            static constexpr Kind NodeKind = Kind::LENGTH;
+
+            VariableRef Array;
+            mutable Type Ty = Type::DOUBLE;
+
+            explicit Length(VariableRef array) : Array{array} {}
         };
     } // namespace expr
 
     /** @brief Statement ast */
     namespace statement
     {
+        enum class Kind : uint8_t
+        {
+            BLOCK,
+            VAR_DECL,
+            FUNCTION,
+            BIN_OP_DEF,
+            UNARY_OP_DEF,
+            EXPRESSION,
+            RETURN,
+            IF,
+            FOR,
+        };
+
         struct Block;
         struct VarDecl;
         struct Function;
@@ -234,72 +382,73 @@ namespace ast
         struct If;
         struct For;
 
-        using BlockPtr = std::unique_ptr<Block>;
-        using VarDeclPtr = std::unique_ptr<VarDecl>;
-        using FunctionPtr = std::unique_ptr<Function>;
-        using BinOpDefPtr = std::unique_ptr<BinOpDef>;
-        using UnaryOpDefPtr = std::unique_ptr<UnaryOpDef>;
-        using ExpressionPtr = std::unique_ptr<Expression>;
-        using ReturnPtr = std::unique_ptr<Return>;
-        using IfPtr = std::unique_ptr<If>;
-        using ForPtr = std::unique_ptr<For>;
-        using StmtPtr = std::variant<BlockPtr,
-                                     VarDeclPtr,
-                                     FunctionPtr,
-                                     BinOpDefPtr,
-                                     UnaryOpDefPtr,
-                                     ExpressionPtr,
-                                     ReturnPtr,
-                                     IfPtr,
-                                     ForPtr>;
+        using BlockRef = Ref<Block>;
+        using VarDeclRef = Ref<VarDecl>;
+        using FunctionRef = Ref<Function>;
+        using BinOpDefRef = Ref<BinOpDef>;
+        using UnaryOpDefRef = Ref<UnaryOpDef>;
+        using ExpressionRef = Ref<Expression>;
+        using ReturnRef = Ref<Return>;
+        using IfRef = Ref<If>;
+        using ForRef = Ref<For>;
+        using StmtRef = AnyRef<Kind>;
 
         /// @brief Block statement, a collection of many statements
-        struct Block : private Uncopyable
+        struct Block
         {
-            std::vector<StmtPtr> Statements;
+            static constexpr Kind NodeKind = Kind::BLOCK;
 
-            explicit Block(std::vector<StmtPtr> statements)
-                : Statements{std::move(statements)} {}
+            List<StmtRef> Statements;
+
+            explicit Block(List<StmtRef> statements) : Statements{statements} {}
         };
 
-        /// @brief Variable declaration
-        struct VarDecl : private Uncopyable
+        /// @brief Variable declaration, `var a[n];` declares an array of `n` doubles
+        struct VarDecl
         {
+            static constexpr Kind NodeKind = Kind::VAR_DECL;
+
             token::Token VarName;
-            std::optional<expression::ExprPtr> Initializer;
+            std::optional<expression::ExprRef> Initializer;
+            /** @brief Number of elements of an array, `std::nullopt` for a scalar variable */
+            std::optional<expression::ExprRef> Size;
+            /** @brief Type of the variable, the join of its initializer and all assignments to it */
+            mutable Type Ty = Type::DOUBLE;
 
             VarDecl(token::Token varName,
-                    std::optional<expression::ExprPtr> initializer_ = std::nullopt)
-                : VarName{std::move(varName)},
-                  Initializer{initializer_.has_value()
-                                  ? std::move(initializer_)
-                                  : std::nullopt} {}
+                    std::optional<expression::ExprRef> initializer_ = std::nullopt,
+                    std::optional<expression::ExprRef> size = std::nullopt)
+                : VarName{std::move(varName)}, Initializer{initializer_}, Size{size} {}
+
+            bool isArray() const { return Size.has_value(); }
+
+            /** @brief Length of an array sized by an integer literal, `std::nullopt` otherwise */
+            std::optional<int64_t> fixedLength(const Arena &nodes) const;
         };
 
-        struct Function : private Uncopyable
+        struct Function
         {
+            static constexpr Kind NodeKind = Kind::FUNCTION;
+
             token::Token Name;
-            std::vector<token::Token> Params;
-            std::vector<StmtPtr> Body;
-
-            Function(token::Token name,
-                     std::vector<token::Token> params,
-                     std::vector<StmtPtr> body)
-                : Name{std::move(name)},
-                  Params{std::move(params)},
-                  Body{std::move(body)} {}
+            List<token::Token> Params;
+            List<StmtRef> Body;
+            /** @brief Body declares an array, the interpreter leaves such functions to the JIT */
+            bool HasArrays = false;
+
+            Function(token::Token name, List<token::Token> params, List<StmtRef> body)
+                : Name{std::move(name)}, Params{params}, Body{body} {}
         };
 
         /** @brief define custom binary operator */
         struct BinOpDef : public Function
         {
+            static constexpr Kind NodeKind = Kind::BIN_OP_DEF;
+
             unsigned Precedence;
 
-            BinOpDef(token::Token name,
-                     std::vector<token::Token> params,
-                     std::vector<StmtPtr> body,
-                     unsigned prec = 0)
-                : Function(std::move(name), std::move(params), std::move(body)), Precedence{prec} {}
+            BinOpDef(token::Token name, List<token::Token> params, List<StmtRef> body, unsigned prec = 0)
+                : Function(std::move(name), params, body), Precedence{prec} {}
 
             const char getOperator() const
             {
@@ -310,10 +459,10 @@ namespace ast
         /** @brief define custom unary operator */
         struct UnaryOpDef : public Function
         {
-            UnaryOpDef(token::Token name,
-                       std::vector<token::Token> params,
-                       std::vector<StmtPtr> body)
-                : Function(std::move(name), std::move(params), std::move(body)) {}
+            static constexpr Kind NodeKind = Kind::UNARY_OP_DEF;
+
+            UnaryOpDef(token::Token name, List<token::Token> params, List<StmtRef> body)
+                : Function(std::move(name), params, body) {}
 
             const char getOperator() const
             {
@@ -321,99 +470,261 @@ namespace ast
             }
         };
 
-        struct Expression : private Uncopyable
+        struct Expression
         {
-            expression::ExprPtr Expr;
+            static constexpr Kind NodeKind = Kind::EXPRESSION;
+
+            expression::ExprRef Expr;
 
-            Expression(expression::ExprPtr expr) : Expr{std::move(expr)} {}
+            Expression(expression::ExprRef expr) : Expr{expr} {}
         };
 
-        struct Return : private Uncopyable
+        struct Return
         {
-            expression::ExprPtr Expr;
+            static constexpr Kind NodeKind = Kind::RETURN;
 
-            Return(expression::ExprPtr expr) : Expr{std::move(expr)} {}
+            expression::ExprRef Expr;
+
+            Return(expression::ExprRef expr) : Expr{expr} {}
         };
 
-        struct If : private Uncopyable
+        struct If
         {
-            expression::ExprPtr Cond;
-            StmtPtr Then;
-            std::optional<StmtPtr> Else;
-
-            If(expression::ExprPtr cond, StmtPtr then_, std::optional<StmtPtr> else_ = std::nullopt)
-                : Cond{std::move(cond)},
-                  Then{std::move(then_)},
-                  Else{else_.has_value() ? std::move(else_) : std::nullopt} {}
+            static constexpr Kind NodeKind = Kind::IF;
+
+            expression::ExprRef Cond;
+            StmtRef Then;
+            std::optional<StmtRef> Else;
+
+            If(expression::ExprRef cond, StmtRef then_, std::optional<StmtRef> else_ = std::nullopt)
+                : Cond{cond}, Then{then_}, Else{else_} {}
         };
 
-        struct For : private Uncopyable
+        struct For
         {
+            static constexpr Kind NodeKind = Kind::FOR;
+
             token::Token VarName;
-            expression::ExprPtr Start, End, Step;
-            StmtPtr Body;
+            expression::ExprRef Start, End, Step;
+            StmtRef Body;
+            /** @brief Type of the loop variable, the join of start, step and all assignments to it */
+            mutable Type Ty = Type::DOUBLE;
+            /** @brief The body assigns the loop variable, set by the semantic analyzer */
+            mutable bool VarAssigned = false;
+            /** @brief The step has the same value in every iteration, it is evaluated once before the loop */
+            mutable bool StepInvariant = false;
+            /** @brief `End` is `var < bound` with a bound that has the same value in every iteration */
+            mutable bool BoundInvariant = false;
+            /** @brief `parallel for`, the iterations may run concurrently on the thread pool */
+            bool Parallel;
+            /** @brief Variable `parallel for ... reduce total in expr;` adds the sum of `expr` over the iterations to, `Body` is then an `Expression` */
+            std::optional<expression::VariableRef> Reduce;
 
             For(token::Token varName,
-                expression::ExprPtr start,
-                expression::ExprPtr end,
-                expression::ExprPtr step,
-                StmtPtr body)
+                expression::ExprRef start,
+                expression::ExprRef end,
+                expression::ExprRef step,
+                StmtRef body,
+                bool parallel = false,
+                std::optional<expression::VariableRef> reduce = std::nullopt)
                 : VarName{std::move(varName)},
-                  Start{std::move(start)},
-                  End{std::move(end)},
-                  Step{std::move(step)},
-                  Body{std::move(body)} {}
+                  Start{start},
+                  End{end},
+                  Step{step},
+                  Body{body},
+                  Parallel{parallel},
+                  Reduce{reduce} {}
+        };
+    } // namespace stmt
+
+    /**
+     * @brief Owner of the nodes of a program, in one contiguous pool per kind of node.
+     * @details The parser appends each node after its children, so walking a function visits
+     * the pools mostly front to back. The nodes hold no memory of their own, lists of children
+     * live in list pools as well, and the whole tree is freed at once with the arena.
+     */
+    class Arena
+    {
+    public:
+        Arena() = default;
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+        Arena(Arena &&) = default;
+        Arena &operator=(Arena &&) = default;
+
+        /**
+         * @brief Append a node, the references to it stay valid as the arena grows.
+         * @details Past `MaxNodes` nodes of a kind an error is reported and the first node of the
+         * kind returned instead, the program is dropped because of the error.
+         */
+        template <typename T, typename... Args>
+        Ref<T> make(Args &&...args)
+        {
+            std::vector<T> &pool = std::get<std::vector<T>>(pools_);
+            if (pool.size() == MaxNodes)
+            {
+                tooLarge();
+                return {0};
+            }
+            pool.emplace_back(std::forward<Args>(args)...);
+            return {(uint32_t)(pool.size() - 1)};
+        }
+
+        /** @brief Append a list of references or tokens */
+        template <typename T>
+        List<T> list(const std::vector<T> &items)
+        {
+            std::vector<T> &pool = std::get<std::vector<T>>(lists_);
+            List<T> list{(uint32_t)pool.size(), (uint32_t)items.size()};
+            pool.insert(pool.end(), items.begin(), items.end());
+            return list;
+        }
+
+        template <typename T>
+        const T &operator[](Ref<T> ref) const { return std::get<std::vector<T>>(pools_)[ref.Index]; }
+        template <typename T>
+        T &operator[](Ref<T> ref) { return std::get<std::vector<T>>(pools_)[ref.Index]; }
+
+        template <typename T>
+        std::span<const T> operator[](List<T> list) const
+        {
+            return std::span<const T>(std::get<std::vector<T>>(lists_)).subspan(list.First, list.Size);
+        }
+
+        /** @brief The node `ref` refers to if it is a `T`, `nullptr` otherwise */
+        template <typename T, typename Kind>
+        const T *getIf(AnyRef<Kind> ref) const
+        {
+            return ref.kind() == T::NodeKind ? &(*this)[ref.template as<T>()] : nullptr;
+        }
+        template <typename T, typename Kind>
+        bool is(AnyRef<Kind> ref) const { return ref.kind() == T::NodeKind; }
+
+        /** @brief Type of the expression, `DOUBLE` until the semantic analyzer ran */
+        Type typeOf(expression::ExprRef expr) const;
+
+        /**
+         * @brief Move the nodes of `other` behind the nodes of this arena, e.g. of a function parsed apart.
+         * @param symbols process symbol of every symbol in the tokens of `other`, indexed by it, see `symbol::Table`.
+         * @param roots references into `other`, e.g. its top level statements, changed to refer into this arena.
+         * @return `false`, with an error reported and nothing moved, if a pool would hold more than `MaxNodes` nodes.
+         */
+        bool append(Arena &&other, std::span<const symbol::Symbol> symbols, std::vector<statement::StmtRef> &roots);
+
+    private:
+        /** @brief Report that the program has too many nodes of a kind, once per arena */
+        void tooLarge();
+
+        bool tooLarge_ = false;
+        std::tuple<std::vector<expression::Number>,
+                   std::vector<expression::Variable>,
+                   std::vector<expression::Binary>,
+                   std::vector<expression::Unary>,
+                   std::vector<expression::Conditional>,
+                   std::vector<expression::Call>,
+                   std::vector<expression::Index>,
+                   std::vector<expression::Length>,
+                   std::vector<statement::Block>,
+                   std::vector<statement::VarDecl>,
+                   std::vector<statement::Function>,
+                   std::vector<statement::BinOpDef>,
+                   std::vector<statement::UnaryOpDef>,
+                   std::vector<statement::Expression>,
+                   std::vector<statement::Return>,
+                   std::vector<statement::If>,
+                   std::vector<statement::For>>
+            pools_;
+        std::tuple<std::vector<expression::ExprRef>,
+                   std::vector<statement::StmtRef>,
+                   std::vector<token::Token>>
+            lists_;
+    };
+
+    namespace expression
+    {
+        template <typename R>
+        class Visitor
+        {
+        public:
+            /** @brief Visit expression node */
+            R visit(ExprRef expr)
+            {
+                const Arena &nodes_ = nodes();
+                switch (expr.kind())
+                {
+                case Kind::NUMBER:
+                    return visitNumberExpr(nodes_[expr.as<Number>()]);
+                case Kind::VARIABLE:
+                    return visitVariableExpr(nodes_[expr.as<Variable>()]);
+                case Kind::BINARY:
+                    return visitBinaryExpr(nodes_[expr.as<Binary>()]);
+                case Kind::UNARY:
+                    return visitUnaryExpr(nodes_[expr.as<Unary>()]);
+                case Kind::CONDITIONAL:
+                    return visitConditionalExpr(nodes_[expr.as<Conditional>()]);
+                case Kind::CALL:
+                    return visitCallExpr(nodes_[expr.as<Call>()]);
+                case Kind::INDEX:
+                    return visitIndexExpr(nodes_[expr.as<Index>()]);
+                case Kind::LENGTH:
+                    return visitLengthExpr(nodes_[expr.as<Length>()]);
+                }
+                __builtin_unreachable();
+            }
+
+        protected:
+            /** @brief Arena the visited nodes live in */
+            virtual const Arena &nodes() const = 0;
+
+            virtual R visitNumberExpr(const Number &expr) = 0;
+            virtual R visitVariableExpr(const Variable &expr) = 0;
+            virtual R visitBinaryExpr(const Binary &expr) = 0;
+            virtual R visitUnaryExpr(const Unary &expr) = 0;
+            virtual R visitConditionalExpr(const Conditional &expr) = 0;
+            virtual R visitCallExpr(const Call &expr) = 0;
+            virtual R visitIndexExpr(const Index &expr) = 0;
+            virtual R visitLengthExpr(const Length &expr) = 0;
         };
+    } // namespace expr
 
+    namespace statement
+    {
         template <typename R>
         class Visitor
         {
         public:
             /** @brief Visit statement node */
-            R visit(const StmtPtr &stmt)
+            R visit(StmtRef stmt)
             {
-                return std::visit(
-                    overloaded{
-                        [this](const BlockPtr &stmt)
-                        {
-                            return visitBlockStmt(*stmt);
-                        },
-                        [this](const VarDeclPtr &stmt)
-                        {
-                            return visitVarDeclStmt(*stmt);
-                        },
-                        [this](const FunctionPtr &stmt)
-                        {
-                            return visitFunctionStmt(*stmt);
-                        },
-                        [this](const BinOpDefPtr &stmt)
-                        {
-                            return visitBinOpDefStmt(*stmt);
-                        },
-                        [this](const UnaryOpDefPtr &stmt)
-                        {
-                            return visitUnaryOpDefStmt(*stmt);
-                        },
-                        [this](const ExpressionPtr &stmt)
-                        {
-                            return visitExpressionStmt(*stmt);
-                        },
-                        [this](const ReturnPtr &stmt)
-                        {
-                            return visitReturnStmt(*stmt);
-                        },
-                        [this](const IfPtr &stmt)
-                        {
-                            return visitIfStmt(*stmt);
-                        },
-                        [this](const ForPtr &stmt)
-                        {
-                            return visitForStmt(*stmt);
-                        }},
-                    stmt);
+                const Arena &nodes_ = nodes();
+                switch (stmt.kind())
+                {
+                case Kind::BLOCK:
+                    return visitBlockStmt(nodes_[stmt.as<Block>()]);
+                case Kind::VAR_DECL:
+                    return visitVarDeclStmt(nodes_[stmt.as<VarDecl>()]);
+                case Kind::FUNCTION:
+                    return visitFunctionStmt(nodes_[stmt.as<Function>()]);
+                case Kind::BIN_OP_DEF:
+                    return visitBinOpDefStmt(nodes_[stmt.as<BinOpDef>()]);
+                case Kind::UNARY_OP_DEF:
+                    return visitUnaryOpDefStmt(nodes_[stmt.as<UnaryOpDef>()]);
+                case Kind::EXPRESSION:
+                    return visitExpressionStmt(nodes_[stmt.as<Expression>()]);
+                case Kind::RETURN:
+                    return visitReturnStmt(nodes_[stmt.as<Return>()]);
+                case Kind::IF:
+                    return visitIfStmt(nodes_[stmt.as<If>()]);
+                case Kind::FOR:
+                    return visitForStmt(nodes_[stmt.as<For>()]);
+                }
+                __builtin_unreachable();
             }
 
         protected:
+            /** @brief Arena the visited nodes live in */
+            virtual const Arena &nodes() const = 0;
+
             virtual R visitBlockStmt(const Block &stmt) = 0;
             virtual R visitVarDeclStmt(const VarDecl &stmt) = 0;
             virtual R visitFunctionStmt(const Function &stmt) = 0;
@@ -424,9 +735,59 @@ namespace ast
             virtual R visitIfStmt(const If &stmt) = 0;
             virtual R visitForStmt(const For &stmt) = 0;
         };
+
+        /** @brief Function definition `stmt` refers to, of any kind, `nullptr` for other statements */
+        inline const Function *functionOf(const Arena &nodes, StmtRef stmt)
+        {
+            if (const auto *fn = nodes.getIf<Function>(stmt))
+                return fn;
+            if (const auto *binOp = nodes.getIf<BinOpDef>(stmt))
+                return binOp;
+            return nodes.getIf<UnaryOpDef>(stmt);
+        }
     } // namespace stmt
 
-    using Program = std::vector<statement::StmtPtr>;
+    inline Type Arena::typeOf(expression::ExprRef expr) const
+    {
+        using namespace expression;
+        switch (expr.kind())
+        {
+        case Kind::NUMBER:
+            return (*this)[expr.as<Number>()].Ty;
+        case Kind::VARIABLE:
+            return (*this)[expr.as<Variable>()].Ty;
+        case Kind::BINARY:
+            return (*this)[expr.as<Binary>()].Ty;
+        case Kind::UNARY:
+            return (*this)[expr.as<Unary>()].Ty;
+        case Kind::CONDITIONAL:
+            return (*this)[expr.as<Conditional>()].Ty;
+        case Kind::CALL:
+            return (*this)[expr.as<Call>()].Ty;
+        case Kind::INDEX:
+            return (*this)[expr.as<Index>()].Ty;
+        case Kind::LENGTH:
+            return (*this)[expr.as<Length>()].Ty;
+        }
+        __builtin_unreachable();
+    }
+
+    inline std::optional<int64_t> statement::VarDecl::fixedLength(const Arena &nodes) const
+    {
+        if (!Size.has_value())
+            return std::nullopt;
+        const auto *literal = nodes.getIf<expression::Number>(Size.value());
+        if (!literal || !literal->IsInteger)
+            return std::nullopt;
+        return (int64_t)literal->Val;
+    }
+
+    /** @brief Parsed program: the arena of its nodes and its top level statements in source order */
+    struct Program
+    {
+        Arena Nodes;
+        std::vector<statement::StmtRef> Statements;
+    };
 
 } // namespace ast
 
@@ -5,11 +5,12 @@
 
 namespace ast
 {
-    SimplePrinter::SimplePrinter() : statement::Visitor<void>(), expression::Visitor<void>(), indent_{0} {}
+    SimplePrinter::SimplePrinter() : statement::Visitor<void>(), expression::Visitor<void>(), indent_{0}, nodes_{nullptr} {}
 
     void SimplePrinter::print(const Program &program)
     {
-        for (const auto &stmt : program)
+        nodes_ = &program.Nodes;
+        for (const auto &stmt : program.Statements)
         {
             visit(stmt);
         }
@@ -24,19 +25,19 @@ namespace ast
     {
         printIndent();
         std::cout << "FunctionDeclaration [ " << stmt.Name.lexeme << " ]  Params: ";
-        for (const auto &param : stmt.Params)
+        for (const auto &param : (*nodes_)[stmt.Params])
             std::cout << param.lexeme << " ";
         std::cout << '\n';
 
         increaseIndent();
-        for (const auto &stmt : stmt.Body)
+        for (const auto &stmt : (*nodes_)[stmt.Body])
             visit(stmt);
         decreaseIndent();
     }
 
-    void SimplePrinter::visitBinOpDefStmt(const statement::BinOpDef &stmt) {}
+    void SimplePrinter::visitBinOpDefStmt(const statement::BinOpDef &stmt) { visitFunctionStmt(stmt); }
 
-    void SimplePrinter::visitUnaryOpDefStmt(const statement::UnaryOpDef &stmt) {}
+    void SimplePrinter::visitUnaryOpDefStmt(const statement::UnaryOpDef &stmt) { visitFunctionStmt(stmt); }
 
     void SimplePrinter::visitExpressionStmt(const statement::Expression &stmt)
     {
@@ -139,6 +140,22 @@ namespace ast
     }
 
     void SimplePrinter::visitCallExpr(const expression::Call &expr) {}
+
+    void SimplePrinter::visitIndexExpr(const expression::Index &expr)
+    {
+        printIndent();
+        std::cout << "Index [ " << (*nodes_)[expr.Array].Name.lexeme << " ]\n";
+
+        increaseIndent();
+        visit(expr.Idx);
+        decreaseIndent();
+    }
+
+    void SimplePrinter::visitLengthExpr(const expression::Length &expr)
+    {
+        printIndent();
+        std::cout << "Length [ " << (*nodes_)[expr.Array].Name.lexeme << " ]\n";
+    }
     //<
 
     std::string SimplePrinter::op(ast::BinaryOp op) const noexcept
@@ -153,6 +170,10 @@ namespace ast
             return "*";
         case ast::BinaryOp::DIV:
             return "/";
+        case ast::BinaryOp::AND:
+            return "&&";
+        case ast::BinaryOp::OR:
+            return "||";
         default:
             return "unknown";
         }
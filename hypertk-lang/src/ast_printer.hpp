@@ -11,6 +11,7 @@ namespace ast
     {
     private:
         int indent_;
+        const Arena *nodes_;
 
     public:
         explicit SimplePrinter();
@@ -21,6 +22,8 @@ namespace ast
         using expression::Visitor<void>::visit;
         using statement::Visitor<void>::visit;
 
+        const Arena &nodes() const override { return *nodes_; }
+
         //> Print statements
         void visitBlockStmt(const statement::Block &stmt);
         void visitVarDeclStmt(const statement::VarDecl &stmt);
@@ -40,6 +43,8 @@ namespace ast
         void visitUnaryExpr(const expression::Unary &expr);
         void visitConditionalExpr(const expression::Conditional &expr);
         void visitCallExpr(const expression::Call &expr);
+        void visitIndexExpr(const expression::Index &expr);
+        void visitLengthExpr(const expression::Length &expr);
         //<
 
         std::string op(ast::BinaryOp op) const noexcept;
@@ -1,15 +1,86 @@
+#include <cmath>
 #include <cstdio>
+#include <cstdlib>
 
 #include "builtin.hpp"
+#include "output.hpp"
+#include "parallel.hpp"
 
 double putchard(double X)
 {
-    fputc((char)X, stderr);
+    output::put((char)X);
     return 0;
 }
 
 double printd(double X)
 {
-    fprintf(stderr, "%f\n", X);
+    output::printNumber(X);
     return 0;
 }
+
+double flushd()
+{
+    output::flush();
+    return 0;
+}
+
+void hypertk_index_error(int64_t index, int64_t length)
+{
+    // In a parallel loop the other threads stop first, then the output every thread buffered is written.
+    parallel::stop();
+    output::flushAll();
+    fprintf(stderr, "Error: index %lld out of bounds for array of length %lld\n", (long long)index, (long long)length);
+    exit(1);
+}
+
+namespace builtin
+{
+    static constexpr MathFunction MathFunctions[] = {
+        {"sqrt", Math::SQRT, 1},
+        {"sin", Math::SIN, 1},
+        {"cos", Math::COS, 1},
+        {"exp", Math::EXP, 1},
+        {"log", Math::LOG, 1},
+        {"fabs", Math::FABS, 1},
+        {"floor", Math::FLOOR, 1},
+        {"ceil", Math::CEIL, 1},
+        {"pow", Math::POW, 2},
+        {"fma", Math::FMA, 3},
+    };
+
+    const MathFunction *findMathFunction(std::string_view name)
+    {
+        for (const MathFunction &fn : MathFunctions)
+            if (fn.Name == name)
+                return &fn;
+        return nullptr;
+    }
+
+    double callMath(Math op, const double *args)
+    {
+        switch (op)
+        {
+        case Math::SQRT:
+            return std::sqrt(args[0]);
+        case Math::SIN:
+            return std::sin(args[0]);
+        case Math::COS:
+            return std::cos(args[0]);
+        case Math::EXP:
+            return std::exp(args[0]);
+        case Math::LOG:
+            return std::log(args[0]);
+        case Math::FABS:
+            return std::fabs(args[0]);
+        case Math::FLOOR:
+            return std::floor(args[0]);
+        case Math::CEIL:
+            return std::ceil(args[0]);
+        case Math::POW:
+            return std::pow(args[0], args[1]);
+        case Math::FMA:
+            return std::fma(args[0], args[1], args[2]);
+        }
+        return 0;
+    }
+} // namespace builtin
@@ -1,6 +1,9 @@
 #ifndef HYPERTK_BUILTIN_HPP
 #define HYPERTK_BUILTIN_HPP
 
+#include <cstdint>
+#include <string_view>
+
 #ifdef _WIN32
 /// @note for Windows we need to actually export the functions because the dynamic symbol loader will use `GetProcAddress` to find the symbols.
 #define DLLEXPORT __declspec(dllexport)
@@ -10,11 +13,56 @@
 
 #define __HYPERTK_BUILTIN_FUNCTION extern "C" DLLEXPORT
 
-/// @brief Putchar that takes a double and returns 0.
+/// @brief Putchar that takes a double and returns 0, the character is buffered, see `output`.
 /// @note Mark it `extern "C"` so that the function name doesn’t get mangled.
 __HYPERTK_BUILTIN_FUNCTION double putchard(double X);
 
 /// @brief Printf that takes a double prints it as "%f\n", returning 0.
 __HYPERTK_BUILTIN_FUNCTION double printd(double X);
 
+/// @brief Write out the output buffered by the calling thread, returning 0.
+__HYPERTK_BUILTIN_FUNCTION double flushd();
+
+/// @brief Report an array index out of bounds and exit, called by the bounds checks of the generated code.
+__HYPERTK_BUILTIN_FUNCTION void hypertk_index_error(int64_t index, int64_t length);
+
+/// @brief Run the outlined body of a `parallel for` over `count` iterations on the thread pool, see `parallel::run`.
+__HYPERTK_BUILTIN_FUNCTION double hypertk_parallel_for(double (*body)(int64_t, int64_t, void *), void *env, int64_t count);
+
+namespace builtin
+{
+    /**
+     * @brief Functions of the builtin math library.
+     * @details A call to one compiles to the LLVM intrinsic of the same name (`sqrt` to `llvm.sqrt`), which the
+     * optimizer can constant fold and vectorize. Where the target has no instruction for it, the backend calls
+     * the C library function of that name instead, so an AOT object using them is linked with `-lm`.
+     */
+    enum class Math
+    {
+        SQRT,
+        SIN,
+        COS,
+        EXP,
+        LOG,
+        FABS,
+        FLOOR,
+        CEIL,
+        POW,
+        FMA,
+    };
+
+    struct MathFunction
+    {
+        std::string_view Name;
+        Math Op;
+        unsigned Arity;
+    };
+
+    /** @brief Math function called `name`, `nullptr` if there is none. A user defined function of the same name hides it. */
+    const MathFunction *findMathFunction(std::string_view name);
+
+    /** @brief Compute a math function with the C library, `args` holds its arity of values */
+    double callMath(Math op, const double *args);
+} // namespace builtin
+
 #endif
\ No newline at end of file
@@ -5,14 +5,22 @@
 #define ENABLE_COMPILER_OPTIMIZATION_PASS
 /** @brief Enable print ast */
 #define ENABLE_PRINTING_AST
-/** @brief Disable semantic analyzing */
-#define DISABLE_SEMATIC_ANALYZING
+/** @brief Disable semantic analyzing, without it no integer or boolean types are inferred and every value is a double */
+// #define DISABLE_SEMATIC_ANALYZING
 /** @brief Enable print llvm ir */
 #define ENABLE_PRINTING_LLVM_IR
 /** @brief Enable basic jit compiler */
 #define ENABLE_BASIC_JIT_COMPILER
 /** @brief Enable built-in functions */
 #define ENABLE_BUILTIN_FUNCTIONS
+/** @brief Enable tiered execution: interpret first, JIT compile hot functions */
+#define ENABLE_TIERED_EXECUTION
+/** @brief Enable parsing and analyzing the functions of large programs on the thread pool */
+#define ENABLE_PARALLEL_FRONTEND
+
+#if defined(ENABLE_TIERED_EXECUTION) && !defined(ENABLE_BASIC_JIT_COMPILER)
+#error "ENABLE_TIERED_EXECUTION requires ENABLE_BASIC_JIT_COMPILER"
+#endif
 
 template <class... Ts>
 struct overloaded : Ts...
@@ -0,0 +1,129 @@
+#include <string>
+#include <variant>
+#include <vector>
+
+#include "engine.hpp"
+#include "common.hpp"
+#include "ast.hpp"
+#include "error.hpp"
+#include "lexer.hpp"
+#ifndef DISABLE_SEMATIC_ANALYZING
+#include "semantic_analyzer.hpp"
+#endif
+#include "timing.hpp"
+
+#ifdef ENABLE_BASIC_JIT_COMPILER
+namespace hypertk
+{
+    Engine::Engine(unsigned optLevel, const JITOptions &opts)
+        : runtime_{optLevel}, parser_{lexer::Lexer{""}}
+    {
+        runtime_.initializeJIT(opts);
+        runtime_.initializeModuleAndManagers();
+#ifdef ENABLE_BUILTIN_FUNCTIONS
+        runtime_.declareBuiltInFunctions();
+#endif
+    }
+
+    std::optional<Engine::UnitId> Engine::load(const std::string &src)
+    {
+        error::reset();
+        parser_.reset(lexer::Lexer{src});
+
+        std::optional<ast::Program> program;
+        {
+            timing::ScopedPhase phase(timing::Phase::PARSE);
+            program = parser_.parse();
+        }
+        if (error::hasError() || !program.has_value())
+            return std::nullopt;
+#ifndef DISABLE_SEMATIC_ANALYZING
+        {
+            timing::ScopedPhase phase(timing::Phase::ANALYZE);
+            semantic_analysis::BasicSemanticAnalyzer analyzer(program.value());
+            if (!analyzer.analyze())
+                return std::nullopt;
+        }
+#endif
+
+        std::vector<const ast::statement::Function *> defs;
+        for (const auto &stmt : program->Statements)
+        {
+            if (const auto *fn = ast::statement::functionOf(program->Nodes, stmt))
+                defs.push_back(fn);
+            else
+            {
+                error::error(0, "Only function and operator definitions can be loaded.");
+                return std::nullopt;
+            }
+        }
+
+        Unit unit{runtime_.createResourceTracker(), {}};
+        if (!runtime_.compileFunctions(program->Nodes, defs, unit.RT, /* batchEntries */ true))
+            return std::nullopt;
+
+        UnitId id = nextUnit_++;
+        for (const auto *def : defs)
+        {
+            unit.Functions.emplace_back(def->Name.lexeme);
+            owners_[std::string(def->Name.lexeme)] = id;
+        }
+        units_.emplace(id, std::move(unit));
+        return id;
+    }
+
+    bool Engine::unload(UnitId id)
+    {
+        auto unit = units_.find(id);
+        if (unit == units_.end())
+        {
+            error::error(0, "Unknown unit.");
+            return false;
+        }
+
+        for (const auto &name : unit->second.Functions)
+        {
+            owners_.erase(name);
+            entries_.erase(name);
+            entries_.erase(name + RuntimeLLVM::BatchSuffix);
+        }
+
+        bool ok = runtime_.removeFunctions(unit->second.RT, unit->second.Functions);
+        units_.erase(unit);
+        return ok;
+    }
+
+    bool Engine::callBatch(const std::string &name, const std::vector<const double *> &args, double *out, int64_t n)
+    {
+        BatchFunction fn = batchFunction(name, args.size());
+        if (!fn)
+            return false;
+
+        fn(args.data(), out, n);
+        return true;
+    }
+
+    void *Engine::resolve(const std::string &name, unsigned arity, bool batch)
+    {
+        const std::string symbol = batch ? name + RuntimeLLVM::BatchSuffix : name;
+        if (auto entry = entries_.find(symbol); entry != entries_.end())
+            return entry->second;
+
+        if (!owners_.count(name))
+        {
+            error::error(0, "Unknown function [ " + name + " ]");
+            return nullptr;
+        }
+        if (runtime_.getFunctionArity(name) != arity)
+        {
+            error::error(0, "Function [ " + name + " ] does not take " + std::to_string(arity) + " arguments");
+            return nullptr;
+        }
+
+        void *address = runtime_.lookupFunction(symbol);
+        if (address)
+            entries_[symbol] = address;
+        return address;
+    }
+} // namespace hypertk
+#endif
@@ -0,0 +1,103 @@
+#ifndef HYPERTK_ENGINE_HPP
+#define HYPERTK_ENGINE_HPP
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hpp"
+#include "parser.hpp"
+#include "runtime_llvm.hpp"
+
+namespace hypertk
+{
+    /**
+     * @brief Host facing API to embed hypertk into a C++ program.
+     * @details Source is loaded as a unit of definitions, each unit is compiled into its own
+     * module and can be unloaded again. Functions are resolved once into typed function
+     * pointers that the host calls directly, without going through the engine:
+     * @code
+     * hypertk::Engine engine;
+     * auto unit = engine.load("func add(a, b) { return a + b; }");
+     * auto add = engine.function<double, double>("add"); // double (*)(double, double)
+     * double sum = add(1, 2);
+     * @endcode
+     * @note What the functions print with `putchard` and `printd` is buffered per thread until
+     * `output::flush` is called or the thread exits.
+     */
+    class Engine : private Uncopyable
+    {
+    public:
+        using UnitId = uint64_t;
+
+        /** @brief Typed entry point of a hypertk function, every value is a `double` */
+        template <class... Args>
+        using Function = double (*)(Args...);
+
+        /** @brief Batch entry point: `out[i] = f(args[0][i], ..., args[arity - 1][i])` for `i < n` */
+        using BatchFunction = void (*)(const double *const *args, double *out, int64_t n);
+
+        /**
+         * @param optLevel optimization level 0..3.
+         * @param opts JIT options, `Lazy` compiles each function (and batch entry point) on its first call.
+         */
+        explicit Engine(unsigned optLevel = 2, const JITOptions &opts = {});
+
+        /**
+         * @brief Parse and compile source of function and operator definitions.
+         * @return the unit owning the compiled code, `std::nullopt` on error.
+         */
+        std::optional<UnitId> load(const std::string &src);
+
+        /**
+         * @brief Free the code of a unit, its functions may be loaded again afterwards.
+         * @warning Handles to its functions become dangling, and no other unit may still call them.
+         */
+        bool unload(UnitId unit);
+
+        /** @brief Resolve a function, `nullptr` if not loaded or if its arity differs */
+        template <class... Args>
+        Function<Args...> function(const std::string &name)
+        {
+            static_assert((std::is_same_v<Args, double> && ...), "hypertk functions only take doubles");
+            return reinterpret_cast<Function<Args...>>(resolve(name, sizeof...(Args), false));
+        }
+
+        /** @brief Resolve the batch entry point of a function of `arity` params, `nullptr` if not loaded */
+        BatchFunction batchFunction(const std::string &name, unsigned arity)
+        {
+            return reinterpret_cast<BatchFunction>(resolve(name, arity, true));
+        }
+
+        /**
+         * @brief Apply a function over columns of arguments, see `BatchFunction`.
+         * @param args one column of `n` values per parameter of the function.
+         * @param out `n` results, must not overlap any column.
+         */
+        bool callBatch(const std::string &name, const std::vector<const double *> &args, double *out, int64_t n);
+
+    private:
+        struct Unit
+        {
+            llvm::orc::ResourceTrackerSP RT;
+            std::vector<std::string> Functions;
+        };
+
+        RuntimeLLVM runtime_;
+        /** @brief Shared by all units so user defined operators stay known */
+        parser::Parser parser_;
+        UnitId nextUnit_ = 0;
+        std::unordered_map<UnitId, Unit> units_;
+        /** @brief Addresses of the resolved entry points by symbol name */
+        std::unordered_map<std::string, void *> entries_;
+        /** @brief Unit defining each loaded function */
+        std::unordered_map<std::string, UnitId> owners_;
+
+        void *resolve(const std::string &name, unsigned arity, bool batch);
+    };
+} // namespace hypertk
+
+#endif
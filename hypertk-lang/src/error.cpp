@@ -3,37 +3,66 @@
 
 #include "error.hpp"
 #include "token.hpp"
+#include "output.hpp"
 
 namespace error
 {
     static bool hasError_ = false;
+    /** @brief Capture of the thread, `nullptr` while its errors are reported */
+    static thread_local Capture *capture_ = nullptr;
 
     bool hasError() { return hasError_; }
 
+    void reset() { hasError_ = false; }
+
     static inline void report(const int line, const std::string where, const std::string msg)
     {
         hasError_ = true;
+        // Output the program printed before the error shows before it.
+        output::flush();
         std::cerr << "[line " << line << "] Error " << where << ": " << msg << "\n";
     }
 
+    Capture::Capture() : outer_{capture_}
+    {
+        capture_ = this;
+    }
+
+    Capture::~Capture()
+    {
+        capture_ = outer_;
+    }
+
     void error(const int line, const std::string &msg)
     {
+        if (capture_)
+        {
+            capture_->caught_ = true;
+            return;
+        }
+
         report(line, "", msg);
     }
 
     void error(const token::Token &t, const std::string &msg)
     {
+        if (capture_)
+        {
+            capture_->caught_ = true;
+            return;
+        }
+
         if (t.type == token::TokenType::END_OF_FILE)
         {
             report(t.line, "at end", msg);
         }
         else if (t.type == token::TokenType::ERROR)
         {
-            report(t.line, "", t.lexeme);
+            report(t.line, "", std::string(t.lexeme));
         }
         else
         {
-            report(t.line, std::string("at '") + t.lexeme + "'", msg);
+            report(t.line, "at '" + std::string(t.lexeme) + "'", msg);
         }
     }
 } // namespace error
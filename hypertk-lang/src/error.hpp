@@ -8,9 +8,34 @@
 namespace error
 {
     bool hasError();
+    /** @brief Forget the errors reported so far, e.g. between REPL entries */
+    void reset();
 
     void error(const int line, const std::string &msg);
     void error(const token::Token &t, const std::string &msg);
+
+    /**
+     * @brief Hold back the errors reported on the thread while it lives, they are neither
+     * printed nor counted by `hasError`.
+     * @details For work run on the side whose errors are found again by a sequential rerun,
+     * e.g. a function parsed on the thread pool.
+     */
+    class Capture : private Uncopyable
+    {
+    public:
+        Capture();
+        ~Capture();
+
+        /** @brief An error was reported since the capture started */
+        bool caught() const { return caught_; }
+
+    private:
+        friend void error(const int line, const std::string &msg);
+        friend void error(const token::Token &t, const std::string &msg);
+
+        Capture *outer_;
+        bool caught_ = false;
+    };
 } // namespace error
 
 #endif
\ No newline at end of file
@@ -0,0 +1,841 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+#include "interpreter.hpp"
+#include "common.hpp"
+#include "ast.hpp"
+#include "error.hpp"
+#include "parallel.hpp"
+#include "profile.hpp"
+#ifdef ENABLE_BUILTIN_FUNCTIONS
+#include "builtin.hpp"
+#endif
+
+namespace hypertk
+{
+    namespace
+    {
+        /** @brief Same truthiness as the generated code: ordered and not equal to 0.0 */
+        inline bool isTruthy(double v) { return !std::isnan(v) && v != 0.0; }
+
+        /** @brief Symbols of the functions defining user operators, e.g. `binary|`, indexed by the operator's token type */
+        struct OperatorSymbols
+        {
+            std::array<symbol::Symbol, token::TokenTypeCount> Binary{};
+            std::array<symbol::Symbol, token::TokenTypeCount> Unary{};
+
+            OperatorSymbols()
+            {
+                for (size_t t = 0; t < token::TokenTypeCount; ++t)
+                {
+                    if (char op = ast::BinaryOp2Char((ast::BinaryOp)t))
+                        Binary[t] = symbol::intern(std::string("binary") + op);
+                    if (char op = ast::UnaryOp2Char((ast::UnaryOp)t))
+                        Unary[t] = symbol::intern(std::string("unary") + op);
+                }
+            }
+        };
+
+        /** @brief The operator names are interned once, evaluating an operator only indexes the table */
+        const OperatorSymbols &operatorSymbols()
+        {
+            static const OperatorSymbols symbols;
+            return symbols;
+        }
+
+        symbol::Symbol operatorSymbol(ast::BinaryOp op) { return operatorSymbols().Binary[(size_t)op]; }
+        symbol::Symbol operatorSymbol(ast::UnaryOp op) { return operatorSymbols().Unary[(size_t)op]; }
+
+        /** @brief Collect names of every function a function body or a loop may call, operators included */
+        class CalleeCollector
+            : protected ast::statement::Visitor<void>,
+              protected ast::expression::Visitor<void>
+        {
+        public:
+            explicit CalleeCollector(const ast::Arena &nodes) : nodes_{nodes} {}
+
+            std::vector<symbol::Symbol> collect(const ast::statement::Function &fn)
+            {
+                begin();
+                for (const auto &stmt : nodes_[fn.Body])
+                    visit(stmt);
+                return std::move(names_);
+            }
+
+            std::vector<symbol::Symbol> collect(const ast::statement::For &loop)
+            {
+                begin();
+                visitForStmt(loop);
+                return std::move(names_);
+            }
+
+            /** @brief Names the `parallel for` loops of the last collected code may call */
+            const std::vector<symbol::Symbol> &parallelNames() const { return parallelNames_; }
+
+        private:
+            const ast::Arena &nodes_;
+            std::vector<symbol::Symbol> names_;
+            std::vector<symbol::Symbol> parallelNames_;
+            /** @brief Visiting the body of a `parallel for` */
+            bool inParallel_ = false;
+
+            void begin()
+            {
+                names_.clear();
+                parallelNames_.clear();
+                inParallel_ = false;
+            }
+
+            void add(symbol::Symbol name)
+            {
+                names_.push_back(name);
+                if (inParallel_)
+                    parallelNames_.push_back(name);
+            }
+
+        protected:
+            using ast::statement::Visitor<void>::visit;
+            using ast::expression::Visitor<void>::visit;
+
+            const ast::Arena &nodes() const override { return nodes_; }
+
+            //> statements
+            void visitBlockStmt(const ast::statement::Block &stmt)
+            {
+                for (const auto &stmt_ : nodes_[stmt.Statements])
+                    visit(stmt_);
+            }
+            void visitVarDeclStmt(const ast::statement::VarDecl &stmt)
+            {
+                if (stmt.Initializer.has_value())
+                    visit(stmt.Initializer.value());
+                if (stmt.Size.has_value())
+                    visit(stmt.Size.value());
+            }
+            void visitFunctionStmt(const ast::statement::Function &stmt) {}
+            void visitBinOpDefStmt(const ast::statement::BinOpDef &stmt) {}
+            void visitUnaryOpDefStmt(const ast::statement::UnaryOpDef &stmt) {}
+            void visitExpressionStmt(const ast::statement::Expression &stmt) { visit(stmt.Expr); }
+            void visitReturnStmt(const ast::statement::Return &stmt) { visit(stmt.Expr); }
+            void visitIfStmt(const ast::statement::If &stmt)
+            {
+                visit(stmt.Cond);
+                visit(stmt.Then);
+                if (stmt.Else.has_value())
+                    visit(stmt.Else.value());
+            }
+            void visitForStmt(const ast::statement::For &stmt)
+            {
+                visit(stmt.Start);
+                visit(stmt.End);
+                visit(stmt.Step);
+                // Only the body of a `parallel for` runs on the pool.
+                const bool outer = inParallel_;
+                inParallel_ = inParallel_ || stmt.Parallel;
+                visit(stmt.Body);
+                inParallel_ = outer;
+            }
+            //<
+
+            //> expressions
+            void visitNumberExpr(const ast::expression::Number &expr) {}
+            void visitVariableExpr(const ast::expression::Variable &expr) {}
+            void visitBinaryExpr(const ast::expression::Binary &expr)
+            {
+                switch (expr.Op)
+                {
+                case ast::BinaryOp::ADD:
+                case ast::BinaryOp::SUB:
+                case ast::BinaryOp::MUL:
+                case ast::BinaryOp::DIV:
+                case ast::BinaryOp::LESS:
+                case ast::BinaryOp::EQUAL:
+                case ast::BinaryOp::AND:
+                case ast::BinaryOp::OR:
+                    break;
+                default:
+                    add(operatorSymbol(expr.Op));
+                    break;
+                }
+                visit(expr.LHS);
+                visit(expr.RHS);
+            }
+            void visitUnaryExpr(const ast::expression::Unary &expr)
+            {
+                if (!ast::isBuiltinUnaryOp(expr.Op))
+                    add(operatorSymbol(expr.Op));
+                visit(expr.Operand);
+            }
+            void visitConditionalExpr(const ast::expression::Conditional &expr)
+            {
+                visit(expr.Cond);
+                visit(expr.Then);
+                visit(expr.Else);
+            }
+            void visitCallExpr(const ast::expression::Call &expr)
+            {
+                add(nodes_[expr.Callee].Name.symbol);
+                for (const auto &arg : nodes_[expr.Args])
+                    visit(arg);
+            }
+            void visitIndexExpr(const ast::expression::Index &expr) { visit(expr.Idx); }
+            void visitLengthExpr(const ast::expression::Length &expr) {}
+            //<
+        };
+    } // namespace
+
+    Interpreter::Interpreter(RuntimeLLVM &runtime, unsigned tierThreshold)
+        : ast::statement::Visitor<Signal>(),
+          ast::expression::Visitor<std::optional<double>>(),
+          runtime_{runtime},
+          tierThreshold_{tierThreshold},
+          nodes_{nullptr},
+          frameBase_{0},
+          currentFunction_{nullptr},
+          returnValue_{0} {}
+
+    std::optional<double> Interpreter::run(const ast::Program &program)
+    {
+        nodes_ = &program.Nodes;
+
+        // Register top-level functions first, they may be called before their declaration.
+        for (const auto &stmt : program.Statements)
+        {
+            if (!ast::statement::functionOf(program.Nodes, stmt))
+            {
+                error::error(0, "Only function declarations are allowed at top level.");
+                return std::nullopt;
+            }
+
+            if (visit(stmt) == Signal::ERROR)
+                return std::nullopt;
+        }
+
+        auto main_ = functions_.find(symbol::intern("main"));
+        if (main_ == functions_.end())
+        {
+            error::error(0, "HyperTk expect a `main` function.");
+            return std::nullopt;
+        }
+
+        return call(main_->second, {});
+    }
+
+    //> statements
+    Signal Interpreter::visitBlockStmt(const ast::statement::Block &stmt)
+    {
+        Signal signal = Signal::NORMAL;
+
+        beginScope();
+        for (const auto &stmt_ : nodes()[stmt.Statements])
+            if (signal = visit(stmt_), signal != Signal::NORMAL)
+                break;
+        endScope();
+
+        return signal;
+    }
+
+    Signal Interpreter::visitVarDeclStmt(const ast::statement::VarDecl &stmt)
+    {
+        if (scopes_.back().count(stmt.VarName.symbol))
+        {
+            error::error(stmt.VarName, "Already a variable with this name in this scope.");
+            return Signal::ERROR;
+        }
+        if (stmt.isArray())
+        {
+            arraysNeedJIT(stmt.VarName.line);
+            return Signal::ERROR;
+        }
+
+        double initializer = 0;
+        if (stmt.Initializer.has_value())
+        {
+            auto value = visit(stmt.Initializer.value());
+            if (!value.has_value())
+                return Signal::ERROR;
+            initializer = value.value();
+        }
+
+        // Not bound before the initializer ran, calls in it may grow `scopes_`.
+        scopes_.back()[stmt.VarName.symbol] = {initializer, stmt.Ty};
+        return Signal::NORMAL;
+    }
+
+    Signal Interpreter::visitFunctionStmt(const ast::statement::Function &stmt)
+    {
+        if (currentFunction_)
+        {
+            error::error(stmt.Name, "Functions can only be declared at top level.");
+            return Signal::ERROR;
+        }
+
+        auto &fn = functions_[stmt.Name.symbol];
+        if (fn.Decl)
+        {
+            error::error(stmt.Name, "Function cannot be redefined.");
+            return Signal::ERROR;
+        }
+
+        fn.Decl = &stmt;
+        fn.Hot = profile::count(std::string(stmt.Name.lexeme)) >= tierThreshold_;
+        return Signal::NORMAL;
+    }
+
+    Signal Interpreter::visitBinOpDefStmt(const ast::statement::BinOpDef &stmt)
+    {
+        return visitFunctionStmt(stmt);
+    }
+
+    Signal Interpreter::visitUnaryOpDefStmt(const ast::statement::UnaryOpDef &stmt)
+    {
+        return visitFunctionStmt(stmt);
+    }
+
+    Signal Interpreter::visitExpressionStmt(const ast::statement::Expression &stmt)
+    {
+        return visit(stmt.Expr).has_value() ? Signal::NORMAL : Signal::ERROR;
+    }
+
+    Signal Interpreter::visitReturnStmt(const ast::statement::Return &stmt)
+    {
+        auto value = visit(stmt.Expr);
+        if (!value.has_value())
+            return Signal::ERROR;
+
+        returnValue_ = value.value();
+        return Signal::RETURN;
+    }
+
+    Signal Interpreter::visitIfStmt(const ast::statement::If &stmt)
+    {
+        auto cond = visit(stmt.Cond);
+        if (!cond.has_value())
+            return Signal::ERROR;
+
+        if (isTruthy(cond.value()))
+            return visit(stmt.Then);
+        if (stmt.Else.has_value())
+            return visit(stmt.Else.value());
+
+        return Signal::NORMAL;
+    }
+
+    /// @details Mirror the loop emitted by `RuntimeLLVM::visitForStmt`: the end condition is
+    /// tested before every run of the body, then the step is evaluated and added to the variable.
+    Signal Interpreter::visitForStmt(const ast::statement::For &stmt)
+    {
+        if (stmt.Parallel)
+            return runParallelFor(stmt);
+
+        // Evaluate the start value first, without the variable in scope.
+        auto start = visit(stmt.Start);
+        if (!start.has_value())
+            return Signal::ERROR;
+
+        Signal signal = Signal::NORMAL;
+
+        beginScope();
+        scopes_.back()[stmt.VarName.symbol] = {start.value(), stmt.Ty};
+        while (true)
+        {
+            auto end = visit(stmt.End);
+            if (!end.has_value())
+            {
+                signal = Signal::ERROR;
+                break;
+            }
+            if (!isTruthy(end.value()))
+                break;
+
+            if (signal = visit(stmt.Body), signal != Signal::NORMAL)
+                break;
+
+            auto step = visit(stmt.Step);
+            if (!step.has_value())
+            {
+                signal = Signal::ERROR;
+                break;
+            }
+
+            // The body may have mutated the variable, reload it before incrementing.
+            double &var = scopes_.back()[stmt.VarName.symbol].Value;
+            var += step.value();
+
+            // Past the tier threshold the rest of the loop runs compiled, the function's next call compiles it.
+            FunctionInfo &fn = *currentFunction_;
+            if (++fn.BackEdges + fn.Calls >= tierThreshold_)
+                if (auto osr = enterCompiledLoop(stmt))
+                {
+                    signal = osr.value();
+                    break;
+                }
+        }
+        endScope();
+
+        return signal;
+    }
+
+    /// @details Runs on the calling thread, in the iterations and chunks `RuntimeLLVM::emitParallelFor`
+    /// hands to the pool: a reduction sums each chunk on its own then the chunk sums in order, so
+    /// the interpreted and the compiled loop give the same total.
+    Signal Interpreter::runParallelFor(const ast::statement::For &stmt)
+    {
+        const auto &cond = nodes()[stmt.End.as<ast::expression::Binary>()];
+        auto start = visit(stmt.Start);
+        auto step = start.has_value() ? visit(stmt.Step) : std::nullopt;
+        auto bound = step.has_value() ? visit(cond.RHS) : std::nullopt;
+        if (!bound.has_value())
+            return Signal::ERROR;
+
+        double span = bound.value() - start.value();
+        int64_t count = step.value() > 0 && span > 0 ? (int64_t)std::ceil(span / step.value()) : 0;
+        int64_t chunk = parallel::chunkSize(count);
+
+        Signal signal = Signal::NORMAL;
+        double total = 0;
+        beginScope();
+        for (int64_t first = 0; first < count && signal == Signal::NORMAL; first += chunk)
+        {
+            double partial = 0;
+            for (int64_t k = first; k < std::min(first + chunk, count); ++k)
+            {
+                scopes_.back()[stmt.VarName.symbol] = {start.value() + (double)k * step.value(), stmt.Ty};
+                if (stmt.Reduce.has_value())
+                {
+                    auto value = visit(nodes().getIf<ast::statement::Expression>(stmt.Body)->Expr);
+                    if (!value.has_value())
+                    {
+                        signal = Signal::ERROR;
+                        break;
+                    }
+                    partial += value.value();
+                }
+                else if (signal = visit(stmt.Body), signal != Signal::NORMAL)
+                    break;
+
+                currentFunction_->BackEdges++;
+            }
+            total += partial;
+        }
+        endScope();
+
+        if (signal == Signal::NORMAL && stmt.Reduce.has_value())
+            *resolveVariable(nodes()[stmt.Reduce.value()].Name.symbol) += total;
+
+        return signal;
+    }
+    //<
+
+    //> expressions
+    std::optional<double> Interpreter::visitNumberExpr(const ast::expression::Number &expr)
+    {
+        return expr.Val;
+    }
+
+    std::optional<double> Interpreter::visitVariableExpr(const ast::expression::Variable &expr)
+    {
+        if (double *var = resolveVariable(expr.Name.symbol))
+            return *var;
+
+        error::error(expr.Name, "Unknown variable name");
+        return std::nullopt;
+    }
+
+    std::optional<double> Interpreter::visitBinaryExpr(const ast::expression::Binary &expr)
+    {
+        // Special case '=' because we don't want to evaluate the LHS as an expression.
+        if (expr.Op == ast::BinaryOp::EQUAL)
+        {
+            const auto *LHSE = nodes().getIf<ast::expression::Variable>(expr.LHS);
+            if (!LHSE)
+            {
+                error::error(0, "destination of '=' must be a variable");
+                return std::nullopt;
+            }
+
+            // Resolved after the RHS ran, calls in it may grow `scopes_`.
+            auto RHS = visit(expr.RHS);
+            if (!RHS.has_value())
+                return std::nullopt;
+
+            double *var = resolveVariable(LHSE->Name.symbol);
+            if (!var)
+            {
+                error::error(LHSE->Name, "Unknown variable name.");
+                return std::nullopt;
+            }
+
+            return *var = RHS.value();
+        }
+
+        auto L = visit(expr.LHS);
+        if (!L.has_value())
+            return std::nullopt;
+
+        // Short-circuit: the RHS only runs when the LHS does not decide the result.
+        if (expr.Op == ast::BinaryOp::AND || expr.Op == ast::BinaryOp::OR)
+        {
+            if (isTruthy(L.value()) == (expr.Op == ast::BinaryOp::OR))
+                return expr.Op == ast::BinaryOp::OR ? 1.0 : 0.0;
+
+            auto R = visit(expr.RHS);
+            if (!R.has_value())
+                return std::nullopt;
+            return isTruthy(R.value()) ? 1.0 : 0.0;
+        }
+
+        auto R = visit(expr.RHS);
+        if (!R.has_value())
+            return std::nullopt;
+
+        switch (expr.Op)
+        {
+        case ast::BinaryOp::ADD:
+            return L.value() + R.value();
+        case ast::BinaryOp::SUB:
+            return L.value() - R.value();
+        case ast::BinaryOp::MUL:
+            return L.value() * R.value();
+        case ast::BinaryOp::DIV:
+            return L.value() / R.value();
+        case ast::BinaryOp::LESS:
+            // Unordered less than, as `fcmp ult`
+            return !(L.value() >= R.value()) ? 1.0 : 0.0;
+        default:
+            break;
+        }
+
+        // If it wasn't a builtin binary operator, it must be a user defined one.
+        return callByName(operatorSymbol(expr.Op), {L.value(), R.value()}, 0);
+    }
+
+    std::optional<double> Interpreter::visitUnaryExpr(const ast::expression::Unary &expr)
+    {
+        auto operand = visit(expr.Operand);
+        if (!operand.has_value())
+            return std::nullopt;
+
+        if (expr.Op == ast::UnaryOp::NOT)
+            return isTruthy(operand.value()) ? 0.0 : 1.0;
+
+        return callByName(operatorSymbol(expr.Op), {operand.value()}, 0);
+    }
+
+    std::optional<double> Interpreter::visitConditionalExpr(const ast::expression::Conditional &expr)
+    {
+        auto cond = visit(expr.Cond);
+        if (!cond.has_value())
+            return std::nullopt;
+
+        return isTruthy(cond.value()) ? visit(expr.Then) : visit(expr.Else);
+    }
+
+    std::optional<double> Interpreter::visitCallExpr(const ast::expression::Call &expr)
+    {
+        std::vector<double> args;
+        args.reserve(expr.Args.Size);
+        for (const auto &arg : nodes()[expr.Args])
+        {
+            auto value = visit(arg);
+            if (!value.has_value())
+                return std::nullopt;
+            args.push_back(value.value());
+        }
+
+        const auto &callee = nodes()[expr.Callee].Name;
+        return callByName(callee.symbol, args, callee.line);
+    }
+
+    std::optional<double> Interpreter::visitIndexExpr(const ast::expression::Index &expr)
+    {
+        arraysNeedJIT(nodes()[expr.Array].Name.line);
+        return std::nullopt;
+    }
+
+    std::optional<double> Interpreter::visitLengthExpr(const ast::expression::Length &expr)
+    {
+        arraysNeedJIT(nodes()[expr.Array].Name.line);
+        return std::nullopt;
+    }
+    //<
+
+    std::optional<double> Interpreter::call(FunctionInfo &fn, const std::vector<double> &args)
+    {
+        if (fn.Decl->Params.Size != args.size())
+        {
+            error::error(fn.Decl->Name, std::string("Expected ") + std::to_string(fn.Decl->Params.Size) +
+                                            " arguments, got " + std::to_string(args.size()) + " arguments");
+            return std::nullopt;
+        }
+
+        fn.Calls++;
+        // Arrays only exist in compiled code, a function declaring one is compiled on its first call,
+        // so is one the profile of an earlier run saw hot.
+        if (!fn.Compiled && !fn.Failed && (fn.Decl->HasArrays || fn.Hot || fn.Calls + fn.BackEdges >= tierThreshold_))
+            tierUp(fn);
+        if (fn.Native)
+        {
+            double result = callNative(fn.Native, args);
+            // Failing to materialize a lazily compiled callee is reported from inside the JIT'd code.
+            if (error::hasError())
+                return std::nullopt;
+            return result;
+        }
+
+        // Push a new call frame, callee can't see caller's variables.
+        const size_t callerFrameBase = frameBase_;
+        FunctionInfo *caller = currentFunction_;
+        frameBase_ = scopes_.size();
+        currentFunction_ = &fn;
+
+        beginScope();
+        auto params = nodes()[fn.Decl->Params];
+        for (size_t i = 0; i < args.size(); ++i)
+            scopes_.back()[params[i].symbol] = {args[i], ast::Type::DOUBLE};
+
+        Signal signal = Signal::NORMAL;
+        for (const auto &stmt : nodes()[fn.Decl->Body])
+            if (signal = visit(stmt), signal != Signal::NORMAL)
+                break;
+        scopes_.resize(frameBase_);
+
+        frameBase_ = callerFrameBase;
+        currentFunction_ = caller;
+
+        if (signal == Signal::ERROR)
+            return std::nullopt;
+        // Return 0.0 for functions without explicit return, as the generated code does.
+        return signal == Signal::RETURN ? returnValue_ : 0.0;
+    }
+
+    std::optional<double> Interpreter::callByName(symbol::Symbol sym, const std::vector<double> &args, int line)
+    {
+        auto fn = functions_.find(sym);
+        if (fn != functions_.end())
+            return call(fn->second, args);
+
+        std::string_view name = symbol::name(sym);
+#ifdef ENABLE_BUILTIN_FUNCTIONS
+        if (args.size() == 1)
+        {
+            if (name == "putchard")
+                return putchard(args[0]);
+            if (name == "printd")
+                return printd(args[0]);
+        }
+        if (args.empty() && name == "flushd")
+            return flushd();
+        if (const builtin::MathFunction *math = builtin::findMathFunction(name))
+        {
+            if (args.size() == math->Arity)
+                return builtin::callMath(math->Op, args.data());
+            error::error(line, std::string("Expected ") + std::to_string(math->Arity) +
+                                   " arguments, got " + std::to_string(args.size()) + " arguments");
+            return std::nullopt;
+        }
+#endif
+
+        error::error(line, "Unknown referenced function [ " + std::string(name) + " ]");
+        return std::nullopt;
+    }
+
+    bool Interpreter::tierUp(FunctionInfo &fn)
+    {
+        CalleeCollector collector(nodes());
+        auto callees = collector.collect(*fn.Decl);
+
+        std::vector<FunctionInfo *> infos{&fn};
+        std::vector<RuntimeLLVM::HostFunction> hosts;
+        if (!collectDependencies(callees, collector.parallelNames(), infos, hosts) || !compile(infos, hosts))
+        {
+            fn.Failed = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool Interpreter::compile(const std::vector<FunctionInfo *> &infos, const std::vector<RuntimeLLVM::HostFunction> &hosts)
+    {
+        std::vector<const ast::statement::Function *> defs;
+        for (auto *info : infos)
+            defs.push_back(info->Decl);
+
+        if (!runtime_.compileFunctions(nodes(), defs, nullptr, false, hosts))
+            return false;
+
+        for (auto *info : infos)
+        {
+            info->Compiled = true;
+            if (info->Decl->Params.Size <= MaxNativeArity)
+                info->Native = runtime_.lookupFunction(std::string(info->Decl->Name.lexeme));
+        }
+        return true;
+    }
+
+    bool Interpreter::collectDependencies(const std::vector<symbol::Symbol> &callees,
+                                          const std::vector<symbol::Symbol> &parallelCallees,
+                                          std::vector<FunctionInfo *> &compile,
+                                          std::vector<RuntimeLLVM::HostFunction> &hosts)
+    {
+        std::unordered_set<symbol::Symbol> seen;
+        for (auto *info : compile)
+            seen.insert(info->Decl->Name.symbol);
+
+        auto notCompiled = [&](symbol::Symbol name) -> FunctionInfo *
+        {
+            auto callee = functions_.find(name);
+            if (callee == functions_.end() || callee->second.Compiled || !seen.insert(name).second)
+                return nullptr;
+            return &callee->second;
+        };
+
+        // Everything a `parallel for` may reach is compiled along, transitively.
+        const size_t first = compile.size();
+        for (auto name : parallelCallees)
+            if (auto *info = notCompiled(name))
+                compile.push_back(info);
+        CalleeCollector collector(nodes());
+        for (size_t i = first; i < compile.size(); ++i)
+            for (auto name : collector.collect(*compile[i]->Decl))
+                if (auto *info = notCompiled(name))
+                    compile.push_back(info);
+
+        bool failedBefore = false;
+        for (size_t i = first; i < compile.size(); ++i)
+            failedBefore = failedBefore || compile[i]->Failed;
+
+        for (auto name : callees)
+            if (auto *info = notCompiled(name))
+                hosts.push_back({std::string(info->Decl->Name.lexeme),
+                                 (unsigned)info->Decl->Params.Size,
+                                 &info->Native,
+                                 &Interpreter::callFromNative,
+                                 this,
+                                 info});
+
+        return !failedBefore;
+    }
+
+    double Interpreter::callFromNative(void *interpreter, void *function, const double *args)
+    {
+        auto &fn = *static_cast<FunctionInfo *>(function);
+        auto result = static_cast<Interpreter *>(interpreter)->call(fn, std::vector<double>(args, args + fn.Decl->Params.Size));
+        // The error is reported, the compiled caller's caller checks `error::hasError` once it returns.
+        return result.value_or(std::nan(""));
+    }
+
+    /// @details The loop is compiled the first time one of its back-edges is past the threshold,
+    /// with the variables in scope of the running call as they are then. Later entries of the loop
+    /// reuse the code and look the same variables up by name.
+    std::optional<Signal> Interpreter::enterCompiledLoop(const ast::statement::For &stmt)
+    {
+        FunctionInfo &fn = *currentFunction_;
+        auto [entry, added] = loops_.try_emplace(&stmt);
+        CompiledLoop &loop = entry->second;
+        if (added && !fn.Failed)
+        {
+            // The innermost scope is the loop's own, its variable shadows the others of that name.
+            std::vector<RuntimeLLVM::LoopVariable> variables;
+            std::unordered_set<symbol::Symbol> seen{stmt.VarName.symbol};
+            for (size_t i = scopes_.size() - 1; i-- > frameBase_;)
+                for (const auto &[name, var] : scopes_[i])
+                    if (seen.insert(name).second)
+                    {
+                        variables.push_back({name, var.Ty});
+                        loop.Variables.push_back(name);
+                    }
+
+            CalleeCollector collector(nodes());
+            auto callees = collector.collect(stmt);
+            std::vector<FunctionInfo *> infos;
+            std::vector<RuntimeLLVM::HostFunction> hosts;
+            // Functions reached from a `parallel for` are compiled first, the loop's code calls them.
+            if (collectDependencies(callees, collector.parallelNames(), infos, hosts) &&
+                (infos.empty() || compile(infos, {})))
+                loop.Native = runtime_.compileLoop(nodes(),
+                                                   stmt,
+                                                   std::string(fn.Decl->Name.lexeme) + ".loop" + std::to_string(loops_.size()),
+                                                   variables,
+                                                   hosts);
+        }
+        if (!loop.Native)
+            return std::nullopt;
+
+        std::vector<double> vars;
+        vars.reserve(loop.Variables.size() + 2);
+        for (auto name : loop.Variables)
+        {
+            const double *var = resolveVariable(name);
+            if (!var)
+                return std::nullopt;
+            vars.push_back(*var);
+        }
+        vars.push_back(scopes_.back()[stmt.VarName.symbol].Value);
+        vars.push_back(0);
+
+        double result = reinterpret_cast<double (*)(double *)>(loop.Native)(vars.data());
+        if (error::hasError())
+            return Signal::ERROR;
+        if (vars.back() == 0)
+        {
+            returnValue_ = result;
+            return Signal::RETURN;
+        }
+
+        // Resolved again, the interpreted functions the loop called may have grown `scopes_`.
+        for (size_t i = 0; i < loop.Variables.size(); ++i)
+            *resolveVariable(loop.Variables[i]) = vars[i];
+        return Signal::NORMAL;
+    }
+
+    double Interpreter::callNative(void *fn, const std::vector<double> &args)
+    {
+        using D = double;
+        const D *a = args.data();
+        switch (args.size())
+        {
+        case 0:
+            return reinterpret_cast<D (*)()>(fn)();
+        case 1:
+            return reinterpret_cast<D (*)(D)>(fn)(a[0]);
+        case 2:
+            return reinterpret_cast<D (*)(D, D)>(fn)(a[0], a[1]);
+        case 3:
+            return reinterpret_cast<D (*)(D, D, D)>(fn)(a[0], a[1], a[2]);
+        case 4:
+            return reinterpret_cast<D (*)(D, D, D, D)>(fn)(a[0], a[1], a[2], a[3]);
+        case 5:
+            return reinterpret_cast<D (*)(D, D, D, D, D)>(fn)(a[0], a[1], a[2], a[3], a[4]);
+        case 6:
+            return reinterpret_cast<D (*)(D, D, D, D, D, D)>(fn)(a[0], a[1], a[2], a[3], a[4], a[5]);
+        case 7:
+            return reinterpret_cast<D (*)(D, D, D, D, D, D, D)>(fn)(a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+        default:
+            return reinterpret_cast<D (*)(D, D, D, D, D, D, D, D)>(fn)(a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+        }
+    }
+
+    void Interpreter::arraysNeedJIT(int line)
+    {
+        error::error(line, "Arrays only run compiled, compiling the function failed or it has more than " +
+                               std::to_string(MaxNativeArity) + " parameters.");
+    }
+
+    inline void Interpreter::beginScope() { scopes_.emplace_back(); }
+    inline void Interpreter::endScope() { scopes_.pop_back(); }
+    double *Interpreter::resolveVariable(symbol::Symbol varName)
+    {
+        for (size_t i = scopes_.size(); i > frameBase_; --i)
+        {
+            auto it = scopes_[i - 1].find(varName);
+            if (it != scopes_[i - 1].end())
+                return &it->second.Value;
+        }
+        return nullptr;
+    }
+} // namespace hypertk
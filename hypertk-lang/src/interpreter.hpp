@@ -0,0 +1,163 @@
+#ifndef HYPERTK_INTERPRETER_HPP
+#define HYPERTK_INTERPRETER_HPP
+
+#include <optional>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "common.hpp"
+#include "ast.hpp"
+#include "symbol.hpp"
+#include "runtime_llvm.hpp"
+
+namespace hypertk
+{
+    /** @brief Control flow signal produced by executing a statement */
+    enum class Signal
+    {
+        NORMAL,
+        RETURN,
+        ERROR,
+    };
+
+    /**
+     * @brief Tree-walking interpreter, the first execution tier.
+     * @details The program starts running right away in the interpreter. Every function keeps
+     * a counter of its calls and loop back-edges. Once the counter passes the tier threshold the
+     * next call compiles the function alone with `RuntimeLLVM` and from then on calls go straight
+     * to the native code, which calls the functions still interpreted through the interpreter.
+     * When the counter passes the threshold at a loop's back-edge, the rest of that loop is
+     * compiled and the running call continues in it (on-stack replacement), so a hot loop in
+     * `main` does not run interpreted to its end. Functions declaring arrays are compiled on
+     * their first call, the interpreter does not model arrays. So are functions the profile
+     * given with `--profile-use` saw pass the threshold.
+     */
+    class Interpreter
+        : private Uncopyable,
+          protected ast::statement::Visitor<Signal>,
+          protected ast::expression::Visitor<std::optional<double>>
+    {
+    public:
+        /**
+         * @param runtime used to JIT compile hot functions, must have its JIT and module initialized.
+         * @param tierThreshold calls + loop back-edges a function runs interpreted before being compiled.
+         */
+        Interpreter(RuntimeLLVM &runtime, unsigned tierThreshold);
+
+        /** @brief Run `main` of the program, return `std::nullopt` on error */
+        std::optional<double> run(const ast::Program &program);
+
+    private:
+        /** @brief Native code is only called for functions with at most this many params */
+        static constexpr unsigned MaxNativeArity = 8;
+
+        /** @brief Value of a variable, with the type the semantic analyzer gave it in compiled code */
+        struct Variable
+        {
+            double Value;
+            ast::Type Ty;
+        };
+
+        struct FunctionInfo
+        {
+            const ast::statement::Function *Decl = nullptr;
+            unsigned Calls = 0;
+            unsigned BackEdges = 0;
+            /** @brief Function was handed to the JIT */
+            bool Compiled = false;
+            /** @brief The loaded profile saw it pass the tier threshold, it is compiled on its first call */
+            bool Hot = false;
+            /** @brief JIT compilation failed, keep interpreting */
+            bool Failed = false;
+            /** @brief Also read by the compiled callers which were compiled before it, see `RuntimeLLVM::HostFunction` */
+            void *Native = nullptr;
+        };
+
+        /** @brief Native code running the rest of a loop entered in the interpreter, see `enterCompiledLoop` */
+        struct CompiledLoop
+        {
+            /** @brief `double loop(double *vars)` of `RuntimeLLVM::compileLoop`, `nullptr` if compiling failed */
+            void *Native = nullptr;
+            /** @brief Variables in scope of the loop, in the order of `vars` */
+            std::vector<symbol::Symbol> Variables;
+        };
+
+        RuntimeLLVM &runtime_;
+        const unsigned tierThreshold_;
+        /** @brief Nodes of the running program */
+        const ast::Arena *nodes_;
+        std::unordered_map<symbol::Symbol, FunctionInfo> functions_;
+        std::unordered_map<const ast::statement::For *, CompiledLoop> loops_;
+        std::vector<std::unordered_map<symbol::Symbol, Variable>> scopes_;
+        /** @brief Index of the first scope of the current call frame */
+        size_t frameBase_;
+        FunctionInfo *currentFunction_;
+        double returnValue_;
+
+    protected:
+        using ast::statement::Visitor<Signal>::visit;
+        using ast::expression::Visitor<std::optional<double>>::visit;
+
+        const ast::Arena &nodes() const override { return *nodes_; }
+
+        //> statements
+        Signal visitBlockStmt(const ast::statement::Block &stmt);
+        Signal visitVarDeclStmt(const ast::statement::VarDecl &stmt);
+        Signal visitFunctionStmt(const ast::statement::Function &stmt);
+        Signal visitBinOpDefStmt(const ast::statement::BinOpDef &stmt);
+        Signal visitUnaryOpDefStmt(const ast::statement::UnaryOpDef &stmt);
+        Signal visitExpressionStmt(const ast::statement::Expression &stmt);
+        Signal visitReturnStmt(const ast::statement::Return &stmt);
+        Signal visitIfStmt(const ast::statement::If &stmt);
+        Signal visitForStmt(const ast::statement::For &stmt);
+        /** @brief Run a `parallel for` sequentially, reducing in the same order as the compiled loop */
+        Signal runParallelFor(const ast::statement::For &stmt);
+        //<
+
+        //> expressions
+        std::optional<double> visitNumberExpr(const ast::expression::Number &expr);
+        std::optional<double> visitVariableExpr(const ast::expression::Variable &expr);
+        std::optional<double> visitBinaryExpr(const ast::expression::Binary &expr);
+        std::optional<double> visitUnaryExpr(const ast::expression::Unary &expr);
+        std::optional<double> visitConditionalExpr(const ast::expression::Conditional &expr);
+        std::optional<double> visitCallExpr(const ast::expression::Call &expr);
+        std::optional<double> visitIndexExpr(const ast::expression::Index &expr);
+        std::optional<double> visitLengthExpr(const ast::expression::Length &expr);
+        //<
+
+        std::optional<double> call(FunctionInfo &fn, const std::vector<double> &args);
+        std::optional<double> callByName(symbol::Symbol name, const std::vector<double> &args, int line);
+        /** @brief JIT compile the function, with what its `parallel for` loops may call */
+        bool tierUp(FunctionInfo &fn);
+        /** @brief Compile the functions into one module, mark them compiled and look up their native code */
+        bool compile(const std::vector<FunctionInfo *> &infos, const std::vector<RuntimeLLVM::HostFunction> &hosts);
+        /**
+         * @brief Gather what code calling `callees` needs to be compiled with.
+         * @details The threads of the pool must not enter the interpreter, every function a `parallel for`
+         * may reach (`parallelCallees`) is added to `compile` unless compiled before. Any other callee
+         * not compiled yet gets a host function running it in the interpreter.
+         * @return false if one of the functions to compile failed to compile before.
+         */
+        bool collectDependencies(const std::vector<symbol::Symbol> &callees,
+                                 const std::vector<symbol::Symbol> &parallelCallees,
+                                 std::vector<FunctionInfo *> &compile,
+                                 std::vector<RuntimeLLVM::HostFunction> &hosts);
+        /** @brief Entry of the host functions, runs `function` on `args` for the compiled code */
+        static double callFromNative(void *interpreter, void *function, const double *args);
+        /**
+         * @brief Run the rest of the interpreted loop `stmt`, at its back-edge, as native code.
+         * @return signal of the loop, `std::nullopt` when it could not be compiled and keeps running interpreted.
+         */
+        std::optional<Signal> enterCompiledLoop(const ast::statement::For &stmt);
+        static double callNative(void *fn, const std::vector<double> &args);
+        /** @brief Report array code reached in the interpreter, which does not model arrays */
+        void arraysNeedJIT(int line);
+
+        inline void beginScope();
+        inline void endScope();
+        double *resolveVariable(symbol::Symbol varName);
+    };
+} // namespace hypertk
+
+#endif
@@ -2,12 +2,20 @@
 #define HYPERTK_JIT_HPP
 
 #include "common.hpp"
+#include "error.hpp"
+#include "object_cache.hpp"
+#include "target.hpp"
 
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <string>
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
+#include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
 #include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/EPCIndirectionUtils.h"
 #include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
 #include "llvm/ExecutionEngine/Orc/ExecutorProcessControl.h"
 #include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
@@ -17,27 +25,76 @@
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
 
 namespace hypertk
 {
+    /** @brief Build options of `HyperTkJIT` */
+    struct JITOptions
+    {
+        /**
+         * @brief Compile each function on its first call instead of compiling whole modules up-front.
+         * @details Every function gets an indirect stub that jumps into a lazy call-through
+         * trampoline, the first call compiles the function and rewrites the stub to point at it.
+         */
+        bool Lazy = false;
+        /** @brief Directory of the persistent object cache, no cache when empty */
+        std::string CacheDir;
+        /** @brief Max total size in bytes of the object cache */
+        uint64_t CacheMaxSize = 256ull << 20;
+        /** @brief Optimization level of the machine code generator */
+        llvm::CodeGenOptLevel CodeGenOpt = llvm::CodeGenOptLevel::Default;
+        /** @brief CPU to generate code for, `native` is the host CPU with all of its features */
+        std::string CPU = "native";
+        /** @brief Comma separated CPU features added on top of the CPU's, e.g. `+avx2,-fma` */
+        std::string Features;
+    };
+
     class HyperTkJIT
     {
     private:
         std::unique_ptr<llvm::orc::ExecutionSession> ES;
+        /** @brief Stubs and call-through trampolines, only created in lazy mode */
+        std::unique_ptr<llvm::orc::EPCIndirectionUtils> EPCIU;
+        /** @brief Persistent object cache, only created when a cache directory is given */
+        std::unique_ptr<ObjectCache> Cache;
 
+        /** @brief Target machine matching the JIT's code generator, used by the IR optimizer */
+        std::unique_ptr<llvm::TargetMachine> TM;
         llvm::DataLayout DL;
         llvm::orc::MangleAndInterner Mangle;
 
         llvm::orc::RTDyldObjectLinkingLayer ObjectLayer;
         llvm::orc::IRCompileLayer CompileLayer;
+        /** @brief Per-function compile-on-first-call layer, only created in lazy mode */
+        std::unique_ptr<llvm::orc::CompileOnDemandLayer> CODLayer;
 
         llvm::orc::JITDylib &MainJD;
 
+        /**
+         * @brief Run instead of a lazily compiled function whose body could not be materialized.
+         * @details Reports the error and returns NaN as the result of the call, the caller of the
+         * JIT'd code checks `error::hasError` once it returns.
+         */
+        static double handleLazyCallThroughError()
+        {
+            error::error(0, "Could not find the body of a lazily compiled function.");
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+
     public:
         HyperTkJIT(std::unique_ptr<llvm::orc::ExecutionSession> ES,
+                   std::unique_ptr<llvm::orc::EPCIndirectionUtils> EPCIU,
+                   std::unique_ptr<ObjectCache> Cache,
+                   std::unique_ptr<llvm::TargetMachine> TM,
                    llvm::orc::JITTargetMachineBuilder JTMB,
                    llvm::DataLayout DL)
             : ES(std::move(ES)),
+              EPCIU(std::move(EPCIU)),
+              Cache(std::move(Cache)),
+              TM(std::move(TM)),
               DL(std::move(DL)),
               Mangle(*this->ES, this->DL),
               ObjectLayer(*this->ES,
@@ -47,7 +104,7 @@ namespace hypertk
                           }),
               CompileLayer(*this->ES,
                            ObjectLayer,
-                           std::make_unique<llvm::orc::ConcurrentIRCompiler>(std::move(JTMB))),
+                           std::make_unique<llvm::orc::ConcurrentIRCompiler>(std::move(JTMB), this->Cache.get())),
               MainJD(this->ES->createBareJITDylib("<main>"))
         {
             MainJD.addGenerator(
@@ -59,6 +116,15 @@ namespace hypertk
                 ObjectLayer.setOverrideObjectFlagsWithResponsibilityFlags(true);
                 ObjectLayer.setAutoClaimResponsibilityForObjectSymbols(true);
             }
+            if (this->EPCIU)
+                CODLayer = std::make_unique<llvm::orc::CompileOnDemandLayer>(
+                    *this->ES,
+                    CompileLayer,
+                    this->EPCIU->getLazyCallThroughManager(),
+                    [this]()
+                    {
+                        return this->EPCIU->createIndirectStubsManager();
+                    });
         }
 
         ~HyperTkJIT()
@@ -67,9 +133,12 @@ namespace hypertk
             {
                 ES->reportError(std::move(Err));
             }
+            if (EPCIU)
+                if (auto Err = EPCIU->cleanup())
+                    ES->reportError(std::move(Err));
         }
 
-        static llvm::Expected<std::unique_ptr<HyperTkJIT>> Create()
+        static llvm::Expected<std::unique_ptr<HyperTkJIT>> Create(const JITOptions &opts = {})
         {
             auto EPC = llvm::orc::SelfExecutorProcessControl::Create();
             if (!EPC)
@@ -77,13 +146,51 @@ namespace hypertk
 
             auto ES = std::make_unique<llvm::orc::ExecutionSession>(std::move(*EPC));
 
+            std::unique_ptr<llvm::orc::EPCIndirectionUtils> EPCIU = nullptr;
+            if (opts.Lazy)
+            {
+                auto EPCIU_ = llvm::orc::EPCIndirectionUtils::Create(*ES);
+                if (!EPCIU_)
+                    return EPCIU_.takeError();
+                EPCIU = std::move(*EPCIU_);
+
+                EPCIU->createLazyCallThroughManager(
+                    *ES, llvm::orc::ExecutorAddr::fromPtr(&handleLazyCallThroughError));
+                if (auto Err = llvm::orc::setUpInProcessLCTMReentryViaEPCIU(*EPCIU))
+                    return std::move(Err);
+            }
+
             llvm::orc::JITTargetMachineBuilder JTMB(ES->getExecutorProcessControl().getTargetTriple());
+            JTMB.setCodeGenOptLevel(opts.CodeGenOpt);
+            // Code is generated for the machine it runs on, so default to the host CPU
+            // instead of the baseline ISA of the triple.
+            TargetSpec target = resolveTarget(opts.CPU, opts.Features);
+            JTMB.setCPU(target.CPU);
+            JTMB.addFeatures(target.Features);
 
             auto DL = JTMB.getDefaultDataLayoutForTarget();
             if (!DL)
                 return DL.takeError();
 
-            return std::make_unique<HyperTkJIT>(std::move(ES), std::move(JTMB), std::move(*DL));
+            auto TM = JTMB.createTargetMachine();
+            if (!TM)
+                return TM.takeError();
+
+            std::unique_ptr<ObjectCache> Cache = nullptr;
+            if (!opts.CacheDir.empty())
+                Cache = std::make_unique<ObjectCache>(opts.CacheDir,
+                                                      opts.CacheMaxSize,
+                                                      JTMB.getTargetTriple().str() + "|" +
+                                                          JTMB.getCPU() + "|" +
+                                                          JTMB.getFeatures().getString() + "|O" +
+                                                          std::to_string((int)opts.CodeGenOpt));
+
+            return std::make_unique<HyperTkJIT>(std::move(ES),
+                                                std::move(EPCIU),
+                                                std::move(Cache),
+                                                std::move(*TM),
+                                                std::move(JTMB),
+                                                std::move(*DL));
         }
 
         const llvm::DataLayout &getDataLayout() const
@@ -96,11 +203,24 @@ namespace hypertk
             return MainJD;
         }
 
+        llvm::TargetMachine *getTargetMachine() const
+        {
+            return TM.get();
+        }
+
+        /** @brief Return the object cache, `nullptr` if caching is disabled */
+        const ObjectCache *getObjectCache() const
+        {
+            return Cache.get();
+        }
+
         llvm::Error addModule(llvm::orc::ThreadSafeModule TSM,
                               llvm::orc::ResourceTrackerSP RT = nullptr)
         {
             if (!RT)
                 RT = MainJD.getDefaultResourceTracker();
+            if (CODLayer)
+                return CODLayer->add(RT, std::move(TSM));
             return CompileLayer.add(RT, std::move(TSM));
         }
 
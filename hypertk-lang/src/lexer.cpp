@@ -1,20 +1,172 @@
-#include <string>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string_view>
 
 #include "lexer.hpp"
 #include "token.hpp"
+#include "symbol.hpp"
 
 namespace lexer
 {
-    Lexer::Lexer(const std::string &src)
-        : src_{src}, start_{0}, current_{0}, line_{1} {}
+    //> tables
+    /** @brief Bits of `CharClasses`, what a character can be part of */
+    enum CharClass : uint8_t
+    {
+        DIGIT = 1 << 0,
+        /** @brief Starts an identifier, `[A-Za-z]` */
+        ALPHA = 1 << 1,
+        /** @brief Skipped between tokens, without `\n` which also counts a line */
+        BLANK = 1 << 2,
+    };
+
+    static constexpr std::array<uint8_t, 256> makeCharClasses()
+    {
+        std::array<uint8_t, 256> classes{};
+        for (char c = '0'; c <= '9'; ++c)
+            classes[(unsigned char)c] |= DIGIT;
+        for (char c = 'a'; c <= 'z'; ++c)
+            classes[(unsigned char)c] |= ALPHA;
+        for (char c = 'A'; c <= 'Z'; ++c)
+            classes[(unsigned char)c] |= ALPHA;
+        for (char c : {' ', '\r', '\t'})
+            classes[(unsigned char)c] |= BLANK;
+        return classes;
+    }
+    /** @brief Class bits of every byte, unlike `<cctype>` it ignores the locale and bytes past 127 */
+    static constexpr std::array<uint8_t, 256> CharClasses = makeCharClasses();
+
+    static inline bool is(char c, uint8_t classes) noexcept { return CharClasses[(unsigned char)c] & classes; }
+
+    static constexpr std::array<token::TokenType, 256> makeCharTokens()
+    {
+        using token::TokenType;
+        std::array<TokenType, 256> tokens{};
+        tokens.fill(TokenType::ERROR);
+        tokens['+'] = TokenType::PLUS;
+        tokens['-'] = TokenType::MINUS;
+        tokens['*'] = TokenType::STAR;
+        tokens['/'] = TokenType::SLASH;
+        tokens['='] = TokenType::EQUAL;
+        tokens['<'] = TokenType::LESS;
+        tokens['>'] = TokenType::GREATER;
+        tokens['!'] = TokenType::EXCLAMATION;
+        tokens['('] = TokenType::LEFT_PAREN;
+        tokens[')'] = TokenType::RIGHT_PAREN;
+        tokens['{'] = TokenType::LEFT_BRACE;
+        tokens['}'] = TokenType::RIGHT_BRACE;
+        tokens['['] = TokenType::LEFT_BRACKET;
+        tokens[']'] = TokenType::RIGHT_BRACKET;
+        tokens['?'] = TokenType::QUESTION_MARK;
+        tokens[':'] = TokenType::COLON;
+        tokens[';'] = TokenType::SEMICOLON;
+        tokens[','] = TokenType::COMMA;
+        tokens['|'] = TokenType::VERTICAL_BAR;
+        tokens['&'] = TokenType::AMPERSAND;
+        return tokens;
+    }
+    /** @brief Token of each single character token, `ERROR` for the other bytes */
+    static constexpr std::array<token::TokenType, 256> CharTokens = makeCharTokens();
+
+    struct Keyword
+    {
+        std::string_view Text;
+        token::TokenType Type;
+    };
+
+    static constexpr Keyword Keywords[] = {
+        {"func", token::TokenType::FUNC},
+        {"return", token::TokenType::RETURN},
+        {"if", token::TokenType::IF},
+        {"then", token::TokenType::THEN},
+        {"else", token::TokenType::ELSE},
+        {"for", token::TokenType::FOR},
+        {"in", token::TokenType::IN},
+        {"unary", token::TokenType::UNARY},
+        {"binary", token::TokenType::BINARY},
+        {"var", token::TokenType::VAR},
+        {"len", token::TokenType::LEN},
+        {"parallel", token::TokenType::PARALLEL},
+        {"reduce", token::TokenType::REDUCE},
+    };
+
+    static constexpr size_t KeywordSlots = 32;
+
+    /**
+     * @brief Slot of a word in `KeywordTable`, from its length, first and last character.
+     * @note The constants were searched for so no two keywords share a slot, adding a keyword
+     * may need new ones, the `static_assert` below tells.
+     */
+    static constexpr size_t keywordSlot(std::string_view word)
+    {
+        return (2 * word.size() + (unsigned char)word.front() + 13 * (unsigned char)word.back()) % KeywordSlots;
+    }
+
+    static constexpr std::array<Keyword, KeywordSlots> makeKeywordTable()
+    {
+        std::array<Keyword, KeywordSlots> table{};
+        for (Keyword &slot : table)
+            slot = {"", token::TokenType::IDENTIFIER};
+        for (const Keyword &keyword : Keywords)
+            table[keywordSlot(keyword.Text)] = keyword;
+        return table;
+    }
+    /** @brief Perfect hash table of the keywords, a word is a keyword only if it equals the one in its slot */
+    static constexpr std::array<Keyword, KeywordSlots> KeywordTable = makeKeywordTable();
+
+    static constexpr bool keywordsHaveOwnSlots()
+    {
+        for (const Keyword &keyword : Keywords)
+            if (KeywordTable[keywordSlot(keyword.Text)].Text != keyword.Text)
+                return false;
+        return true;
+    }
+    static_assert(keywordsHaveOwnSlots(), "Two keywords share a slot of the keyword table, change keywordSlot");
+
+    /** @brief Message of the error token of an unexpected character, its `?` is replaced by the character */
+    static constexpr std::string_view UnexpectedCharacter = "Unexpected character '?'.";
+    using UnexpectedCharacterMessage = std::array<char, UnexpectedCharacter.size()>;
+
+    static constexpr std::array<UnexpectedCharacterMessage, 256> makeUnexpectedCharacterMessages()
+    {
+        std::array<UnexpectedCharacterMessage, 256> messages{};
+        for (size_t c = 0; c < messages.size(); ++c)
+        {
+            std::copy(UnexpectedCharacter.begin(), UnexpectedCharacter.end(), messages[c].begin());
+            messages[c][UnexpectedCharacter.find('?')] = (char)c;
+        }
+        return messages;
+    }
+    /** @brief Message of every byte, error tokens view into it so lexing bad input allocates nothing */
+    static constexpr std::array<UnexpectedCharacterMessage, 256> UnexpectedCharacterMessages = makeUnexpectedCharacterMessages();
+    //<
+
+    Lexer::Lexer(std::string_view src)
+        : Lexer{llvm::MemoryBuffer::getMemBufferCopy(llvm::StringRef(src.data(), src.size()), "<input>")} {}
+
+    Lexer::Lexer(std::unique_ptr<llvm::MemoryBuffer> src)
+        : Lexer{src->getMemBufferRef()}
+    {
+        owned_ = std::move(src);
+    }
+
+    Lexer::Lexer(llvm::MemoryBufferRef src)
+        : buf_{src.getBufferStart()}, size_{(int)src.getBufferSize()}, start_{0}, current_{0}, line_{1} {}
+
+    Lexer::Lexer(const char *buf, int size, int current, int line)
+        : buf_{buf}, size_{size}, start_{current}, current_{current}, line_{line} {}
 
     Lexer::Lexer(Lexer &&other)
-        : src_{std::move(other.src_)}, start_{other.start_}, current_{other.current_}, line_{other.line_} {}
+        : owned_{std::move(other.owned_)}, buf_{other.buf_}, size_{other.size_},
+          start_{other.start_}, current_{other.current_}, line_{other.line_} {}
     Lexer &Lexer::operator=(Lexer &&other)
     {
         if (this != &other)
         {
-            src_ = std::move(other.src_);
+            owned_ = std::move(other.owned_);
+            buf_ = other.buf_;
+            size_ = other.size_;
             start_ = other.start_;
             current_ = other.current_;
             line_ = other.line_;
@@ -34,61 +186,141 @@ namespace lexer
 
         char c = advance();
 
-        if (isalpha(c))
+        if (is(c, ALPHA))
             return identifier();
-        if (isdigit(c))
+        if (is(c, DIGIT))
             return number();
 
-        if (c == '+')
-            return makeToken(token::TokenType::PLUS);
-        if (c == '-')
-            return makeToken(token::TokenType::MINUS);
-        if (c == '*')
-            return makeToken(token::TokenType::STAR);
-        if (c == '/')
-            return makeToken(token::TokenType::SLASH);
-        if (c == '=')
-            return makeToken(token::TokenType::EQUAL);
-        if (c == '<')
-            return makeToken(token::TokenType::LESS);
-        if (c == '>')
-            return makeToken(token::TokenType::GREATER);
-        if (c == '!')
-            return makeToken(token::TokenType::EXCLAMATION);
-        if (c == '(')
-            return makeToken(token::TokenType::LEFT_PAREN);
-        if (c == ')')
-            return makeToken(token::TokenType::RIGHT_PAREN);
-        if (c == '{')
-            return makeToken(token::TokenType::LEFT_BRACE);
-        if (c == '}')
-            return makeToken(token::TokenType::RIGHT_BRACE);
-        if (c == '?')
-            return makeToken(token::TokenType::QUESTION_MARK);
-        if (c == ':')
-            return makeToken(token::TokenType::COLON);
-        if (c == ';')
-            return makeToken(token::TokenType::SEMICOLON);
-        if (c == ',')
-            return makeToken(token::TokenType::COMMA);
-        if (c == '|')
-            return makeToken(token::TokenType::VERTICAL_BAR);
-        if (c == '&')
-            return makeToken(token::TokenType::AMPERSAND);
-
-        return errorToken(std::string("Unexpected character '") + c + "'.");
+        token::TokenType type = CharTokens[(unsigned char)c];
+        if (type == token::TokenType::VERTICAL_BAR && match('|'))
+            type = token::TokenType::VERTICAL_BAR_VERTICAL_BAR;
+        else if (type == token::TokenType::AMPERSAND && match('&'))
+            type = token::TokenType::AMPERSAND_AMPERSAND;
+        if (type != token::TokenType::ERROR)
+            return makeToken(type);
+
+        const UnexpectedCharacterMessage &message = UnexpectedCharacterMessages[(unsigned char)c];
+        return errorToken(std::string_view(message.data(), message.size()));
+    }
+
+    /// @details The scan copies the lexer, so the tables and `skipWhitespaceAndComment` see the
+    /// source exactly as `nextToken` does.
+    std::optional<std::vector<FunctionStart>> Lexer::scanFunctions() const
+    {
+        Lexer scan{buf_, size_, current_, line_};
+        auto word = [&scan]
+        {
+            scan.start_ = scan.current_;
+            while (is(scan.peek(), ALPHA | DIGIT))
+                scan.advance();
+            return scan.makeLexeme();
+        };
+        // Operator token after `binary` or `unary`, `ERROR` if there is none
+        auto scanOperator = [&scan]
+        {
+            scan.skipWhitespaceAndComment();
+            if (scan.isAtEnd())
+                return token::TokenType::ERROR;
+            token::TokenType op = CharTokens[(unsigned char)scan.advance()];
+            if (op == token::TokenType::VERTICAL_BAR && scan.match('|'))
+                op = token::TokenType::VERTICAL_BAR_VERTICAL_BAR;
+            else if (op == token::TokenType::AMPERSAND && scan.match('&'))
+                op = token::TokenType::AMPERSAND_AMPERSAND;
+            if (op == token::TokenType::LEFT_BRACE || op == token::TokenType::RIGHT_BRACE)
+                return token::TokenType::ERROR;
+            return op;
+        };
+
+        std::vector<FunctionStart> starts;
+        while (true)
+        {
+            scan.skipWhitespaceAndComment();
+            if (scan.isAtEnd())
+                return starts;
+
+            FunctionStart &fn = starts.emplace_back(FunctionStart{scan.current_, scan.line_});
+            if (word() != "func")
+                return std::nullopt;
+
+            //> Operator and precedence of `func binary| 5 (a, b)`, operator of `func unary- (v)`
+            scan.skipWhitespaceAndComment();
+            std::string_view kind = word();
+            if (kind == "unary")
+            {
+                fn.UnaryOp = scanOperator();
+                if (fn.UnaryOp == token::TokenType::ERROR)
+                    return std::nullopt;
+            }
+            else if (kind == "binary")
+            {
+                token::TokenType binaryOp = scanOperator();
+                if (binaryOp == token::TokenType::ERROR)
+                    return std::nullopt;
+
+                // Leading digits, as the parser reads them. Past 100 the parser reports an error anyway.
+                unsigned prec = 30;
+                scan.skipWhitespaceAndComment();
+                if (is(scan.peek(), DIGIT))
+                    for (prec = 0; is(scan.peek(), DIGIT);)
+                        prec = std::min(prec * 10 + (scan.advance() - '0'), 1000u);
+                fn.BinaryOp = binaryOp;
+                fn.Precedence = prec;
+            }
+            //<
+
+            // Name and parameters
+            while (true)
+            {
+                scan.skipWhitespaceAndComment();
+                if (scan.isAtEnd() || scan.peek() == '}')
+                    return std::nullopt;
+                if (scan.advance() == '{')
+                    break;
+            }
+
+            // Body, a `//` is a comment wherever it is outside of one.
+            for (int depth = 1; depth > 0;)
+            {
+                switch (scan.advance())
+                {
+                case '{':
+                    ++depth;
+                    break;
+                case '}':
+                    --depth;
+                    break;
+                case '\n':
+                    ++scan.line_;
+                    break;
+                case '/':
+                    if (scan.peek() == '/')
+                        while (scan.peek() != '\n' && !scan.isAtEnd())
+                            scan.advance();
+                    break;
+                case '\0':
+                    if (scan.current_ > scan.size_)
+                        return std::nullopt;
+                    break;
+                }
+            }
+        }
+    }
+
+    Lexer Lexer::at(const FunctionStart &start) const
+    {
+        return Lexer{buf_, size_, start.Offset, start.Line};
     }
 
     token::Token Lexer::number()
     {
-        while (isdigit(peek()))
+        while (is(peek(), DIGIT))
             advance();
 
-        if (peek() == '.' && isdigit(peekNext()))
+        if (peek() == '.' && is(peekNext(), DIGIT))
         {
             advance(); // consume `.`
 
-            while (isdigit(peek()))
+            while (is(peek(), DIGIT))
                 advance();
         }
 
@@ -96,35 +328,17 @@ namespace lexer
     }
     token::Token Lexer::identifier()
     {
-        while (isalnum(peek()))
+        while (is(peek(), ALPHA | DIGIT))
             advance();
 
         const auto lexeme = makeLexeme();
-        token::TokenType type;
-        if (lexeme == "func")
-            type = token::TokenType::FUNC;
-        else if (lexeme == "return")
-            type = token::TokenType::RETURN;
-        else if (lexeme == "if")
-            type = token::TokenType::IF;
-        else if (lexeme == "then")
-            type = token::TokenType::THEN;
-        else if (lexeme == "else")
-            type = token::TokenType::ELSE;
-        else if (lexeme == "for")
-            type = token::TokenType::FOR;
-        else if (lexeme == "in")
-            type = token::TokenType::IN;
-        else if (lexeme == "unary")
-            type = token::TokenType::UNARY;
-        else if (lexeme == "binary")
-            type = token::TokenType::BINARY;
-        else if (lexeme == "var")
-            type = token::TokenType::VAR;
-        else
-            type = token::TokenType::IDENTIFIER;
-
-        return makeToken(type, lexeme);
+        const Keyword &keyword = KeywordTable[keywordSlot(lexeme)];
+        if (keyword.Text == lexeme)
+            return token::Token(keyword.Type, lexeme, line_);
+
+        // Interned once here, from now on the name is only compared as its symbol.
+        symbol::Symbol sym = symbol::intern(lexeme);
+        return token::Token(token::TokenType::IDENTIFIER, symbol::name(sym), line_, sym);
     }
 
     void Lexer::skipWhitespaceAndComment() noexcept
@@ -132,61 +346,41 @@ namespace lexer
         while (true)
         {
             char c = peek();
-            switch (c)
-            {
-            case ' ':
-            case '\r':
-            case '\t':
-            {
+            if (is(c, BLANK))
                 advance();
-                break;
-            }
-            case '\n':
+            else if (c == '\n')
             {
                 line_++;
                 advance();
-                break;
             }
-            case '/':
+            else if (c == '/' && peekNext() == '/')
             {
-                if (peekNext() == '/')
-                {
-                    while (peek() != '\n' && !isAtEnd())
-                    {
-                        advance();
-                    }
-                }
-                else
-                {
-                    return;
-                }
-                break;
+                while (peek() != '\n' && !isAtEnd())
+                    advance();
             }
-            default:
+            else
                 return;
-            }
         }
     }
 
     inline token::Token Lexer::makeToken(token::TokenType type) { return token::Token(type, makeLexeme(), line_); }
-    inline token::Token Lexer::makeToken(token::TokenType type, const std::string &lexeme) { return token::Token(type, lexeme, line_); }
-    inline std::string Lexer::makeLexeme() { return src_.substr(start_, current_ - start_); }
-    inline token::Token Lexer::errorToken(const std::string &msg) { return makeToken(token::TokenType::ERROR, msg); }
+    inline std::string_view Lexer::makeLexeme() { return std::string_view(buf_ + start_, current_ - start_); }
+    /// @details The messages are static, interning them would grow the symbol table with every error.
+    inline token::Token Lexer::errorToken(std::string_view msg) { return token::Token(token::TokenType::ERROR, msg, line_); }
 
     bool Lexer::match(char expected) noexcept
     {
-        if (isAtEnd())
-            return false;
-
         if (peek() != expected)
             return false;
 
         current_++;
         return true;
     }
-    inline char Lexer::advance() noexcept { return isAtEnd() ? '\0' : src_.at(current_++); }
-    inline char Lexer::peek() const noexcept { return isAtEnd() ? '\0' : src_.at(current_); }
-    inline char Lexer::peekNext() const noexcept { return nextIsEnd() ? '\0' : src_.at(current_ + 1); }
-    inline bool Lexer::isAtEnd() const noexcept { return current_ >= src_.length(); }
-    inline bool Lexer::nextIsEnd() const noexcept { return current_ + 1 >= src_.length(); }
-}
+    /// @details Past the last character `peek` reads the terminating `\0` of the source, which
+    /// no scanning loop accepts, so they stop at the end without a bounds check. `peekNext` is
+    /// only called after `peek` returned a character, so it reads at most the terminator.
+    inline char Lexer::advance() noexcept { return buf_[current_++]; }
+    inline char Lexer::peek() const noexcept { return buf_[current_]; }
+    inline char Lexer::peekNext() const noexcept { return buf_[current_ + 1]; }
+    inline bool Lexer::isAtEnd() const noexcept { return current_ >= size_; }
+}
\ No newline at end of file
@@ -1,16 +1,52 @@
 #ifndef HYPERTK_LEXER_HPP
 #define HYPERTK_LEXER_HPP
 
-#include <string>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "llvm/Support/MemoryBuffer.h"
 
 #include "token.hpp"
 
 namespace lexer
 {
+    /** @brief Where a top level function definition starts, found by `Lexer::scanFunctions` */
+    struct FunctionStart
+    {
+        /** @brief Offset of its `func` keyword in the source */
+        int Offset;
+        int Line;
+        /** @brief Operator a `binary` definition defines, `ERROR` for any other function */
+        token::TokenType BinaryOp = token::TokenType::ERROR;
+        /** @brief Precedence a `binary` definition gives its operator */
+        unsigned Precedence = 0;
+        /** @brief Operator a `unary` definition defines, `ERROR` for any other function */
+        token::TokenType UnaryOp = token::TokenType::ERROR;
+    };
+
+    /**
+     * @brief Splits the source into tokens without copying their text.
+     * @details Tokens other than identifiers view into the source, which must outlive them.
+     * The lexer scans a buffer in place, a file read or mapped by `llvm::MemoryBuffer` is not
+     * copied again. Moving the lexer keeps the source where it is, so views taken before the
+     * move stay valid. Scanning is driven by tables built at compile time: a class per byte, the token of each
+     * single character token and a perfect hash table of the keywords.
+     */
     class Lexer : private Uncopyable
     {
     public:
-        explicit Lexer(const std::string &src);
+        /** @brief Lex a copy of `src`, owned by the lexer */
+        explicit Lexer(std::string_view src);
+        /** @brief Lex `src` in place, the lexer owns it from now on */
+        explicit Lexer(std::unique_ptr<llvm::MemoryBuffer> src);
+        /**
+         * @brief Lex `src` in place, the caller keeps it alive as long as its tokens are used.
+         * @note `src` must be followed by a `\0`, as any `llvm::MemoryBuffer` not created
+         * without `RequiresNullTerminator` is.
+         */
+        explicit Lexer(llvm::MemoryBufferRef src);
 
         Lexer(Lexer &&other);
         Lexer &operator=(Lexer &&other);
@@ -20,29 +56,46 @@ namespace lexer
          */
         token::Token nextToken();
 
+        /** @brief Bytes of the source not lexed yet */
+        int remaining() const { return size_ - current_; }
+
+        /**
+         * @brief Find where the top level function definitions in the rest of the source start, without making tokens.
+         * @details Inside a body only braces are tracked, and nothing is interned. The lexer stays where it is.
+         * @return `std::nullopt` if the top level holds anything but function definitions or the braces do
+         * not pair up, parsing the source in order then reports the error.
+         */
+        std::optional<std::vector<FunctionStart>> scanFunctions() const;
+        /** @brief Lexer of the same source from a definition `scanFunctions` found, the caller keeps the source alive */
+        Lexer at(const FunctionStart &start) const;
+
     private:
-        /** @brief Text source code */
-        std::string src_;
+        /** @brief Source the lexer owns, `nullptr` when the caller does */
+        std::unique_ptr<llvm::MemoryBuffer> owned_;
+        /** @brief Characters of the source, terminated by a `\0` sentinel */
+        const char *buf_;
+        int size_;
         int start_;
         int current_;
         int line_;
 
+        Lexer(const char *buf, int size, int current, int line);
+
         token::Token identifier();
         token::Token number();
 
         void skipWhitespaceAndComment() noexcept;
 
         inline token::Token makeToken(token::TokenType type);
-        inline token::Token makeToken(token::TokenType type, const std::string &lexeme);
-        inline std::string makeLexeme();
-        inline token::Token errorToken(const std::string &msg);
+        inline std::string_view makeLexeme();
+        /** @brief Error token whose lexeme is `msg`, which must outlive the token */
+        inline token::Token errorToken(std::string_view msg);
 
         bool match(char expected) noexcept;
         inline char advance() noexcept;
         inline char peek() const noexcept;
         inline char peekNext() const noexcept;
         inline bool isAtEnd() const noexcept;
-        inline bool nextIsEnd() const noexcept;
     };
 }
 
@@ -1,7 +1,11 @@
 #include <cstdlib>
 #include <iostream>
+#include <fstream>
 #include <string>
 #include <memory>
+#include <optional>
+#include <vector>
+#include <unistd.h>
 
 #include "common.hpp"
 #include "lexer.hpp"
@@ -18,18 +22,23 @@
 #include "semantic_analyzer.hpp"
 #endif
 #include "runtime_llvm.hpp"
+#ifdef ENABLE_TIERED_EXECUTION
+#include "interpreter.hpp"
+#endif
+#ifdef ENABLE_BASIC_JIT_COMPILER
+#include "repl.hpp"
+#endif
+#include "options.hpp"
 #include "error.hpp"
+#include "timing.hpp"
+#include "output.hpp"
+#include "parallel.hpp"
+#include "profile.hpp"
 
-int main()
-{
-    std::string src = R"(
-        // Logical unary not. 
-        func unary!(v) {
-            // return v ? 0 : 1; // There are some issue with parsing `?:`
-            if (v) return 0;
-            else return 1;
-        }
+#include "llvm/Support/MemoryBuffer.h"
 
+/** @brief Built-in demo program, run when no source file is given */
+static const char *DemoProgram = R"(
         // Unary negate.
         func unary-(v) {
             return 0-v;
@@ -81,7 +90,8 @@ int main()
         // Determine whether the specific location diverges.
         // Solve for z = z^2 + c in the complex plane.
         func mandelconverger(real, imag, iters, creal, cimag) {
-            if (iters > 255 | (real*real + imag*imag > 4))
+            // `||` is builtin: a branch instead of a call, and the magnitude is not tested once `iters` ran out.
+            if (iters > 255 || real*real + imag*imag > 4)
                 return iters;
             else
                return mandelconverger(real*real - imag*imag + creal,
@@ -122,23 +132,184 @@ int main()
             return 0;
         }
     )";
-    parser::Parser parser_{lexer::Lexer{src}};
 
-    auto ast_ = parser_.parse();
+/**
+ * @brief Open a source file, `-` for stdin, print an error and return `nullptr` if it can't be read.
+ * @details `llvm::MemoryBuffer` maps a regular file read-only unless it is small, and reads pipes
+ * and other streams. Either way the buffer ends with the `\0` the lexer stops at.
+ */
+static std::unique_ptr<llvm::MemoryBuffer> openSource(const std::string &path)
+{
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer = llvm::MemoryBuffer::getFileOrSTDIN(path);
+    if (!buffer)
+    {
+        std::cerr << "Could not open file '" << path << "': " << buffer.getError().message() << "\n";
+        return nullptr;
+    }
+    return std::move(buffer.get());
+}
+
+#ifdef ENABLE_BASIC_JIT_COMPILER
+/** @brief Print object cache counters if asked for */
+static void reportCacheStats(const options::Options &opts, const hypertk::RuntimeLLVM &runtime)
+{
+    if (!opts.CacheStats)
+        return;
+
+    if (const auto *cache = runtime.getObjectCache())
+        cache->printStats(llvm::errs());
+    else
+        llvm::errs() << "object cache is disabled, use --cache-dir=<dir>\n";
+}
+#endif
+
+/** @brief Print timing if asked for */
+static void reportTiming(const options::Options &opts)
+{
+    if (opts.Timing.has_value())
+        timing::report(llvm::errs(), opts.Timing.value());
+}
+
+#ifdef ENABLE_BASIC_JIT_COMPILER
+/** @brief Write the profile if asked for, return `false` if it can't be written */
+static bool writeProfile(const options::Options &opts)
+{
+    if (opts.ProfileGenerate.empty() || profile::write(opts.ProfileGenerate))
+        return true;
+
+    std::cerr << "Could not write profile '" << opts.ProfileGenerate << "'\n";
+    return false;
+}
+
+static hypertk::JITOptions makeJITOptions(const options::Options &opts)
+{
+    hypertk::JITOptions jitOpts;
+    jitOpts.Lazy = opts.LazyJIT;
+    jitOpts.CacheDir = opts.CacheDir;
+    jitOpts.CacheMaxSize = (uint64_t)opts.CacheSizeMB << 20;
+    if (!opts.CPU.empty())
+        jitOpts.CPU = opts.CPU;
+    jitOpts.Features = opts.Features;
+    return jitOpts;
+}
+
+/** @brief Evaluate the input file, or stdin, entry by entry */
+static int runRepl(const options::Options &opts)
+{
+    hypertk::RuntimeLLVM runtime(opts.OptLevel);
+    runtime.initializeJIT(makeJITOptions(opts));
+    runtime.initializeModuleAndManagers();
+#ifdef ENABLE_BUILTIN_FUNCTIONS
+    runtime.declareBuiltInFunctions();
+#endif
+
+    hypertk::Repl repl(runtime);
+    bool ok = true;
+    if (opts.InputFiles.empty())
+        ok = repl.run(std::cin, isatty(STDIN_FILENO));
+    for (const std::string &path : opts.InputFiles)
+    {
+        if (!ok)
+            break;
+        if (path == "-")
+        {
+            ok = repl.run(std::cin, false);
+            continue;
+        }
+
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cerr << "Could not open file '" << path << "'\n";
+            return EXIT_FAILURE;
+        }
+        ok = repl.run(file, false);
+    }
+
+    reportCacheStats(opts, runtime);
+    reportTiming(opts);
+    return ok && writeProfile(opts) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    options::Options opts;
+    if (!options::parse(argc, argv, opts))
+    {
+        options::printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (opts.Timing.has_value())
+        timing::enable();
+    output::configure(opts.Output, opts.OutputBufferSize);
+    parallel::setThreadCount(opts.Threads);
+    if (!opts.ProfileUse.empty() && !profile::load(opts.ProfileUse))
+    {
+        std::cerr << "Could not read profile '" << opts.ProfileUse << "'\n";
+        return EXIT_FAILURE;
+    }
+#ifdef ENABLE_BASIC_JIT_COMPILER
+    if (!opts.ProfileGenerate.empty())
+    {
+        // The counters are referenced by address, instrumented objects are no use to a later run.
+        opts.CacheDir.clear();
+#ifdef ENABLE_TIERED_EXECUTION
+        // Code the interpreter runs would not be counted.
+        opts.Tiered = false;
+#endif
+        profile::startGenerating();
+    }
+#endif
+
+#ifdef ENABLE_BASIC_JIT_COMPILER
+    if (opts.Repl)
+        return runRepl(opts);
+#endif
+
+    // Tokens view into the sources, they live as long as the program.
+    std::vector<std::unique_ptr<llvm::MemoryBuffer>> sources;
+    if (opts.InputFiles.empty())
+        sources.push_back(llvm::MemoryBuffer::getMemBuffer(DemoProgram, "demo"));
+    for (const std::string &path : opts.InputFiles)
+    {
+        sources.push_back(openSource(path));
+        if (!sources.back())
+            return EXIT_FAILURE;
+    }
+
+    // The files are parsed in order into one program, an operator defined in one file can be
+    // used in the next.
+    parser::Parser parser_{lexer::Lexer{sources.front()->getMemBufferRef()}};
+
+    std::optional<ast::Program> ast_{std::in_place};
+    for (size_t i = 0; i < sources.size(); ++i)
+    {
+        if (i > 0)
+            parser_.reset(lexer::Lexer{sources[i]->getMemBufferRef()});
+
+        timing::ScopedPhase phase(timing::Phase::PARSE);
+        parser_.parse(ast_.value());
+    }
     if (error::hasError())
         return EXIT_FAILURE;
     if (ast_.has_value())
     {
 #ifdef ENABLE_PRINTING_AST
-        ast::SimplePrinter printer;
-        printer.print(ast_.value());
+        if (opts.PrintAST)
+        {
+            ast::SimplePrinter printer;
+            printer.print(ast_.value());
+        }
 #endif
 
-        hypertk::RuntimeLLVM runtime;
+        hypertk::RuntimeLLVM runtime(opts.OptLevel);
+        if (opts.WholeProgram)
+            runtime.setWholeProgram(opts.Exports);
 #ifdef ENABLE_BASIC_JIT_COMPILER
-        runtime.initializeJIT();
+        runtime.initializeJIT(makeJITOptions(opts));
 #else
-        if (!runtime.initializeAOT())
+        if (!runtime.initializeAOT(opts.CPU.empty() ? "generic" : opts.CPU, opts.Features))
             return EXIT_FAILURE;
 #endif
 
@@ -149,24 +320,56 @@ int main()
 #endif
 
 #ifndef DISABLE_SEMATIC_ANALYZING
-        semantic_analysis::BasicSemanticAnalyzer analyzer(ast_.value());
-        if (!analyzer.analyze())
-            return EXIT_FAILURE;
+        {
+            // Also infers the types code generation uses, it must run before anything is compiled.
+            timing::ScopedPhase phase(timing::Phase::ANALYZE);
+            semantic_analysis::BasicSemanticAnalyzer analyzer(ast_.value());
+            if (!analyzer.analyze())
+                return EXIT_FAILURE;
+        }
+#endif
+
+#ifdef ENABLE_TIERED_EXECUTION
+        // The interpreter hands functions to the JIT a few at a time, whole-program mode needs them all at once.
+        if (opts.Tiered && !opts.WholeProgram)
+        {
+            // Start running right away, hot functions are handed to the JIT on the way.
+            hypertk::Interpreter interpreter(runtime, opts.TierThreshold);
+            std::optional<double> result;
+            {
+                timing::ScopedPhase phase(timing::Phase::EXECUTE);
+                result = interpreter.run(ast_.value());
+                output::flush();
+            }
+            if (!result.has_value())
+                return EXIT_FAILURE;
+
+            std::cout << "Eval " << result.value() << "\n";
+            reportCacheStats(opts, runtime);
+            reportTiming(opts);
+            return EXIT_SUCCESS;
+        }
 #endif
 
         runtime.genIR(ast_.value());
         if (error::hasError())
             return EXIT_FAILURE;
 #ifdef ENABLE_PRINTING_LLVM_IR
-        runtime.printIR();
+        if (opts.PrintIR)
+            runtime.printIR();
 #endif
 
 #ifdef ENABLE_BASIC_JIT_COMPILER
-        runtime.eval();
+        if (!runtime.eval())
+            return EXIT_FAILURE;
+        reportCacheStats(opts, runtime);
+        if (!writeProfile(opts))
+            return EXIT_FAILURE;
 #else
         if (!runtime.compileToObjectFile("output.o"))
             return EXIT_FAILURE;
 #endif
+        reportTiming(opts);
     }
 
     return EXIT_SUCCESS;
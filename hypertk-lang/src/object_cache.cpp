@@ -0,0 +1,155 @@
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "object_cache.hpp"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_sha1_ostream.h"
+
+namespace hypertk
+{
+    ObjectCache::ObjectCache(std::string dir, uint64_t maxSize, std::string targetId)
+        : dir_{std::move(dir)}, maxSize_{maxSize}, targetId_{std::move(targetId)}
+    {
+        if (auto ec = llvm::sys::fs::create_directories(dir_))
+            llvm::errs() << "Could not create cache directory '" << dir_ << "': " << ec.message() << "\n";
+    }
+
+    void ObjectCache::notifyObjectCompiled(const llvm::Module *M, llvm::MemoryBufferRef Obj)
+    {
+        std::string key;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = pending_.find(M);
+            if (it == pending_.end())
+                return;
+            key = std::move(it->second);
+            pending_.erase(it);
+        }
+
+        // Write to a temporary file then rename it, a concurrent reader never sees a partial object.
+        int fd;
+        llvm::SmallString<128> tmpPath;
+        if (llvm::sys::fs::createUniqueFile(dir_ + "/tmp-%%%%%%%%.o", fd, tmpPath))
+            return;
+        {
+            llvm::raw_fd_ostream os(fd, /* shouldClose */ true);
+            os << Obj.getBuffer();
+        }
+        if (llvm::sys::fs::rename(tmpPath, objectPath(key)))
+        {
+            llvm::sys::fs::remove(tmpPath);
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.Stores++;
+        prune();
+    }
+
+    std::unique_ptr<llvm::MemoryBuffer> ObjectCache::getObject(const llvm::Module *M)
+    {
+        const std::string key = computeKey(M);
+        const std::string path = objectPath(key);
+
+        auto buffer = llvm::MemoryBuffer::getFile(path, /* IsText */ false, /* RequiresNullTerminator */ false);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!buffer)
+        {
+            stats_.Misses++;
+            pending_[M] = key;
+            return nullptr;
+        }
+
+        // Touch the object so it counts as recently used.
+        int fd;
+        if (!llvm::sys::fs::openFileForReadWrite(path, fd, llvm::sys::fs::CD_OpenExisting, llvm::sys::fs::OF_None))
+        {
+            llvm::sys::fs::setLastAccessAndModificationTime(fd, std::chrono::system_clock::now());
+            llvm::sys::Process::SafelyCloseFileDescriptor(fd);
+        }
+
+        stats_.Hits++;
+        return std::move(*buffer);
+    }
+
+    ObjectCache::Stats ObjectCache::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    void ObjectCache::printStats(llvm::raw_ostream &os) const
+    {
+        const Stats stats = getStats();
+        os << "object cache [ " << dir_ << " ]  hits: " << stats.Hits
+           << "  misses: " << stats.Misses
+           << "  stores: " << stats.Stores
+           << "  evictions: " << stats.Evictions << "\n";
+    }
+
+    std::string ObjectCache::computeKey(const llvm::Module *M) const
+    {
+        llvm::raw_sha1_ostream hash;
+        M->print(hash, nullptr);
+        hash << '\0' << targetId_;
+        return llvm::toHex(hash.sha1(), /* LowerCase */ true);
+    }
+
+    std::string ObjectCache::objectPath(const std::string &key) const
+    {
+        return dir_ + "/" + key + ".o";
+    }
+
+    void ObjectCache::prune()
+    {
+        struct Entry
+        {
+            std::string Path;
+            uint64_t Size;
+            llvm::sys::TimePoint<> LastUsed;
+        };
+
+        std::vector<Entry> entries;
+        uint64_t totalSize = 0;
+
+        std::error_code ec;
+        for (llvm::sys::fs::directory_iterator it(dir_, ec), end; it != end && !ec; it.increment(ec))
+        {
+            if (llvm::sys::path::extension(it->path()) != ".o" ||
+                llvm::sys::path::filename(it->path()).starts_with("tmp-"))
+                continue;
+
+            auto status = it->status();
+            if (!status)
+                continue;
+
+            entries.push_back({it->path(), status->getSize(), status->getLastModificationTime()});
+            totalSize += status->getSize();
+        }
+
+        if (totalSize <= maxSize_)
+            return;
+
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry &a, const Entry &b)
+                  { return a.LastUsed < b.LastUsed; });
+
+        for (const auto &entry : entries)
+        {
+            if (totalSize <= maxSize_)
+                break;
+            if (llvm::sys::fs::remove(entry.Path))
+                continue;
+
+            totalSize -= entry.Size;
+            stats_.Evictions++;
+        }
+    }
+} // namespace hypertk
@@ -0,0 +1,68 @@
+#ifndef HYPERTK_OBJECT_CACHE_HPP
+#define HYPERTK_OBJECT_CACHE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "common.hpp"
+
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace hypertk
+{
+    /**
+     * @brief Persistent cache of JIT compiled objects.
+     * @details Objects are stored as `<key>.o` in the cache directory, the key is a SHA1 of the
+     * optimized module IR together with the target triple, CPU and CPU features, so a change in
+     * any of them misses the cache. When the directory grows past its size limit the least
+     * recently used objects are evicted.
+     */
+    class ObjectCache : public llvm::ObjectCache, private Uncopyable
+    {
+    public:
+        struct Stats
+        {
+            uint64_t Hits = 0;
+            uint64_t Misses = 0;
+            uint64_t Stores = 0;
+            uint64_t Evictions = 0;
+        };
+
+        /**
+         * @param dir cache directory, created if missing.
+         * @param maxSize max total size in bytes of cached objects.
+         * @param targetId target triple, CPU and CPU features the objects are compiled for.
+         */
+        ObjectCache(std::string dir, uint64_t maxSize, std::string targetId);
+
+        /** @brief Called by the compiler with the compiled object of a module */
+        void notifyObjectCompiled(const llvm::Module *M, llvm::MemoryBufferRef Obj) override;
+        /** @brief Called by the compiler before compiling a module, return cached object if any */
+        std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *M) override;
+
+        Stats getStats() const;
+        void printStats(llvm::raw_ostream &os) const;
+
+    private:
+        const std::string dir_;
+        const uint64_t maxSize_;
+        const std::string targetId_;
+        mutable std::mutex mutex_;
+        Stats stats_;
+        /** @brief Keys of modules which missed the cache and are being compiled */
+        std::unordered_map<const llvm::Module *, std::string> pending_;
+
+        std::string computeKey(const llvm::Module *M) const;
+        std::string objectPath(const std::string &key) const;
+        /** @brief Evict least recently used objects until the cache fits in `maxSize_` */
+        void prune();
+    };
+} // namespace hypertk
+
+#endif
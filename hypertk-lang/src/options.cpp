@@ -0,0 +1,235 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "options.hpp"
+
+namespace options
+{
+    /** @brief If `arg` is `--name=value`, store `value` and return `true` */
+    static bool matchValue(const std::string &arg, const std::string &name, std::string &value)
+    {
+        const std::string prefix = name + "=";
+        if (arg.compare(0, prefix.size(), prefix) != 0)
+            return false;
+
+        value = arg.substr(prefix.size());
+        return true;
+    }
+
+    static bool parseUnsigned(const std::string &arg, const std::string &value, unsigned &out)
+    {
+        char *end = nullptr;
+        unsigned long v = std::strtoul(value.c_str(), &end, 10);
+        if (value.empty() || *end != '\0')
+        {
+            std::cerr << "Invalid value for '" << arg << "'\n";
+            return false;
+        }
+
+        out = (unsigned)v;
+        return true;
+    }
+
+    /** @brief Split `a,b,c`, skipping empty names */
+    static std::vector<std::string> splitList(const std::string &value)
+    {
+        std::vector<std::string> names;
+        size_t start = 0;
+        while (start <= value.size())
+        {
+            size_t end = value.find(',', start);
+            if (end == std::string::npos)
+                end = value.size();
+            if (end > start)
+                names.push_back(value.substr(start, end - start));
+            start = end + 1;
+        }
+        return names;
+    }
+
+    bool parse(int argc, char **argv, Options &opts)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            std::string value;
+
+            if (arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '3')
+            {
+                opts.OptLevel = arg[2] - '0';
+                continue;
+            }
+
+#ifdef ENABLE_PRINTING_AST
+            if (arg == "--print-ast")
+            {
+                opts.PrintAST = true;
+                continue;
+            }
+#endif
+#ifdef ENABLE_PRINTING_LLVM_IR
+            if (arg == "--print-ir")
+            {
+                opts.PrintIR = true;
+                continue;
+            }
+#endif
+            if (matchValue(arg, "--mcpu", opts.CPU))
+                continue;
+            if (matchValue(arg, "--mattr", opts.Features))
+                continue;
+            if (arg == "--whole-program")
+            {
+                opts.WholeProgram = true;
+                continue;
+            }
+            if (matchValue(arg, "--export", value))
+            {
+                for (auto &name : splitList(value))
+                    opts.Exports.push_back(std::move(name));
+                continue;
+            }
+            if (arg == "--timing")
+            {
+                opts.Timing = timing::Format::TEXT;
+                continue;
+            }
+            if (matchValue(arg, "--timing", value))
+            {
+                if (value == "text")
+                    opts.Timing = timing::Format::TEXT;
+                else if (value == "json")
+                    opts.Timing = timing::Format::JSON;
+                else
+                {
+                    std::cerr << "Invalid value for '" << arg << "'\n";
+                    return false;
+                }
+                continue;
+            }
+            if (matchValue(arg, "--output", value))
+            {
+                if (value == "stdout")
+                    opts.Output = output::Stream::STDOUT;
+                else if (value == "stderr")
+                    opts.Output = output::Stream::STDERR;
+                else
+                {
+                    std::cerr << "Invalid value for '" << arg << "'\n";
+                    return false;
+                }
+                continue;
+            }
+            if (matchValue(arg, "--output-buffer", value))
+            {
+                if (!parseUnsigned(arg, value, opts.OutputBufferSize))
+                    return false;
+                continue;
+            }
+            if (matchValue(arg, "--threads", value))
+            {
+                if (!parseUnsigned(arg, value, opts.Threads))
+                    return false;
+                continue;
+            }
+            if (matchValue(arg, "--profile-use", opts.ProfileUse))
+                continue;
+
+#ifdef ENABLE_BASIC_JIT_COMPILER
+            if (arg == "--lazy")
+            {
+                opts.LazyJIT = true;
+                continue;
+            }
+            if (matchValue(arg, "--cache-dir", opts.CacheDir))
+                continue;
+            if (matchValue(arg, "--cache-size", value))
+            {
+                if (!parseUnsigned(arg, value, opts.CacheSizeMB))
+                    return false;
+                continue;
+            }
+            if (arg == "--cache-stats")
+            {
+                opts.CacheStats = true;
+                continue;
+            }
+            if (arg == "--repl")
+            {
+                opts.Repl = true;
+                continue;
+            }
+            if (matchValue(arg, "--profile-generate", opts.ProfileGenerate))
+                continue;
+#endif
+
+#ifdef ENABLE_TIERED_EXECUTION
+            if (arg == "--no-tiering")
+            {
+                opts.Tiered = false;
+                continue;
+            }
+            if (matchValue(arg, "--tier-threshold", value))
+            {
+                if (!parseUnsigned(arg, value, opts.TierThreshold))
+                    return false;
+                continue;
+            }
+#endif
+
+            // A lone `-` is stdin.
+            if (arg.empty() || (arg[0] == '-' && arg != "-"))
+            {
+                std::cerr << "Unknown option '" << arg << "'\n";
+                return false;
+            }
+            opts.InputFiles.push_back(arg);
+        }
+
+#ifdef ENABLE_BASIC_JIT_COMPILER
+        if (!opts.ProfileGenerate.empty() && !opts.ProfileUse.empty())
+        {
+            std::cerr << "'--profile-generate' and '--profile-use' can't be combined\n";
+            return false;
+        }
+#endif
+
+        return true;
+    }
+
+    void printUsage(const char *program)
+    {
+        std::cerr << "Usage: " << program << " [options] [file...]\n"
+                  << "  file                     source file, - for stdin; several files make one program, in order\n"
+                  << "  -O0, -O1, -O2, -O3       optimization level, -O0 skips the optimizer (default -O2)\n"
+                  << "  --mcpu=native|<name>     CPU to generate code for (default: host CPU for the JIT, generic for AOT)\n"
+                  << "  --mattr=<+f1,-f2,...>    enable/disable CPU features on top of the CPU's\n"
+                  << "  --whole-program          internalize all but main and exports, inline operators, drop dead code\n"
+                  << "  --export=<f1,f2,...>     functions kept external in whole-program mode, besides main\n"
+                  << "  --timing[=text|json]     print phase, pass and function timing to stderr on exit\n"
+                  << "  --output=stdout|stderr   stream the program prints to (default stderr)\n"
+                  << "  --output-buffer=<bytes>  program output buffered per thread, 0 writes every call (default 65536)\n"
+                  << "  --threads=<n>            threads running parallel for loops and parsing, 0 uses every core (default 0)\n"
+                  << "  --profile-use=<file>     optimize with the profile written by --profile-generate\n"
+#ifdef ENABLE_PRINTING_AST
+                  << "  --print-ast              print the AST\n"
+#endif
+#ifdef ENABLE_PRINTING_LLVM_IR
+                  << "  --print-ir               print the LLVM IR of the whole program module\n"
+#endif
+#ifdef ENABLE_BASIC_JIT_COMPILER
+                  << "  --lazy                   compile each function on its first call\n"
+                  << "  --cache-dir=<dir>        cache JIT compiled objects in <dir> across runs\n"
+                  << "  --cache-size=<MiB>       max size of the object cache (default 256)\n"
+                  << "  --cache-stats            print object cache hit/miss counters on exit\n"
+                  << "  --repl                   evaluate statement by statement, from stdin when no file is given\n"
+                  << "  --profile-generate=<file> instrument the code, write its call and branch counts to <file> on exit\n"
+#endif
+#ifdef ENABLE_TIERED_EXECUTION
+                  << "  --no-tiering             JIT compile the whole program before running it\n"
+                  << "  --tier-threshold=<n>     calls + loop back-edges a function runs interpreted before it is JIT compiled (default 1000)\n"
+#endif
+            ;
+    }
+} // namespace options
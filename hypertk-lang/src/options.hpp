@@ -0,0 +1,74 @@
+#ifndef HYPERTK_OPTIONS_HPP
+#define HYPERTK_OPTIONS_HPP
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "common.hpp"
+#include "timing.hpp"
+#include "output.hpp"
+
+namespace options
+{
+    /** @brief Command line options of the `hypertk` driver */
+    struct Options
+    {
+        /** @brief Source files of the program to run, `-` is stdin, the built-in demo program is used when empty */
+        std::vector<std::string> InputFiles;
+        /** @brief Optimization level 0..3 */
+        unsigned OptLevel = 2;
+        /** @brief CPU to generate code for, empty selects the host CPU for the JIT and `generic` for AOT */
+        std::string CPU;
+        /** @brief Comma separated CPU features added on top of the CPU's */
+        std::string Features;
+        /** @brief Internalize everything but `main` and `Exports`, inline operators, drop dead functions */
+        bool WholeProgram = false;
+        /** @brief Functions keeping external linkage in whole-program mode */
+        std::vector<std::string> Exports;
+        /** @brief Print phase, pass and function timing on exit, off when empty */
+        std::optional<timing::Format> Timing;
+        /** @brief Stream the program's `putchard` and `printd` output goes to */
+        output::Stream Output = output::Stream::STDERR;
+        /** @brief Bytes of program output each thread buffers, `0` writes every call through */
+        unsigned OutputBufferSize = output::DefaultBufferSize;
+        /** @brief Threads running `parallel for` loops, `0` uses every core */
+        unsigned Threads = 0;
+        /** @brief Profile written by `--profile-generate` to optimize with, none when empty */
+        std::string ProfileUse;
+#ifdef ENABLE_PRINTING_AST
+        bool PrintAST = false;
+#endif
+#ifdef ENABLE_PRINTING_LLVM_IR
+        bool PrintIR = false;
+#endif
+#ifdef ENABLE_BASIC_JIT_COMPILER
+        /** @brief Compile each function on its first call */
+        bool LazyJIT = false;
+        /** @brief Directory of the persistent JIT object cache, disabled when empty */
+        std::string CacheDir;
+        /** @brief Max size of the object cache in MiB */
+        unsigned CacheSizeMB = 256;
+        /** @brief Print object cache hit/miss counters on exit */
+        bool CacheStats = false;
+        /** @brief Evaluate the input entry by entry, read from stdin when no file is given */
+        bool Repl = false;
+        /** @brief Instrument the code and write the profile to this file on exit, off when empty */
+        std::string ProfileGenerate;
+#endif
+#ifdef ENABLE_TIERED_EXECUTION
+        /** @brief Start running in the interpreter and JIT compile hot functions */
+        bool Tiered = true;
+        /** @brief Calls + loop back-edges a function runs interpreted before it is JIT compiled */
+        unsigned TierThreshold = 1000;
+#endif
+    };
+
+    /** @brief Parse command line arguments, return `false` if they are malformed */
+    bool parse(int argc, char **argv, Options &opts);
+
+    /** @brief Print usage to stderr */
+    void printUsage(const char *program);
+} // namespace options
+
+#endif
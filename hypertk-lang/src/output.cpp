@@ -0,0 +1,123 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "output.hpp"
+
+namespace output
+{
+    /** @brief Longest `%f` of a double: 309 integer digits, sign, point and 6 decimals, then a newline */
+    static constexpr size_t MaxNumberLength = 320;
+
+    static FILE *stream_ = stderr;
+    static size_t bufferSize_ = DefaultBufferSize;
+
+    struct Buffer;
+    /** @brief Buffers of the running threads, for `flushAll` */
+    static std::vector<Buffer *> buffers_;
+    static std::mutex buffersLock_;
+
+    struct Buffer
+    {
+        std::unique_ptr<char[]> Data;
+        size_t Size = 0;
+        size_t Capacity = 0;
+
+        Buffer() : Capacity{bufferSize_}
+        {
+            if (Capacity)
+                Data = std::make_unique<char[]>(Capacity);
+            std::lock_guard<std::mutex> lock(buffersLock_);
+            buffers_.push_back(this);
+        }
+        ~Buffer()
+        {
+            flush();
+            std::lock_guard<std::mutex> lock(buffersLock_);
+            buffers_.erase(std::find(buffers_.begin(), buffers_.end(), this));
+        }
+
+        void flush()
+        {
+            if (Size == 0)
+                return;
+            std::fwrite(Data.get(), 1, Size, stream_);
+            std::fflush(stream_);
+            Size = 0;
+        }
+    };
+
+    /** @brief Buffer of the calling thread, flushed by its destructor when the thread exits */
+    static Buffer &buffer()
+    {
+        thread_local Buffer buffer_;
+        return buffer_;
+    }
+
+    void configure(Stream stream, size_t bufferSize)
+    {
+        stream_ = stream == Stream::STDOUT ? stdout : stderr;
+        bufferSize_ = bufferSize;
+    }
+
+    void write(const char *data, size_t size)
+    {
+        Buffer &buf = buffer();
+        if (size == 0)
+            return;
+        if (buf.Size + size > buf.Capacity)
+        {
+            buf.flush();
+            // Too big to buffer, write it through.
+            if (size > buf.Capacity)
+            {
+                std::fwrite(data, 1, size, stream_);
+                std::fflush(stream_);
+                return;
+            }
+        }
+        std::memcpy(buf.Data.get() + buf.Size, data, size);
+        buf.Size += size;
+    }
+
+    void put(char c)
+    {
+        Buffer &buf = buffer();
+        if (buf.Size < buf.Capacity)
+            buf.Data[buf.Size++] = c;
+        else
+            write(&c, 1);
+    }
+
+    void printNumber(double value)
+    {
+        Buffer &buf = buffer();
+        if (buf.Capacity <= MaxNumberLength)
+        {
+            char text[MaxNumberLength + 1];
+            int length = std::snprintf(text, sizeof(text), "%f\n", value);
+            write(text, (size_t)length);
+            return;
+        }
+
+        if (buf.Capacity - buf.Size < MaxNumberLength + 1)
+            buf.flush();
+        int length = std::snprintf(buf.Data.get() + buf.Size, buf.Capacity - buf.Size, "%f\n", value);
+        buf.Size += (size_t)length;
+    }
+
+    void flush()
+    {
+        buffer().flush();
+    }
+
+    void flushAll()
+    {
+        std::lock_guard<std::mutex> lock(buffersLock_);
+        for (Buffer *buf : buffers_)
+            buf->flush();
+    }
+} // namespace output
@@ -0,0 +1,44 @@
+#ifndef HYPERTK_OUTPUT_HPP
+#define HYPERTK_OUTPUT_HPP
+
+#include <cstddef>
+
+/**
+ * @brief Buffered output of the running program, written by `putchard` and `printd`.
+ * @details Every thread collects its output in a buffer of its own and writes it in one call once
+ * it is full, when `flush` is called, and when the thread exits (for the main thread, when the
+ * process exits). A buffer is always written whole, output of different threads does not interleave
+ * within one flush. Output that has to show before something else, such as an error message or the
+ * `Eval` line, is flushed first.
+ */
+namespace output
+{
+    enum class Stream
+    {
+        STDOUT,
+        STDERR,
+    };
+
+    /** @brief Default size of each thread's buffer in bytes */
+    inline constexpr size_t DefaultBufferSize = 64 * 1024;
+
+    /**
+     * @brief Select where the output goes and how much each thread buffers, `0` writes every call through.
+     * @note Call it before any code runs, a thread keeps the size its buffer was created with.
+     */
+    void configure(Stream stream, size_t bufferSize = DefaultBufferSize);
+
+    void write(const char *data, size_t size);
+    void put(char c);
+    /** @brief Write `value` as `%f` followed by a newline, formatted straight into the buffer */
+    void printNumber(double value);
+    /** @brief Write out the buffer of the calling thread */
+    void flush();
+    /**
+     * @brief Write out the buffers of every thread, e.g. before the process exits from another thread than the main one.
+     * @note Only while the other threads write no output, see `parallel::stop`.
+     */
+    void flushAll();
+} // namespace output
+
+#endif
@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "parallel.hpp"
+#include "builtin.hpp"
+#include "output.hpp"
+
+namespace parallel
+{
+    /** @brief Most chunks a loop is cut into, more chunks balance better but cost more scheduling */
+    static constexpr int64_t MaxChunks = 1024;
+
+    static unsigned threadCount_ = 0;
+
+    class Pool
+    {
+    public:
+        explicit Pool(unsigned threads) : workers_(threads)
+        {
+            for (auto &worker : workers_)
+                worker = std::make_unique<Worker>();
+            // Worker `0` is the thread starting the loop.
+            for (unsigned w = 1; w < threads; ++w)
+                std::thread(&Pool::workerLoop, this, w).detach();
+        }
+
+        /** @brief Run a loop on the pool, `false` if it is busy with another one */
+        bool tryRun(Body body, void *env, int64_t count, int64_t chunk, std::vector<double> &partials)
+        {
+            if (inWorker_)
+                return false;
+            std::unique_lock<std::mutex> job(jobLock_, std::try_to_lock);
+            if (!job.owns_lock())
+                return false;
+
+            const int64_t chunks = (int64_t)partials.size();
+            {
+                std::unique_lock<std::mutex> lock(lock_);
+                // A worker woken late for the previous loop must be gone before the job changes.
+                done_.wait(lock, [&] { return busy_ == 0; });
+
+                body_ = body, env_ = env, count_ = count, chunk_ = chunk, partials_ = partials.data();
+                remaining_ = chunks;
+                const int64_t threads = (int64_t)workers_.size();
+                for (int64_t w = 0; w < threads; ++w)
+                {
+                    std::lock_guard<std::mutex> range(workers_[w]->Lock);
+                    workers_[w]->Begin = chunks * w / threads;
+                    workers_[w]->End = chunks * (w + 1) / threads;
+                }
+                ++generation_;
+                ++busy_;
+            }
+            wake_.notify_all();
+
+            inWorker_ = true;
+            work(0);
+            inWorker_ = false;
+
+            std::unique_lock<std::mutex> lock(lock_);
+            --busy_;
+            done_.notify_all();
+            done_.wait(lock, [&] { return remaining_ == 0 && busy_ == 0; });
+            return true;
+        }
+
+        /** @brief The calling thread runs chunks of a loop */
+        static bool inLoop() { return inWorker_; }
+
+        /** @brief Take no more chunks and wait until the calling thread is the only one working, see `parallel::stop` */
+        void stop()
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+            if (stopping_)
+            {
+                // Another thread stops the loop and ends the process, this one must not go on.
+                --busy_;
+                done_.notify_all();
+                while (true)
+                    wake_.wait(lock);
+            }
+            stopping_ = true;
+            done_.wait(lock, [&] { return busy_ == 1; });
+        }
+
+    private:
+        /** @brief Chunks `Begin` to `End - 1` a thread has left to run */
+        struct Worker
+        {
+            std::mutex Lock;
+            int64_t Begin = 0;
+            int64_t End = 0;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers_;
+        /** @brief Held while a loop runs on the pool */
+        std::mutex jobLock_;
+
+        std::mutex lock_;
+        std::condition_variable wake_;
+        std::condition_variable done_;
+        /** @brief Counts the loops started, a worker runs a loop once */
+        uint64_t generation_ = 0;
+        /** @brief Threads working on the current loop */
+        unsigned busy_ = 0;
+        /** @brief Chunks of the current loop not run yet */
+        int64_t remaining_ = 0;
+        /** @brief Set by `stop`, no thread takes a chunk any more */
+        std::atomic<bool> stopping_{false};
+
+        Body body_ = nullptr;
+        void *env_ = nullptr;
+        int64_t count_ = 0;
+        int64_t chunk_ = 0;
+        double *partials_ = nullptr;
+
+        /** @brief The thread runs chunks of a loop, a loop it starts runs on its own */
+        static thread_local bool inWorker_;
+
+        void workerLoop(unsigned w)
+        {
+            inWorker_ = true;
+            uint64_t seen = 0;
+            std::unique_lock<std::mutex> lock(lock_);
+            while (true)
+            {
+                wake_.wait(lock, [&] { return generation_ != seen; });
+                seen = generation_;
+                ++busy_;
+                lock.unlock();
+
+                work(w);
+                // Workers never exit, their output would stay in their buffers.
+                output::flush();
+
+                lock.lock();
+                --busy_;
+                done_.notify_all();
+            }
+        }
+
+        /** @brief Take the next chunk of worker `w`, stealing half of another worker's chunks when it has none */
+        bool next(unsigned w, int64_t &chunk)
+        {
+            if (stopping_)
+                return false;
+
+            Worker &self = *workers_[w];
+            {
+                std::lock_guard<std::mutex> range(self.Lock);
+                if (self.Begin < self.End)
+                {
+                    chunk = self.Begin++;
+                    return true;
+                }
+            }
+
+            for (size_t i = 1; i < workers_.size(); ++i)
+            {
+                Worker &victim = *workers_[(w + i) % workers_.size()];
+                int64_t begin, end;
+                {
+                    std::lock_guard<std::mutex> range(victim.Lock);
+                    if (victim.Begin >= victim.End)
+                        continue;
+                    begin = victim.Begin + (victim.End - victim.Begin) / 2;
+                    end = victim.End;
+                    victim.End = begin;
+                }
+                std::lock_guard<std::mutex> range(self.Lock);
+                self.Begin = begin + 1;
+                self.End = end;
+                chunk = begin;
+                return true;
+            }
+            return false;
+        }
+
+        void work(unsigned w)
+        {
+            int64_t chunk;
+            while (next(w, chunk))
+            {
+                int64_t first = chunk * chunk_;
+                partials_[chunk] = body_(first, std::min(count_, first + chunk_), env_);
+
+                std::lock_guard<std::mutex> lock(lock_);
+                if (--remaining_ == 0)
+                    done_.notify_all();
+            }
+        }
+    };
+
+    thread_local bool Pool::inWorker_ = false;
+
+    /** @brief Pool of the process, created on the first loop and never destroyed: a worker may call `exit` */
+    static Pool *pool()
+    {
+        static Pool *pool_ = new Pool(threadCount());
+        return pool_;
+    }
+
+    void setThreadCount(unsigned threads)
+    {
+        threadCount_ = threads;
+    }
+
+    unsigned threadCount()
+    {
+        return threadCount_ ? threadCount_ : std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    int64_t chunkSize(int64_t count)
+    {
+        return std::max<int64_t>(1, (count + MaxChunks - 1) / MaxChunks);
+    }
+
+    double run(Body body, void *env, int64_t count)
+    {
+        if (count <= 0)
+            return 0;
+
+        const int64_t chunk = chunkSize(count);
+        std::vector<double> partials((count + chunk - 1) / chunk);
+        if (!pool()->tryRun(body, env, count, chunk, partials))
+            for (size_t c = 0; c < partials.size(); ++c)
+            {
+                int64_t first = (int64_t)c * chunk;
+                partials[c] = body(first, std::min(count, first + chunk), env);
+            }
+
+        double sum = 0;
+        for (double partial : partials)
+            sum += partial;
+        return sum;
+    }
+
+    void stop()
+    {
+        if (Pool::inLoop())
+            pool()->stop();
+    }
+} // namespace parallel
+
+double hypertk_parallel_for(double (*body)(int64_t, int64_t, void *), void *env, int64_t count)
+{
+    return parallel::run(body, env, count);
+}
@@ -0,0 +1,48 @@
+#ifndef HYPERTK_PARALLEL_HPP
+#define HYPERTK_PARALLEL_HPP
+
+#include <cstdint>
+
+/**
+ * @brief Thread pool running the iterations of `parallel for` loops, and the functions of large
+ * programs the frontend parses and analyzes in parallel.
+ * @details The iterations are cut into chunks whose size only depends on the iteration count.
+ * Each thread starts with an equal share of the chunks and takes them one by one, a thread
+ * running out of work steals the second half of the chunks another thread has left. The partial
+ * sums of the chunks are added up in chunk order, so a reduction gives the same result for any
+ * number of threads and any schedule.
+ */
+namespace parallel
+{
+    /** @brief Outlined loop body: runs the iterations `first` to `last - 1`, returns the sum of their values */
+    using Body = double (*)(int64_t first, int64_t last, void *env);
+
+    /**
+     * @brief Number of threads running a loop, the calling one included. `0` (the default) uses every core.
+     * @note Call it before the first parallel loop runs, the pool is created then.
+     */
+    void setThreadCount(unsigned threads);
+
+    /** @brief Number of threads running a loop, the calling one included */
+    unsigned threadCount();
+
+    /** @brief Number of iterations in each chunk of a loop of `count` iterations, the last chunk may be shorter */
+    int64_t chunkSize(int64_t count);
+
+    /**
+     * @brief Run `body` over the iterations `0` to `count - 1` and return the sum of the chunk results in chunk order.
+     * @details A loop started while the pool runs another one, e.g. a parallel loop nested in
+     * another, runs its chunks on the calling thread alone.
+     */
+    double run(Body body, void *env, int64_t count);
+
+    /**
+     * @brief Stop the loop the calling thread runs chunks of and wait until the other threads are idle.
+     * @details For a loop body about to end the process, e.g. on an index error: once it returns no
+     * other thread writes output, see `output::flushAll`. Does nothing outside of a loop. When
+     * several threads call it, only the first returns, the others block for good.
+     */
+    void stop();
+} // namespace parallel
+
+#endif
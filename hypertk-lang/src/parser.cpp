@@ -1,49 +1,185 @@
-#include <memory>
 #include <vector>
 
 #include "parser.hpp"
 #include "lexer.hpp"
 #include "error.hpp"
+#include "timing.hpp"
+#include "symbol.hpp"
+#ifdef ENABLE_PARALLEL_FRONTEND
+#include "parallel.hpp"
+#endif
 
 namespace parser
 {
     using token::TokenType;
 
     Parser::Parser(lexer::Lexer &&lexer_)
-        : lexer_{std::move(lexer_)}, panicMode_{false}
+        : lexer_{std::move(lexer_)}, nodes_{nullptr}, panicMode_{false}, rules_{}, sawArray_{false}, lexedTokens_{0}
     {
-        binopPrec_[TokenType::EQUAL] = 2;
-        binopPrec_[TokenType::QUESTION_MARK] = 5;
-        binopPrec_[TokenType::LESS] = 10;
-        binopPrec_[TokenType::PLUS] = 20;
-        binopPrec_[TokenType::MINUS] = 20;
-        binopPrec_[TokenType::STAR] = 40;
-        binopPrec_[TokenType::SLASH] = 40;
+        rule(TokenType::NUMBER).Prefix = &Parser::parseNumber;
+        rule(TokenType::IDENTIFIER).Prefix = &Parser::parseIdentifier;
+        rule(TokenType::LEN).Prefix = &Parser::parseLength;
+        rule(TokenType::LEFT_PAREN).Prefix = &Parser::parseParen;
+        // `-x` may come before the `unary-` definition, unary operators are known from the start.
+        rule(TokenType::MINUS).Prefix = &Parser::parseUnary;
+        rule(TokenType::EXCLAMATION).Prefix = &Parser::parseUnary;
+
+        rule(TokenType::QUESTION_MARK) = {nullptr, &Parser::parseConditional, 5};
+        setTokenPrecedence(TokenType::EQUAL, 2);
+        setTokenPrecedence(TokenType::VERTICAL_BAR_VERTICAL_BAR, 6);
+        setTokenPrecedence(TokenType::AMPERSAND_AMPERSAND, 7);
+        setTokenPrecedence(TokenType::LESS, 10);
+        setTokenPrecedence(TokenType::PLUS, 20);
+        setTokenPrecedence(TokenType::MINUS, 20);
+        setTokenPrecedence(TokenType::STAR, 40);
+        setTokenPrecedence(TokenType::SLASH, 40);
     }
     // Parser::Parser(const lexer::Lexer &lexer)
     //     : lexer_{std::move(lexer)}, panicMode_{false} {}
 
+    void Parser::reset(lexer::Lexer &&lexer_)
+    {
+        this->lexer_ = std::move(lexer_);
+        previous_ = token::Token();
+        current_ = token::Token();
+        panicMode_ = false;
+    }
+
     std::optional<ast::Program> Parser::parse()
     {
+        ast::Program program;
+        parse(program);
+        return std::move(program);
+    }
+
+    void Parser::parse(ast::Program &program)
+    {
+#ifdef ENABLE_PARALLEL_FRONTEND
+        if (parseInParallel(program))
+            return;
+#endif
+
+        nodes_ = &program.Nodes;
         advance();
 
-        ast::Program program;
         while (!match(TokenType::END_OF_FILE))
         {
             if (auto stmt = parseDeclaration(); stmt.has_value())
             {
-                program.emplace_back(std::move(stmt.value()));
+                program.Statements.push_back(stmt.value());
                 continue;
             }
 
             break; // should synchronize
         }
+        nodes_ = nullptr;
+    }
 
-        return std::move(program);
+#ifdef ENABLE_PARALLEL_FRONTEND
+    /** @brief Smallest source whose functions are parsed on the thread pool, a smaller one parses faster than the threads start */
+    static constexpr int ParallelMinBytes = 64 << 10;
+
+    /// @details The lexer scans the source for where its functions start, the pool parses each
+    /// chunk of consecutive functions with a parser of its own, into an arena and a symbol table
+    /// of its own. The parts are then appended to the program in source order, their names are
+    /// interned in that order too, so the program is the same as the one parsed in order, symbols
+    /// included. If any part has an error the whole source is parsed again in order, which
+    /// reports the error with the right line, and only it, as a sequential parse does.
+    bool Parser::parseInParallel(ast::Program &program)
+    {
+        if (lexer_.remaining() < ParallelMinBytes || parallel::threadCount() < 2)
+            return false;
+        std::optional<std::vector<lexer::FunctionStart>> starts;
+        {
+            timing::ScopedPhase phase(timing::Phase::LEX);
+            starts = lexer_.scanFunctions();
+        }
+        if (!starts.has_value() || starts->size() < 2)
+            return false;
+
+        std::vector<size_t> operatorDefs;
+        for (size_t i = 0; i < starts->size(); ++i)
+            if (starts.value()[i].BinaryOp != TokenType::ERROR || starts.value()[i].UnaryOp != TokenType::ERROR)
+                operatorDefs.push_back(i);
+
+        const int64_t count = (int64_t)starts->size();
+        const int64_t chunk = parallel::chunkSize(count);
+        std::vector<Part> parts((count + chunk - 1) / chunk);
+        struct Job
+        {
+            const Parser *Outer;
+            const std::vector<lexer::FunctionStart> *Starts;
+            const std::vector<size_t> *OperatorDefs;
+            std::vector<Part> *Parts;
+            int64_t Chunk;
+        } job{this, &starts.value(), &operatorDefs, &parts, chunk};
+
+        double failures = parallel::run(
+            [](int64_t first, int64_t last, void *env) -> double
+            {
+                const Job &job = *(const Job *)env;
+                Part &part = (*job.Parts)[first / job.Chunk];
+                return job.Outer->parsePart(part, *job.Starts, *job.OperatorDefs, first, last) ? 0 : 1;
+            },
+            &job, count);
+        if (failures > 0)
+            return false;
+
+        for (Part &part : parts)
+        {
+            std::vector<symbol::Symbol> symbols = part.Symbols.publish();
+            // Too large a program is reported, and dropped like one with a parse error.
+            if (!program.Nodes.append(std::move(part.Program.Nodes), symbols, part.Program.Statements))
+                return true;
+            program.Statements.insert(program.Statements.end(), part.Program.Statements.begin(), part.Program.Statements.end());
+        }
+        for (size_t i : operatorDefs)
+            defineOperator(starts.value()[i]);
+        return true;
     }
 
+    bool Parser::parsePart(Part &part, const std::vector<lexer::FunctionStart> &starts, const std::vector<size_t> &operatorDefs,
+                           size_t first, size_t last) const
+    {
+        symbol::InternInto intern(part.Symbols);
+        error::Capture capture;
+
+        Parser partParser{lexer_.at(starts[first])};
+        partParser.rules_ = rules_;
+        for (size_t i = 0; i < operatorDefs.size() && operatorDefs[i] < first; ++i)
+            partParser.defineOperator(starts[operatorDefs[i]]);
+
+        partParser.nodes_ = &part.Program.Nodes;
+        partParser.advance();
+        const char *begin = partParser.current_.lexeme.data();
+        for (size_t i = first; i < last; ++i)
+        {
+            if (!partParser.match(TokenType::FUNC))
+                return false;
+            auto stmt = partParser.parseFunctionDeclaration();
+            if (!stmt.has_value())
+                return false;
+            part.Program.Statements.push_back(stmt.value());
+        }
+
+        // Parsed without error, the last function ends where the scan found the next one starts.
+        bool atNext = last == starts.size()
+                          ? partParser.check(TokenType::END_OF_FILE)
+                          : partParser.current_.lexeme.data() == begin + (starts[last].Offset - starts[first].Offset);
+        return atNext && !capture.caught();
+    }
+
+    void Parser::defineOperator(const lexer::FunctionStart &start)
+    {
+        if (start.BinaryOp != TokenType::ERROR)
+            setTokenPrecedence(start.BinaryOp, start.Precedence);
+        if (start.UnaryOp != TokenType::ERROR)
+            setPrefixOperator(start.UnaryOp);
+    }
+#endif
+
     //> Parse statement
-    std::optional<ast::statement::StmtPtr> Parser::parseDeclaration()
+    std::optional<ast::statement::StmtRef> Parser::parseDeclaration()
     {
         if (match(TokenType::FUNC))
             return parseFunctionDeclaration();
@@ -52,7 +188,7 @@ namespace parser
         return parseStatement();
     }
 
-    std::optional<ast::statement::StmtPtr> Parser::parseStatement()
+    std::optional<ast::statement::StmtRef> Parser::parseStatement()
     {
         if (match(TokenType::RETURN))
             return parseReturnStmt();
@@ -60,12 +196,17 @@ namespace parser
             return parseIfStmt();
         if (match(TokenType::FOR))
             return parseForStmt();
+        if (match(TokenType::PARALLEL))
+        {
+            consume(TokenType::FOR, "Expect 'for' after 'parallel'.");
+            return parseForStmt(true);
+        }
         if (match(TokenType::LEFT_BRACE))
             return parseBlockStmt();
         return parseExpressionStmt();
     }
 
-    std::optional<ast::statement::VarDeclPtr> Parser::parseVariableDeclaration()
+    std::optional<ast::statement::VarDeclRef> Parser::parseVariableDeclaration()
     {
         if (!match(TokenType::IDENTIFIER))
         {
@@ -75,23 +216,35 @@ namespace parser
 
         token::Token varName = std::move(previous_);
 
-        std::optional<ast::expression::ExprPtr> initializer = std::nullopt;
+        //> Parse array size, `var a[n];`
+        std::optional<ast::expression::ExprRef> size = std::nullopt;
+        if (match(TokenType::LEFT_BRACKET))
+        {
+            if (size = parseExpr(); !size.has_value())
+                return std::nullopt;
+            consume(TokenType::RIGHT_BRACKET, "Expect ']' after array size.");
+            if (check(TokenType::EQUAL))
+                errorAtCurrent("An array cannot have an initializer, its elements start as 0.");
+            sawArray_ = true;
+        }
+        //<
+
+        std::optional<ast::expression::ExprRef> initializer = std::nullopt;
         if (match(TokenType::EQUAL))
         {
             if (initializer = parseExpr(); !initializer.has_value())
                 return std::nullopt;
         }
 
-        return std::make_unique<ast::statement::VarDecl>(std::move(varName),
-                                                         initializer.has_value()
-                                                             ? std::move(initializer.value())
-                                                             : (std::optional<ast::expression::ExprPtr>)std::nullopt);
+        consume(TokenType::SEMICOLON, "Expect ';' after variable declaration.");
+
+        return nodes_->make<ast::statement::VarDecl>(std::move(varName), initializer, size);
     }
 
     /// functionDecl
     ///   ::= id '(' id* ')'
     ///   ::= binary LETTER number? (id, id)
-    std::optional<ast::statement::FunctionPtr> Parser::parseFunctionDeclaration()
+    std::optional<ast::statement::StmtRef> Parser::parseFunctionDeclaration()
     {
         token::Token funcName;
         ast::FuncKind funcKind = ast::FuncKind::FUNCTION; // 0 = identifier, 1 = unary, 2 = binary.
@@ -107,12 +260,15 @@ namespace parser
             funcName = std::move(current_);
             advance();
             binOpType = current_.type;
-            funcName.lexeme += current_.lexeme; // operator
+            funcName.symbol = symbol::intern(std::string(funcName.lexeme) + std::string(current_.lexeme)); // operator
+            funcName.lexeme = symbol::name(funcName.symbol);
             advance();
+            if (binOpType == TokenType::AMPERSAND_AMPERSAND || binOpType == TokenType::VERTICAL_BAR_VERTICAL_BAR)
+                error("Cannot redefine builtin operator.");
 
             if (match(TokenType::NUMBER))
             {
-                binPrec = (unsigned)std::stoi(previous_.lexeme);
+                binPrec = (unsigned)std::stoi(std::string(previous_.lexeme));
                 if (binPrec < 0 || binPrec > 100)
                     errorAtCurrent("Invalid precedence: must be 1..100");
             }
@@ -126,8 +282,13 @@ namespace parser
             funcName = std::move(current_);
             advance();
             binOpType = current_.type;
-            funcName.lexeme += current_.lexeme; // operator
+            funcName.symbol = symbol::intern(std::string(funcName.lexeme) + std::string(current_.lexeme)); // operator
+            funcName.lexeme = symbol::name(funcName.symbol);
             advance();
+            if (!ast::isUnaryOp(binOpType))
+                error("Expect an operator character after 'unary'.");
+            else if (ast::isBuiltinUnaryOp((ast::UnaryOp)binOpType))
+                error("Cannot redefine builtin operator.");
 
             break;
         }
@@ -164,31 +325,44 @@ namespace parser
         consume(TokenType::RIGHT_PAREN, "Expect ')'.");
         consume(TokenType::LEFT_BRACE, "Expect '{'.");
 
-        std::vector<ast::statement::StmtPtr> stmts;
+        sawArray_ = false;
+        ast::List<ast::statement::StmtRef> stmts;
         if (!check(TokenType::RIGHT_BRACE))
             stmts = parseBlock();
 
         consume(TokenType::RIGHT_BRACE, "Expect '}'.");
 
+        ast::List<token::Token> params = nodes_->list(args);
         switch (funcKind)
         {
         case ast::FuncKind::BINARY_OP:
         {
             setTokenPrecedence(binOpType, binPrec);
-            return std::make_unique<ast::statement::BinOpDef>(std::move(funcName), std::move(args), std::move(stmts), binPrec);
+            auto binOp = nodes_->make<ast::statement::BinOpDef>(std::move(funcName), params, stmts, binPrec);
+            (*nodes_)[binOp].HasArrays = sawArray_;
+            return binOp;
         }
         case ast::FuncKind::UNARY_OP:
-            return std::make_unique<ast::statement::UnaryOpDef>(std::move(funcName), std::move(args), std::move(stmts));
+        {
+            setPrefixOperator(binOpType);
+            auto unaryOp = nodes_->make<ast::statement::UnaryOpDef>(std::move(funcName), params, stmts);
+            (*nodes_)[unaryOp].HasArrays = sawArray_;
+            return unaryOp;
+        }
         default:
-            return std::make_unique<ast::statement::Function>(std::move(funcName), std::move(args), std::move(stmts));
+        {
+            auto function = nodes_->make<ast::statement::Function>(std::move(funcName), params, stmts);
+            (*nodes_)[function].HasArrays = sawArray_;
+            return function;
+        }
         }
     }
 
-    std::optional<ast::statement::ExpressionPtr> Parser::parseExpressionStmt()
+    std::optional<ast::statement::ExpressionRef> Parser::parseExpressionStmt()
     {
         if (auto expr = parseExpr(); expr.has_value())
         {
-            auto stmt = std::make_unique<ast::statement::Expression>(std::move(expr.value()));
+            auto stmt = nodes_->make<ast::statement::Expression>(expr.value());
             consume(TokenType::SEMICOLON, "Expect ';' after expression.");
             return stmt;
         }
@@ -196,11 +370,11 @@ namespace parser
         return std::nullopt;
     }
 
-    std::optional<ast::statement::ReturnPtr> Parser::parseReturnStmt()
+    std::optional<ast::statement::ReturnRef> Parser::parseReturnStmt()
     {
         if (auto expr = parseExpr(); expr.has_value())
         {
-            auto stmt = std::make_unique<ast::statement::Return>(std::move(expr.value()));
+            auto stmt = nodes_->make<ast::statement::Return>(expr.value());
             consume(TokenType::SEMICOLON, "Expect ';' after expression.");
             return stmt;
         }
@@ -208,7 +382,7 @@ namespace parser
         return std::nullopt;
     }
 
-    std::optional<ast::statement::IfPtr> Parser::parseIfStmt()
+    std::optional<ast::statement::IfRef> Parser::parseIfStmt()
     {
         consume(TokenType::LEFT_PAREN, "Expect '(' after 'if'.");
         auto cond = parseExpr();
@@ -220,23 +394,18 @@ namespace parser
         if (!then_.has_value())
             return std::nullopt;
 
-        std::optional<ast::statement::StmtPtr> else_ = std::nullopt;
+        std::optional<ast::statement::StmtRef> else_ = std::nullopt;
         if (match(TokenType::ELSE))
         {
             if (else_ = parseStatement(); !else_.has_value())
                 return std::nullopt;
         }
 
-        return std::make_unique<ast::statement::If>(
-            std::move(cond.value()),
-            std::move(then_.value()),
-            else_.has_value()
-                ? std::move(else_.value())
-                : (std::optional<ast::statement::StmtPtr>)std::nullopt);
+        return nodes_->make<ast::statement::If>(cond.value(), then_.value(), else_);
     }
 
     /// forexpr ::= 'for' identifier '=' expr ',' expr (',' expr)? 'in' expression
-    std::optional<ast::statement::ForPtr> Parser::parseForStmt()
+    std::optional<ast::statement::ForRef> Parser::parseForStmt(bool parallel)
     {
         consume(TokenType::IDENTIFIER, "expected identifier after for");
         token::Token nameToken = std::move(previous_);
@@ -259,151 +428,183 @@ namespace parser
         if (!step.has_value())
             return std::nullopt;
 
+        //> Parse reduction, `parallel for i = 0, i < n, 1 reduce total in expr;`
+        std::optional<ast::expression::VariableRef> reduce = std::nullopt;
+        if (parallel && match(TokenType::REDUCE))
+        {
+            consume(TokenType::IDENTIFIER, "Expect variable name after 'reduce'.");
+            reduce = nodes_->make<ast::expression::Variable>(std::move(previous_));
+        }
+        //<
+
         consume(TokenType::IN, "expected 'in' after for step value");
 
-        auto body = parseStatement();
+        // The reduced value is an expression, not a statement.
+        std::optional<ast::statement::StmtRef> body = std::nullopt;
+        if (!reduce.has_value())
+            body = parseStatement();
+        else if (auto expr = parseExpressionStmt(); expr.has_value())
+            body = expr.value();
         if (!body.has_value())
             return std::nullopt;
 
-        return std::make_unique<ast::statement::For>(std::move(nameToken),
-                                                     std::move(start.value()),
-                                                     std::move(end.value()),
-                                                     std::move(step.value()),
-                                                     std::move(body.value()));
+        return nodes_->make<ast::statement::For>(std::move(nameToken),
+                                                 start.value(),
+                                                 end.value(),
+                                                 step.value(),
+                                                 body.value(),
+                                                 parallel,
+                                                 reduce);
     }
 
-    std::optional<ast::statement::BlockPtr> Parser::parseBlockStmt()
+    std::optional<ast::statement::BlockRef> Parser::parseBlockStmt()
     {
-        std::vector<ast::statement::StmtPtr> statements = parseBlock();
+        ast::List<ast::statement::StmtRef> statements = parseBlock();
         consume(TokenType::RIGHT_BRACE, "Expect '}' at the end of block.");
-        return std::make_unique<ast::statement::Block>(std::move(statements));
+        return nodes_->make<ast::statement::Block>(statements);
     }
 
-    inline std::vector<ast::statement::StmtPtr> Parser::parseBlock()
+    inline ast::List<ast::statement::StmtRef> Parser::parseBlock()
     {
-        std::vector<ast::statement::StmtPtr> statements;
+        std::vector<ast::statement::StmtRef> statements;
 
         while (!check(TokenType::RIGHT_BRACE) && !check(TokenType::END_OF_FILE))
-            if (auto stmt = parseDeclaration(); stmt.has_value())
-                statements.push_back(std::move(stmt.value()));
+        {
+            auto stmt = parseDeclaration();
+            if (!stmt.has_value())
+                break; // should synchronize
+
+            statements.push_back(stmt.value());
+        }
 
-        return statements;
+        // Nested blocks were appended while this one was parsed, its list is appended whole at the end.
+        return nodes_->list(statements);
     }
     //>
 
     //> Parse expression
-    std::optional<ast::expression::ExprPtr> Parser::parseExpr() { return parseExpr(0); }
-    std::optional<ast::expression::ExprPtr> Parser::parseExpr(int exprPrec)
+    std::optional<ast::expression::ExprRef> Parser::parseExpr() { return parseExpr(0); }
+
+    /// @details Pratt parsing: the prefix rule of the first token parses an operand, then the
+    /// infix rules of the operators after it extend the expression, see `parseInfix`.
+    std::optional<ast::expression::ExprRef> Parser::parseExpr(int minPrec)
     {
-        auto LHS = parseUnary();
+        auto LHS = parsePrefix();
         if (!LHS.has_value())
             return std::nullopt;
 
-        return parseBinaryRHS(0, std::move(LHS.value()));
+        return parseInfix(minPrec, LHS.value());
     }
 
-    /// unary
-    ///   ::= primary
-    ///   ::= '!' unary
-    std::optional<ast::expression::ExprPtr> Parser::parseUnary()
+    /// @details As long as the current token is an infix operator binding at least as tightly as
+    /// `minPrec`, its infix rule takes `LHS` as its left operand.
+    std::optional<ast::expression::ExprRef> Parser::parseInfix(int minPrec, ast::expression::ExprRef LHS)
     {
-        // If the current token is not an unary operator, it must be a primary expr.
-        if (!ast::isUnaryOp(current_.type))
-            return parsePrimary();
-
-        ast::UnaryOp op = static_cast<ast::UnaryOp>(current_.type);
-        advance();
-
-        if (auto operand = parseUnary(); operand.has_value())
-            return std::make_unique<ast::expression::Unary>(op, std::move(operand.value()));
+        while (true)
+        {
+            int prec = getTokenPrecedence(current_.type);
+            if (prec < minPrec)
+                return LHS;
 
-        return std::nullopt;
+            InfixFn infix = rule(current_.type).Infix;
+            advance();
+            auto expr = (this->*infix)(LHS, prec);
+            if (!expr.has_value())
+                return std::nullopt;
+            LHS = expr.value();
+        }
     }
 
-    std::optional<ast::expression::ExprPtr> Parser::parseBinaryRHS(int exprPrec, ast::expression::ExprPtr LHS)
+    std::optional<ast::expression::ExprRef> Parser::parsePrefix()
     {
-        // If this is a binop, find its precedence.
-        while (true)
+        PrefixFn prefix = rule(current_.type).Prefix;
+        if (!prefix)
         {
-            int tokenPrec = getTokenPrecedence(current_.type);
+            errorAtCurrent("Unexpected token.");
+            return std::nullopt;
+        }
 
-            // If this is a binop that binds at least as tightly as the current binop,
-            // consume it, otherwise we are done.
-            if (tokenPrec < exprPrec)
-                return LHS;
+        advance();
+        return (this->*prefix)();
+    }
 
-            //> Parse conditional expression
-            if (match(TokenType::QUESTION_MARK))
-            {
-                auto thenExpr = parseExpr(tokenPrec);
-                if (!thenExpr.has_value())
-                    return std::nullopt;
+    std::optional<ast::expression::ExprRef> Parser::parseNumber()
+    {
+        double val = std::stod(std::string(previous_.lexeme));
+        // Literals out of the `int64_t` range stay floating point.
+        bool isInteger = previous_.lexeme.find('.') == std::string_view::npos && val < 0x1p63;
+        return nodes_->make<ast::expression::Number>(val, isInteger);
+    }
 
-                consume(TokenType::COLON, "Expect ':' in conditional expression");
+    /// unary
+    ///   ::= '!' operand
+    ///   ::= '-' operand
+    ///   ::= operator operand, for an operator a `unary` definition defines
+    std::optional<ast::expression::ExprRef> Parser::parseUnary()
+    {
+        ast::UnaryOp op = static_cast<ast::UnaryOp>(previous_.type);
 
-                auto elseExpr = parseExpr(tokenPrec);
-                if (!elseExpr.has_value())
-                    return std::nullopt;
+        // Unary operators bind tighter than any binary one.
+        if (auto operand = parsePrefix(); operand.has_value())
+            return nodes_->make<ast::expression::Unary>(op, operand.value());
 
-                LHS = std::make_unique<ast::expression::Conditional>(std::move(LHS),
-                                                                     std::move(thenExpr.value()),
-                                                                     std::move(elseExpr.value()));
-                continue;
-            }
-            //<
+        return std::nullopt;
+    }
 
-            // Okay, we know this is a binop.
-            advance();
-            auto binOp = std::move(previous_);
+    std::optional<ast::expression::ExprRef> Parser::parseBinary(ast::expression::ExprRef LHS, int prec)
+    {
+        auto op = (ast::BinaryOp)previous_.type;
 
-            // Parse the primary expression after the binary operator.
-            auto RHS = parseUnary();
+        auto RHS = parsePrefix();
+        if (!RHS.has_value())
+            return std::nullopt;
+
+        // An operator binding tighter than this one takes the RHS as its LHS. Operators of the
+        // same precedence do not, they group to the left.
+        if (getTokenPrecedence(current_.type) > prec)
+        {
+            RHS = parseInfix(prec + 1, RHS.value());
             if (!RHS.has_value())
                 return std::nullopt;
-
-            // If BinOp binds less tightly with RHS than the operator after RHS, let
-            // the pending operator take RHS as its LHS.
-            int nextPrec = getTokenPrecedence(current_.type);
-            if (tokenPrec < nextPrec)
-            {
-                RHS = parseBinaryRHS(tokenPrec + 1, std::move(RHS.value()));
-                if (!RHS.has_value())
-                    return std::nullopt;
-            }
-
-            // Merge LHS/RHS.
-            LHS = std::make_unique<ast::expression::Binary>((ast::BinaryOp)binOp.type, std::move(LHS), std::move(RHS.value()));
         }
+
+        return nodes_->make<ast::expression::Binary>(op, LHS, RHS.value());
     }
 
-    std::optional<ast::expression::ExprPtr> Parser::parsePrimary()
+    /// @brief conditionalexpr ::= expression '?' expression ':' expression
+    /// @note Both arms are whole expressions, an assignment included.
+    std::optional<ast::expression::ExprRef> Parser::parseConditional(ast::expression::ExprRef LHS, int prec)
     {
-        if (match(TokenType::NUMBER))
-            return std::make_unique<ast::expression::Number>(std::stod(previous_.lexeme));
-        if (match(TokenType::IDENTIFIER))
-            return parseIdentifier();
-        if (match(TokenType::LEFT_PAREN))
-            return parseParen();
+        auto thenExpr = parseExpr();
+        if (!thenExpr.has_value())
+            return std::nullopt;
 
-        errorAtCurrent("Unexpected token.");
-        return std::nullopt;
+        consume(TokenType::COLON, "Expect ':' in conditional expression");
+
+        auto elseExpr = parseExpr();
+        if (!elseExpr.has_value())
+            return std::nullopt;
+
+        return nodes_->make<ast::expression::Conditional>(LHS, thenExpr.value(), elseExpr.value());
     }
 
-    std::optional<ast::expression::ExprPtr> Parser::parseIdentifier()
+    std::optional<ast::expression::ExprRef> Parser::parseIdentifier()
     {
         token::Token name = std::move(previous_);
+        if (match(TokenType::LEFT_BRACKET))
+            return parseIndex(std::move(name));
         if (!match(TokenType::LEFT_PAREN))
-            return std::make_unique<ast::expression::Variable>(std::move(name));
+            return nodes_->make<ast::expression::Variable>(std::move(name));
 
         //> Parse call expression
-        std::vector<ast::expression::ExprPtr> args;
+        std::vector<ast::expression::ExprRef> args;
         if (!check(TokenType::RIGHT_PAREN))
         {
             do
             {
                 if (auto expr_ = parseExpr(); expr_.has_value())
                 {
-                    args.push_back(std::move(expr_.value()));
+                    args.push_back(expr_.value());
                     continue;
                 }
 
@@ -412,13 +613,39 @@ namespace parser
         }
         consume(TokenType::RIGHT_PAREN, "Expect ')'");
 
-        return std::make_unique<ast::expression::Call>(std::make_unique<ast::expression::Variable>(std::move(name)),
-                                                       std::move(args));
+        return nodes_->make<ast::expression::Call>(nodes_->make<ast::expression::Variable>(std::move(name)),
+                                                   nodes_->list(args));
         //<
     }
 
+    /// @brief indexexpr ::= identifier '[' expression ']'
+    std::optional<ast::expression::ExprRef> Parser::parseIndex(token::Token name)
+    {
+        auto idx = parseExpr();
+        if (!idx.has_value())
+            return std::nullopt;
+
+        consume(TokenType::RIGHT_BRACKET, "Expect ']' after index.");
+        return nodes_->make<ast::expression::Index>(nodes_->make<ast::expression::Variable>(std::move(name)), idx.value());
+    }
+
+    /// @brief lenexpr ::= 'len' '(' identifier ')'
+    std::optional<ast::expression::ExprRef> Parser::parseLength()
+    {
+        consume(TokenType::LEFT_PAREN, "Expect '(' after 'len'.");
+        if (!match(TokenType::IDENTIFIER))
+        {
+            errorAtCurrent("Expect array name.");
+            return std::nullopt;
+        }
+        token::Token name = std::move(previous_);
+        consume(TokenType::RIGHT_PAREN, "Expect ')' after array name.");
+
+        return nodes_->make<ast::expression::Length>(nodes_->make<ast::expression::Variable>(std::move(name)));
+    }
+
     /// @brief parenexpr ::= '(' expression ')'
-    std::optional<ast::expression::ExprPtr> Parser::parseParen()
+    std::optional<ast::expression::ExprRef> Parser::parseParen()
     {
         auto expr = parseExpr();
         if (!expr.has_value())
@@ -428,19 +655,25 @@ namespace parser
         return expr;
     }
 
-    int Parser::getTokenPrecedence(TokenType type)
+    inline int Parser::getTokenPrecedence(TokenType type) const
     {
-        int prec = binopPrec_[type];
-        if (prec <= 0)
-            return -1;
-
-        return prec;
+        return rules_[(size_t)type].Precedence;
     }
     bool Parser::setTokenPrecedence(TokenType type, int prec)
     {
-        binopPrec_[type] = prec;
+        ParseRule &rule_ = rule(type);
+        // Redefining `?` changes its precedence, it stays the conditional.
+        if (!rule_.Infix)
+            rule_.Infix = &Parser::parseBinary;
+        // An operator of precedence 0 never binds.
+        rule_.Precedence = prec > 0 ? prec : -1;
         return true;
     }
+    void Parser::setPrefixOperator(TokenType type)
+    {
+        if (ast::isUnaryOp(type))
+            rule(type).Prefix = &Parser::parseUnary;
+    }
     //< Parse expression
 
     void Parser::advance()
@@ -449,11 +682,14 @@ namespace parser
 
         while (true)
         {
-            current_ = lexer_.nextToken();
+            {
+                timing::SampledPhase phase(timing::Phase::LEX, lexedTokens_);
+                current_ = lexer_.nextToken();
+            }
             if (current_.type != TokenType::ERROR)
                 break;
 
-            errorAtCurrent(current_.lexeme);
+            errorAtCurrent(std::string(current_.lexeme));
         }
     }
     void Parser::consume(token::TokenType type, const std::string &msg)
@@ -1,13 +1,15 @@
 #ifndef HYPERTK_PARSER_HPP
 #define HYPERTK_PARSER_HPP
 
+#include <array>
 #include <optional>
-#include <map>
 #include <vector>
 
+#include "common.hpp"
 #include "token.hpp"
 #include "ast.hpp"
 #include "lexer.hpp"
+#include "symbol.hpp"
 
 namespace parser
 {
@@ -18,37 +20,101 @@ namespace parser
         // explicit Parser(const lexer::Lexer &lexer_);
 
         std::optional<ast::Program> parse();
+        /** @brief Parse into `program`, appending its nodes and top level statements */
+        void parse(ast::Program &program);
+        /** @brief Parse new input with the next `parse`, user defined operator precedences are kept */
+        void reset(lexer::Lexer &&lexer_);
 
     private:
+        /// @brief Parse the expression starting with the `previous_` token
+        using PrefixFn = std::optional<ast::expression::ExprRef> (Parser::*)();
+        /// @brief Parse the rest of an expression whose LHS is followed by the `previous_` operator of precedence `prec`
+        using InfixFn = std::optional<ast::expression::ExprRef> (Parser::*)(ast::expression::ExprRef LHS, int prec);
+        /** @brief How a token parses at the start of an expression and after an operand */
+        struct ParseRule
+        {
+            PrefixFn Prefix = nullptr;
+            InfixFn Infix = nullptr;
+            /** @brief Binding power of the infix operator, `-1` while the token is not one */
+            int Precedence = -1;
+        };
+
         lexer::Lexer lexer_;
+        /** @brief Arena of the program being parsed */
+        ast::Arena *nodes_;
         token::Token previous_;
         token::Token current_;
         bool panicMode_;
-        std::map<token::TokenType, int> binopPrec_;
+        /** @brief Pratt parsing table indexed by token type, `binary` and `unary` definitions update it */
+        std::array<ParseRule, token::TokenTypeCount> rules_;
+        /** @brief An array was declared since the current function body started */
+        bool sawArray_;
+        /** @brief Tokens lexed so far, one in `timing::SampledPhase::Rate` is timed */
+        unsigned lexedTokens_;
+
+#ifdef ENABLE_PARALLEL_FRONTEND
+        /** @brief Functions of a source parsed apart, with the names they interned */
+        struct Part
+        {
+            ast::Program Program;
+            symbol::Table Symbols;
+        };
+
+        /**
+         * @brief Parse the top level functions of a large source on the thread pool.
+         * @return `false` if the source is small, holds anything but functions or has an error,
+         * nothing was parsed then.
+         */
+        bool parseInParallel(ast::Program &program);
+        /**
+         * @brief Parse the functions `first` to `last - 1` of `starts` into `part`, return `false` on error.
+         * @param operatorDefs indexes of the `binary` and `unary` definitions in `starts`, the ones above `first` define their operator first.
+         */
+        bool parsePart(Part &part, const std::vector<lexer::FunctionStart> &starts, const std::vector<size_t> &operatorDefs,
+                       size_t first, size_t last) const;
+        /** @brief Update the parse rules as the operator definition `start` does once parsed */
+        void defineOperator(const lexer::FunctionStart &start);
+#endif
 
         //> Parse statement
-        std::optional<ast::statement::StmtPtr> parseDeclaration();
-        std::optional<ast::statement::StmtPtr> parseStatement();
-        std::optional<ast::statement::VarDeclPtr> parseVariableDeclaration();
-        std::optional<ast::statement::FunctionPtr> parseFunctionDeclaration();
-        std::optional<ast::statement::ExpressionPtr> parseExpressionStmt();
-        std::optional<ast::statement::ReturnPtr> parseReturnStmt();
-        std::optional<ast::statement::IfPtr> parseIfStmt();
-        std::optional<ast::statement::ForPtr> parseForStmt();
-        std::optional<ast::statement::BlockPtr> parseBlockStmt();
-        inline std::vector<ast::statement::StmtPtr> parseBlock();
+        std::optional<ast::statement::StmtRef> parseDeclaration();
+        std::optional<ast::statement::StmtRef> parseStatement();
+        std::optional<ast::statement::VarDeclRef> parseVariableDeclaration();
+        std::optional<ast::statement::StmtRef> parseFunctionDeclaration();
+        std::optional<ast::statement::ExpressionRef> parseExpressionStmt();
+        std::optional<ast::statement::ReturnRef> parseReturnStmt();
+        std::optional<ast::statement::IfRef> parseIfStmt();
+        std::optional<ast::statement::ForRef> parseForStmt(bool parallel = false);
+        std::optional<ast::statement::BlockRef> parseBlockStmt();
+        inline ast::List<ast::statement::StmtRef> parseBlock();
         //<
 
         //> Parse expression
-        std::optional<ast::expression::ExprPtr> parseExpr();
-        std::optional<ast::expression::ExprPtr> parseExpr(int exprPrec);
-        std::optional<ast::expression::ExprPtr> parseUnary();
-        std::optional<ast::expression::ExprPtr> parseBinaryRHS(int exprPrec, ast::expression::ExprPtr LHS);
-        std::optional<ast::expression::ExprPtr> parsePrimary();
-        std::optional<ast::expression::ExprPtr> parseParen();
-        std::optional<ast::expression::ExprPtr> parseIdentifier();
-        int getTokenPrecedence(token::TokenType type);
+        std::optional<ast::expression::ExprRef> parseExpr();
+        /** @brief Parse an expression whose operators outside parentheses bind at least as tightly as `minPrec` */
+        std::optional<ast::expression::ExprRef> parseExpr(int minPrec);
+        /** @brief Parse an operand, the prefix rule of the current token */
+        std::optional<ast::expression::ExprRef> parsePrefix();
+        /** @brief Extend `LHS` with the operators binding at least as tightly as `minPrec` */
+        std::optional<ast::expression::ExprRef> parseInfix(int minPrec, ast::expression::ExprRef LHS);
+        //> prefix rules
+        std::optional<ast::expression::ExprRef> parseNumber();
+        std::optional<ast::expression::ExprRef> parseUnary();
+        std::optional<ast::expression::ExprRef> parseParen();
+        std::optional<ast::expression::ExprRef> parseIdentifier();
+        std::optional<ast::expression::ExprRef> parseLength();
+        //<
+        //> infix rules
+        std::optional<ast::expression::ExprRef> parseBinary(ast::expression::ExprRef LHS, int prec);
+        std::optional<ast::expression::ExprRef> parseConditional(ast::expression::ExprRef LHS, int prec);
+        //<
+        std::optional<ast::expression::ExprRef> parseIndex(token::Token name);
+        inline ParseRule &rule(token::TokenType type) { return rules_[(size_t)type]; }
+        /** @brief Precedence of the infix operator `type`, `-1` if it is not one */
+        inline int getTokenPrecedence(token::TokenType type) const;
         bool setTokenPrecedence(token::TokenType type, int prec);
+        /** @brief Parse `type` as a prefix operator, as a `unary` definition makes it */
+        void setPrefixOperator(token::TokenType type);
         //< Parse expression
 
         void advance();
@@ -0,0 +1,257 @@
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "profile.hpp"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/ProfileSummary.h"
+
+namespace profile
+{
+    namespace detail
+    {
+        bool generating_ = false;
+        bool loaded_ = false;
+    } // namespace detail
+
+    static constexpr const char *Magic = "hypertk-profile";
+    static constexpr unsigned Version = 1;
+
+    /** @brief Counts of one function: calls, then taken and not taken of each conditional branch */
+    struct FunctionCounts
+    {
+        uint64_t Hash = 0;
+        std::vector<uint64_t> *Counts = nullptr;
+    };
+
+    /** @brief Counters of the instrumented code, never freed, code compiled earlier may still run */
+    static std::list<std::vector<uint64_t>> storage_;
+    /** @brief Instrumented functions when generating, profiled ones when a profile was loaded */
+    static std::map<std::string, FunctionCounts> functions_;
+    /** @brief Summary of the loaded profile, attached to every annotated module */
+    static std::unique_ptr<llvm::ProfileSummary> summary_;
+
+    /** @brief Conditional branches of `F` in block order, the order of their counters */
+    static std::vector<llvm::BranchInst *> conditionalBranches(llvm::Function &F)
+    {
+        std::vector<llvm::BranchInst *> branches;
+        for (llvm::BasicBlock &BB : F)
+            if (auto *br = llvm::dyn_cast<llvm::BranchInst>(BB.getTerminator()); br && br->isConditional())
+                branches.push_back(br);
+        return branches;
+    }
+
+    /** @brief FNV-1a of the number of successors of each block, changes with the control flow graph */
+    static uint64_t cfgHash(const llvm::Function &F)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (const llvm::BasicBlock &BB : F)
+        {
+            hash ^= BB.getTerminator() ? BB.getTerminator()->getNumSuccessors() + 1 : 0;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    //> generate
+    void startGenerating()
+    {
+        detail::generating_ = true;
+    }
+
+    /// @details The counter of a branch is picked with a `select` on its condition before the
+    /// branch, so no edge has to be split and the CFG the profile is matched against stays the
+    /// same. Increments are atomic, the bodies of parallel loops run on several threads.
+    void instrument(llvm::Module &M)
+    {
+        llvm::LLVMContext &C = M.getContext();
+        llvm::Type *i64Ty = llvm::Type::getInt64Ty(C);
+
+        for (llvm::Function &F : M)
+        {
+            if (F.isDeclaration())
+                continue;
+
+            std::vector<llvm::BranchInst *> branches = conditionalBranches(F);
+            std::vector<uint64_t> &counts = storage_.emplace_back(1 + 2 * branches.size(), 0);
+            functions_[F.getName().str()] = {cfgHash(F), &counts};
+            llvm::Constant *base = llvm::ConstantExpr::getIntToPtr(llvm::ConstantInt::get(i64Ty, (uint64_t)counts.data()),
+                                                                   llvm::PointerType::getUnqual(C));
+
+            auto increment = [&](llvm::IRBuilder<> &B, llvm::Value *index)
+            {
+                llvm::Value *counter = B.CreateInBoundsGEP(i64Ty, base, index, "prof.counter");
+                B.CreateAtomicRMW(llvm::AtomicRMWInst::Add, counter, llvm::ConstantInt::get(i64Ty, 1),
+                                  llvm::MaybeAlign(8), llvm::AtomicOrdering::Monotonic);
+            };
+
+            // After the allocas, which must stay at the start of the entry block to be promoted.
+            llvm::BasicBlock::iterator entry = F.getEntryBlock().getFirstInsertionPt();
+            while (llvm::isa<llvm::AllocaInst>(*entry))
+                ++entry;
+            llvm::IRBuilder<> B(&F.getEntryBlock(), entry);
+            increment(B, llvm::ConstantInt::get(i64Ty, 0));
+
+            for (size_t i = 0; i < branches.size(); ++i)
+            {
+                B.SetInsertPoint(branches[i]);
+                llvm::Value *index = B.CreateSelect(branches[i]->getCondition(),
+                                                    llvm::ConstantInt::get(i64Ty, 1 + 2 * i),
+                                                    llvm::ConstantInt::get(i64Ty, 2 + 2 * i),
+                                                    "prof.index");
+                increment(B, index);
+            }
+        }
+    }
+
+    bool write(const std::string &path)
+    {
+        std::ofstream file(path, std::ios::out | std::ios::trunc);
+        if (!file)
+            return false;
+
+        file << Magic << " " << Version << "\n";
+        for (const auto &[name, function] : functions_)
+        {
+            file << name << " " << function.Hash << " " << function.Counts->size();
+            for (uint64_t count : *function.Counts)
+                file << " " << count;
+            file << "\n";
+        }
+        return (bool)file.flush();
+    }
+    //<
+
+    //> use
+    /** @brief Detailed summary at the cutoffs of LLVM's own profiles, the hot and cold thresholds are read from it */
+    static std::unique_ptr<llvm::ProfileSummary> summarize()
+    {
+        static constexpr uint32_t Cutoffs[] = {10000, 100000, 200000, 300000, 400000, 500000, 600000, 700000,
+                                               800000, 900000, 950000, 990000, 999000, 999900, 999990, 999999};
+
+        std::vector<uint64_t> counts;
+        uint64_t total = 0, maxCount = 0, maxInternal = 0, maxFunction = 0;
+        for (const auto &[name, function] : functions_)
+        {
+            const std::vector<uint64_t> &c = *function.Counts;
+            maxFunction = std::max(maxFunction, c[0]);
+            for (size_t i = 0; i < c.size(); ++i)
+            {
+                counts.push_back(c[i]);
+                total += c[i];
+                maxCount = std::max(maxCount, c[i]);
+                if (i > 0)
+                    maxInternal = std::max(maxInternal, c[i]);
+            }
+        }
+        std::sort(counts.begin(), counts.end(), std::greater<uint64_t>());
+
+        llvm::SummaryEntryVector detailed;
+        size_t taken = 0;
+        uint64_t sum = 0;
+        for (uint32_t cutoff : Cutoffs)
+        {
+            // Smallest count among the largest ones adding up to `cutoff` millionths of the total.
+            uint64_t needed = (uint64_t)((__uint128_t)total * cutoff / llvm::ProfileSummary::Scale);
+            while (taken < counts.size() && (sum < needed || taken == 0))
+                sum += counts[taken++];
+            detailed.push_back({cutoff, taken ? counts[taken - 1] : 0, (uint64_t)taken});
+        }
+
+        return std::make_unique<llvm::ProfileSummary>(llvm::ProfileSummary::PSK_Instr, detailed, total, maxCount,
+                                                      maxInternal, maxFunction, (uint32_t)counts.size(),
+                                                      (uint32_t)functions_.size());
+    }
+
+    bool load(const std::string &path)
+    {
+        std::ifstream file(path);
+        std::string magic;
+        unsigned version;
+        if (!file || !(file >> magic >> version) || magic != Magic || version != Version)
+            return false;
+
+        std::map<std::string, FunctionCounts> functions;
+        std::string name;
+        while (file >> name)
+        {
+            FunctionCounts function;
+            size_t size;
+            if (!(file >> function.Hash >> size) || size == 0 || size % 2 == 0)
+                return false;
+            function.Counts = &storage_.emplace_back(size);
+            for (uint64_t &count : *function.Counts)
+                if (!(file >> count))
+                    return false;
+            functions[name] = function;
+        }
+        if (!file.eof())
+            return false;
+
+        functions_ = std::move(functions);
+        summary_ = summarize();
+        detail::loaded_ = true;
+        return true;
+    }
+
+    /** @brief Branch weights are 32-bit, scale both counts down by the same factor to fit */
+    static llvm::MDNode *branchWeights(llvm::LLVMContext &C, uint64_t taken, uint64_t notTaken)
+    {
+        uint64_t scale = std::max(taken, notTaken) / UINT32_MAX + 1;
+        return llvm::MDBuilder(C).createBranchWeights((uint32_t)(taken / scale), (uint32_t)(notTaken / scale));
+    }
+
+    void annotate(llvm::Module &M)
+    {
+        bool any = false;
+        for (llvm::Function &F : M)
+        {
+            if (F.isDeclaration())
+                continue;
+            auto function = functions_.find(F.getName().str());
+            if (function == functions_.end())
+                continue;
+
+            std::vector<llvm::BranchInst *> branches = conditionalBranches(F);
+            const std::vector<uint64_t> &counts = *function->second.Counts;
+            // Changed since the profile was taken, its counts would land on the wrong branches.
+            if (function->second.Hash != cfgHash(F) || counts.size() != 1 + 2 * branches.size())
+                continue;
+
+            F.setEntryCount(counts[0]);
+            for (size_t i = 0; i < branches.size(); ++i)
+                // A branch never reached has no weights, the frequency of its block already says it is cold.
+                if (counts[1 + 2 * i] + counts[2 + 2 * i] > 0)
+                    branches[i]->setMetadata(llvm::LLVMContext::MD_prof,
+                                             branchWeights(M.getContext(), counts[1 + 2 * i], counts[2 + 2 * i]));
+            any = true;
+        }
+
+        if (any)
+            M.setProfileSummary(summary_->getMD(M.getContext()), llvm::ProfileSummary::PSK_Instr);
+    }
+
+    uint64_t count(const std::string &name)
+    {
+        auto function = functions_.find(name);
+        if (function == functions_.end())
+            return 0;
+
+        uint64_t sum = 0;
+        for (uint64_t count : *function->second.Counts)
+            sum += count;
+        return sum;
+    }
+    //<
+} // namespace profile
@@ -0,0 +1,50 @@
+#ifndef HYPERTK_PROFILE_HPP
+#define HYPERTK_PROFILE_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "llvm/IR/Module.h"
+
+/**
+ * @brief Profile-guided optimization of the generated code, in two runs.
+ * @details The first run (`startGenerating`) instruments every function before it is optimized:
+ * a counter of its calls and two counters per conditional branch, one per direction. Once the
+ * program finished, `write` saves the counts to a file. A later run `load`s the file, and
+ * `annotate` attaches the counts to the functions before they are optimized: function entry
+ * counts, branch weights and a profile summary, from which the inliner, the block layout and the
+ * loop passes tell hot code from cold. A function is matched by its name and a hash of its
+ * control flow graph, a function changed since the profile was taken is optimized without it.
+ */
+namespace profile
+{
+    namespace detail
+    {
+        extern bool generating_;
+        extern bool loaded_;
+    } // namespace detail
+
+    /**
+     * @brief Instrument the functions of every module from now on.
+     * @note The counters live in this process and are referenced by address, instrumented code
+     * can't be cached or written to an object file.
+     */
+    void startGenerating();
+    inline bool generating() { return detail::generating_; }
+
+    /** @brief Add the counters to every function defined in `M`, which is not optimized yet */
+    void instrument(llvm::Module &M);
+    /** @brief Write the counts of every instrumented function to `path`, return `false` on error */
+    bool write(const std::string &path);
+
+    /** @brief Read a profile written by `write`, return `false` if it can't be read or is malformed */
+    bool load(const std::string &path);
+    inline bool loaded() { return detail::loaded_; }
+
+    /** @brief Attach the loaded counts to the functions defined in `M` which match the profile */
+    void annotate(llvm::Module &M);
+    /** @brief Calls plus branches taken of the function `name` in the loaded profile, `0` when not profiled */
+    uint64_t count(const std::string &name);
+} // namespace profile
+
+#endif
@@ -0,0 +1,134 @@
+#include <iostream>
+#include <optional>
+#include <string>
+
+#include "repl.hpp"
+#include "common.hpp"
+#include "ast.hpp"
+#include "error.hpp"
+#include "lexer.hpp"
+#ifndef DISABLE_SEMATIC_ANALYZING
+#include "semantic_analyzer.hpp"
+#endif
+#include "timing.hpp"
+#include "token.hpp"
+
+#ifdef ENABLE_BASIC_JIT_COMPILER
+namespace hypertk
+{
+    using token::TokenType;
+
+    Repl::Repl(RuntimeLLVM &runtime)
+        : runtime_{runtime}, parser_{lexer::Lexer{""}}
+    {
+    }
+
+    bool Repl::run(std::istream &in, bool interactive)
+    {
+        bool ok = true;
+        std::string entry;
+        std::string line;
+
+        if (interactive)
+            std::cerr << "ready> ";
+        while (std::getline(in, line))
+        {
+            entry += line;
+            entry += '\n';
+
+            if (!isComplete(entry))
+            {
+                if (entry.find_first_not_of(" \t\r\n") == std::string::npos)
+                    entry.clear();
+                if (interactive)
+                    std::cerr << (entry.empty() ? "ready> " : "  ...> ");
+                continue;
+            }
+
+            ok = evalEntry(entry) && ok;
+            entry.clear();
+            if (interactive)
+                std::cerr << "ready> ";
+        }
+
+        // Let the parser report whatever is left over.
+        if (entry.find_first_not_of(" \t\r\n") != std::string::npos)
+            ok = evalEntry(entry) && ok;
+
+        return ok;
+    }
+
+    bool Repl::evalEntry(const std::string &entry)
+    {
+        error::reset();
+        parser_.reset(lexer::Lexer{entry});
+
+        std::optional<ast::Program> program;
+        {
+            timing::ScopedPhase phase(timing::Phase::PARSE);
+            program = parser_.parse();
+        }
+        if (error::hasError() || !program.has_value())
+            return false;
+#ifndef DISABLE_SEMATIC_ANALYZING
+        {
+            timing::ScopedPhase phase(timing::Phase::ANALYZE);
+            semantic_analysis::BasicSemanticAnalyzer analyzer(program.value());
+            if (!analyzer.analyze())
+                return false;
+        }
+#endif
+
+        const ast::Arena &nodes = program->Nodes;
+        for (const auto &stmt : program->Statements)
+        {
+            if (const auto *def = ast::statement::functionOf(nodes, stmt))
+            {
+                if (!runtime_.compileFunctions(nodes, {def}))
+                    return false;
+                continue;
+            }
+
+            auto value = runtime_.evalTopLevel(nodes, stmt);
+            if (!value.has_value())
+                return false;
+            if (nodes.is<ast::statement::Expression>(stmt))
+                std::cout << "Eval " << value.value() << "\n";
+        }
+
+        return true;
+    }
+
+    bool Repl::isComplete(const std::string &entry)
+    {
+        lexer::Lexer lexer{entry};
+        int depth = 0;
+        TokenType last = TokenType::END_OF_FILE;
+
+        for (auto t = lexer.nextToken(); t.type != TokenType::END_OF_FILE; t = lexer.nextToken())
+        {
+            switch (t.type)
+            {
+            case TokenType::LEFT_PAREN:
+            case TokenType::LEFT_BRACE:
+            case TokenType::LEFT_BRACKET:
+                depth++;
+                break;
+            case TokenType::RIGHT_PAREN:
+            case TokenType::RIGHT_BRACE:
+            case TokenType::RIGHT_BRACKET:
+                depth--;
+                break;
+            case TokenType::ERROR:
+                // Let the parser report it.
+                return true;
+            default:
+                break;
+            }
+            last = t.type;
+        }
+
+        return depth <= 0 && (last == TokenType::SEMICOLON || last == TokenType::RIGHT_BRACE);
+    }
+} // namespace hypertk
+#endif
@@ -0,0 +1,44 @@
+#ifndef HYPERTK_REPL_HPP
+#define HYPERTK_REPL_HPP
+
+#include <istream>
+#include <string>
+
+#include "common.hpp"
+#include "parser.hpp"
+#include "runtime_llvm.hpp"
+
+namespace hypertk
+{
+    /**
+     * @brief Read-eval-print loop on top of the JIT.
+     * @details Input is read line by line and split into entries, an entry ends with a `;` or
+     * `}` outside of any bracket. Every function definition of an entry is compiled into its
+     * own module and kept for the rest of the session, every other top-level statement runs in
+     * an anonymous function that is freed right after it ran.
+     */
+    class Repl : private Uncopyable
+    {
+    public:
+        /** @param runtime must have its JIT and module initialized */
+        explicit Repl(RuntimeLLVM &runtime);
+
+        /**
+         * @brief Evaluate entries until the end of `in`.
+         * @param interactive print prompts to stderr.
+         * @return `false` if an entry failed.
+         */
+        bool run(std::istream &in, bool interactive);
+
+    private:
+        RuntimeLLVM &runtime_;
+        /** @brief Shared by all entries so user defined operators stay known */
+        parser::Parser parser_;
+
+        bool evalEntry(const std::string &entry);
+        /** @brief `true` if `entry` ends with a complete statement */
+        static bool isComplete(const std::string &entry);
+    };
+} // namespace hypertk
+
+#endif
@@ -1,13 +1,17 @@
+#include <algorithm>
 #include <memory>
 #include <map>
 #include <string>
 #include <iostream>
-#include <variant>
 
 #include "runtime_llvm.hpp"
 #include "common.hpp"
 #include "ast.hpp"
 #include "error.hpp"
+#include "target.hpp"
+#include "timing.hpp"
+#include "output.hpp"
+#include "profile.hpp"
 #ifdef ENABLE_BASIC_JIT_COMPILER
 #include "jit.hpp"
 #endif
@@ -16,11 +20,15 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/CodeGen.h"
 #ifdef ENABLE_BASIC_JIT_COMPILER
 #include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
 #else
@@ -36,20 +44,35 @@
 #include "llvm/IR/PassInstrumentation.h"
 #include "llvm/Passes/StandardInstrumentations.h"
 #include "llvm/Passes/PassBuilder.h"
+#include "llvm/Transforms/Scalar/TailRecursionElimination.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/IPO/GlobalDCE.h"
 #include "llvm/Analysis/LoopAnalysisManager.h"
 #include "llvm/Analysis/CGSCCPassManager.h"
-#include "llvm/Transforms/InstCombine/InstCombine.h"
-#include "llvm/Transforms/Scalar/Reassociate.h"
-#include "llvm/Transforms/Scalar/GVN.h"
-#include "llvm/Transforms/Scalar/SimplifyCFG.h"
-#include "llvm/Transforms/Utils/Mem2Reg.h"
+#include "llvm/Target/TargetMachine.h"
 #endif
 
 namespace hypertk
 {
-    RuntimeLLVM::RuntimeLLVM()
+    static llvm::CodeGenOptLevel toCodeGenOptLevel(unsigned optLevel)
+    {
+        switch (optLevel)
+        {
+        case 0:
+            return llvm::CodeGenOptLevel::None;
+        case 1:
+            return llvm::CodeGenOptLevel::Less;
+        case 2:
+            return llvm::CodeGenOptLevel::Default;
+        default:
+            return llvm::CodeGenOptLevel::Aggressive;
+        }
+    }
+
+    RuntimeLLVM::RuntimeLLVM(unsigned optLevel)
         : ast::statement::Visitor<llvm::Value *>(),
-          ast::expression::Visitor<llvm::Value *>()
+          ast::expression::Visitor<llvm::Value *>(),
+          OptLevel_{optLevel}
 #ifndef ENABLE_BASIC_JIT_COMPILER
           ,
           TargetTriple_{llvm::sys::getDefaultTargetTriple()}
@@ -64,14 +87,38 @@ namespace hypertk
 
     llvm::Value *RuntimeLLVM::genIR(const ast::Program &program)
     {
+        timing::ScopedPhase phase(timing::Phase::CODEGEN);
+
+        nodes_ = &program.Nodes;
         beginScope();
-        for (const auto &stmt : program)
+        for (const auto &stmt : program.Statements)
             visit(stmt);
         endScope();
 
+        if (WholeProgram_)
+            internalizeModule();
+
         return nullptr;
     }
 
+    void RuntimeLLVM::setWholeProgram(const std::vector<std::string> &exported)
+    {
+        WholeProgram_ = true;
+        Exported_ = exported;
+    }
+
+    void RuntimeLLVM::internalizeModule()
+    {
+        for (llvm::Function &F : *TheModule_)
+        {
+            if (F.isDeclaration() || F.getName() == "main" ||
+                std::find(Exported_.begin(), Exported_.end(), F.getName()) != Exported_.end())
+                continue;
+            // Nothing outside the module can call it, the optimizer may inline, specialize or drop it.
+            F.setLinkage(llvm::GlobalValue::InternalLinkage);
+        }
+    }
+
     void RuntimeLLVM::initializeModuleAndManagers()
     {
         // Open new context and module
@@ -84,37 +131,104 @@ namespace hypertk
         TheModule_->setTargetTriple(TargetTriple_);
 #endif
 
+        // Record the CPU the code is generated for, it ends up in the `.comment` section of
+        // cached and emitted objects.
+        llvm::TargetMachine *TM = getTargetMachine();
+        TheModule_->getOrInsertNamedMetadata("llvm.ident")
+            ->addOperand(llvm::MDNode::get(*TheContext_,
+                                           llvm::MDString::get(*TheContext_,
+                                                               "hypertk target-cpu=" + TM->getTargetCPU().str() +
+                                                                   " target-features=" + TM->getTargetFeatureString().str())));
+
         // Create a new builder for the module
         Builder_ = std::make_unique<llvm::IRBuilder<>>(*TheContext_);
 
 #ifdef ENABLE_COMPILER_OPTIMIZATION_PASS
         // Create new pass and analysis manager
-        TheFPM_ = std::make_unique<llvm::FunctionPassManager>();
         TheLAM_ = std::make_unique<llvm::LoopAnalysisManager>();
         TheFAM_ = std::make_unique<llvm::FunctionAnalysisManager>();
         TheCGAM_ = std::make_unique<llvm::CGSCCAnalysisManager>();
         TheMAM_ = std::make_unique<llvm::ModuleAnalysisManager>();
         ThePIC_ = std::make_unique<llvm::PassInstrumentationCallbacks>();
-        TheSI_ = std::make_unique<llvm::StandardInstrumentations>(*TheContext_, /* Debug logging*/ true);
+        TheSI_ = std::make_unique<llvm::StandardInstrumentations>(*TheContext_, /* Debug logging*/ false);
         TheSI_->registerCallbacks(*ThePIC_, TheMAM_.get());
-
-        // Add transformation passes
-        // Promote allocas to registers.
-        TheFPM_->addPass(llvm::PromotePass());
-        // Do simple "peephole" optimizations and bit-twiddling optzns.
-        TheFPM_->addPass(llvm::InstCombinePass());
-        // Reassociate expressions.
-        TheFPM_->addPass(llvm::ReassociatePass());
-        // Eliminate Common SubExpressions.
-        TheFPM_->addPass(llvm::GVNPass());
-        // Simplify the control flow graph (deleting unreachable blocks, etc).
-        TheFPM_->addPass(llvm::SimplifyCFGPass());
-
-        // Register analysis passes used in these transform passes.
-        llvm::PassBuilder pBuilder;
+        if (timing::enabled())
+            timing::registerPassCallbacks(*ThePIC_);
+
+        // Every pipeline from -O1 rotates loops, unrolling and vectorizing is only worth its compile time from -O2 on.
+        llvm::PipelineTuningOptions PTO;
+        PTO.LoopUnrolling = OptLevel_ >= 2;
+        PTO.LoopInterleaving = OptLevel_ >= 2;
+        PTO.LoopVectorization = OptLevel_ >= 2;
+        PTO.SLPVectorization = OptLevel_ >= 2;
+
+        // Register analysis passes used in the transform passes.
+        // Target machine gives the cost models (vectorizer, unroller, inliner) the real target.
+        llvm::PassBuilder pBuilder(TM, PTO, std::nullopt, ThePIC_.get());
         pBuilder.registerModuleAnalyses(*TheMAM_);
+        pBuilder.registerCGSCCAnalyses(*TheCGAM_);
         pBuilder.registerFunctionAnalyses(*TheFAM_);
+        pBuilder.registerLoopAnalyses(*TheLAM_);
         pBuilder.crossRegisterProxies(*TheLAM_, *TheFAM_, *TheCGAM_, *TheMAM_);
+
+        // `-O0` skips optimization entirely for fast iteration.
+        TheMPM_ = nullptr;
+        switch (OptLevel_)
+        {
+        case 0:
+            // The default pipelines inline and drop dead internal functions by themselves, -O0 needs
+            // both passes explicitly to honor whole-program mode.
+            if (WholeProgram_)
+            {
+                TheMPM_ = std::make_unique<llvm::ModulePassManager>();
+                TheMPM_->addPass(llvm::AlwaysInlinerPass(/* InsertLifetimeIntrinsics */ false));
+                TheMPM_->addPass(llvm::GlobalDCEPass());
+            }
+            break;
+        case 1:
+            // Only the -O2 and -O3 pipelines eliminate tail calls by themselves.
+            pBuilder.registerScalarOptimizerLateEPCallback(
+                [](llvm::FunctionPassManager &FPM, llvm::OptimizationLevel)
+                {
+                    FPM.addPass(llvm::TailCallElimPass());
+                });
+            TheMPM_ = std::make_unique<llvm::ModulePassManager>(pBuilder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O1));
+            break;
+        case 2:
+            TheMPM_ = std::make_unique<llvm::ModulePassManager>(pBuilder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O2));
+            break;
+        default:
+            TheMPM_ = std::make_unique<llvm::ModulePassManager>(pBuilder.buildPerModuleDefaultPipeline(llvm::OptimizationLevel::O3));
+            break;
+        }
+#endif
+    }
+
+    void RuntimeLLVM::optimizeModule()
+    {
+        // The profile is taken and matched on the IR as generated, before any pass changed it.
+        if (profile::generating())
+            profile::instrument(*TheModule_);
+        else if (profile::loaded())
+            profile::annotate(*TheModule_);
+
+#ifdef ENABLE_COMPILER_OPTIMIZATION_PASS
+        if (!TheMPM_)
+            return;
+
+        timing::ScopedPhase phase(timing::Phase::OPTIMIZE);
+        if (timing::enabled())
+            timing::beforeOptimize(*TheModule_);
+        TheMPM_->run(*TheModule_, *TheMAM_);
+        if (timing::enabled())
+            timing::afterOptimize(*TheModule_);
+
+        // The module goes to the JIT next, which frees it once compiled. Cached analysis results
+        // point into its IR, drop them now instead of when the next module replaces the managers.
+        TheLAM_->clear();
+        TheFAM_->clear();
+        TheCGAM_->clear();
+        TheMAM_->clear();
 #endif
     }
 
@@ -136,30 +250,366 @@ namespace hypertk
         // anonymous expression -- that way we can free it after executing.
         auto RT = TheJIT_->getMainJITDylib().createResourceTracker();
 
-        auto TSM = llvm::orc::ThreadSafeModule(std::move(TheModule_), std::move(TheContext_));
-        ExitOnErr(TheJIT_->addModule(std::move(TSM), RT));
-        // initializeModuleAndManagers();
+        optimizeModule();
 
         // Search the JIT for the `main` symbol.
         // HyperTk expect a `main` function.
-        auto mainSymbol = ExitOnErr(TheJIT_->lookup("main"));
+        llvm::orc::ExecutorSymbolDef mainSymbol;
+        {
+            timing::ScopedPhase phase(timing::Phase::JIT_LINK);
+            auto TSM = llvm::orc::ThreadSafeModule(std::move(TheModule_), std::move(TheContext_));
+            ExitOnErr(TheJIT_->addModule(std::move(TSM), RT));
+            // initializeModuleAndManagers();
+
+            mainSymbol = ExitOnErr(TheJIT_->lookup("main"));
+        }
 
         /// @details Because the LLVM JIT compiler matches the native platform ABI,
         /// this means that you can just cast the result pointer to a function pointer
         /// of that type and call it directly.
         double (*FP)() = mainSymbol.getAddress().toPtr<double (*)()>();
-        std::cout << "Eval " << FP() << "\n";
+        double result;
+        {
+            timing::ScopedPhase phase(timing::Phase::EXECUTE);
+            result = FP();
+            output::flush();
+        }
+        // A lazily compiled function failed to materialize, its error is already reported.
+        if (error::hasError())
+            return false;
+        std::cout << "Eval " << result << "\n";
 
         return true;
     }
 
-    void RuntimeLLVM::initializeJIT()
+    void RuntimeLLVM::initializeJIT(const JITOptions &opts)
     {
         llvm::InitializeNativeTarget();
         llvm::InitializeNativeTargetAsmPrinter();
         llvm::InitializeNativeTargetAsmParser();
 
-        TheJIT_ = ExitOnErr(HyperTkJIT::Create());
+        JITOptions jitOpts = opts;
+        jitOpts.CodeGenOpt = toCodeGenOptLevel(OptLevel_);
+        TheJIT_ = ExitOnErr(HyperTkJIT::Create(jitOpts));
+    }
+
+    bool RuntimeLLVM::compileFunctions(const ast::Arena &nodes,
+                                       const std::vector<const ast::statement::Function *> &defs,
+                                       llvm::orc::ResourceTrackerSP RT,
+                                       bool batchEntries,
+                                       const std::vector<HostFunction> &hostFunctions)
+    {
+        nodes_ = &nodes;
+
+        // Declare all definitions first so they can call each other regardless of source order.
+        for (const auto *def : defs)
+            declareFunction(std::string(def->Name.lexeme), def->Params.Size);
+
+        bool ok = true;
+        {
+            timing::ScopedPhase phase(timing::Phase::CODEGEN);
+            for (const auto &host : hostFunctions)
+                emitHostFunction(host);
+
+            beginScope();
+            for (const auto *def : defs)
+                if (!visitFunctionStmt(*def))
+                {
+                    ok = false;
+                    break;
+                }
+            endScope();
+
+            // Emitted next to the functions so the optimizer can inline them into the loop.
+            if (ok && batchEntries)
+                for (const auto *def : defs)
+                    emitBatchEntry(TheModule_->getFunction(def->Name.lexeme));
+        }
+
+        if (ok)
+        {
+            for (const auto *def : defs)
+                FunctionProtos_[std::string(def->Name.lexeme)] = def->Params.Size;
+
+            optimizeModule();
+            timing::ScopedPhase phase(timing::Phase::JIT_LINK);
+            auto TSM = llvm::orc::ThreadSafeModule(std::move(TheModule_), std::move(TheContext_));
+            ExitOnErr(TheJIT_->addModule(std::move(TSM), std::move(RT)));
+        }
+
+        // Start a fresh module for the next batch of functions. A failed module is simply dropped.
+        startNextModule();
+
+        return ok;
+    }
+
+    /// @details The interpreter's variables and the loop variable come in as doubles, each is stored
+    /// into an alloca of its own type before the loop is emitted in their scope. `visitForStmt`
+    /// starts the loop at `ResumedStart_`, the iteration the interpreter stopped at, with its step
+    /// and bound hoisted again from the current values.
+    void *RuntimeLLVM::compileLoop(const ast::Arena &nodes,
+                                   const ast::statement::For &loop,
+                                   const std::string &name,
+                                   const std::vector<LoopVariable> &variables,
+                                   const std::vector<HostFunction> &hostFunctions)
+    {
+        nodes_ = &nodes;
+        llvm::Type *doubleTy = llvm::Type::getDoubleTy(*TheContext_);
+
+        bool ok;
+        {
+            timing::ScopedPhase phase(timing::Phase::CODEGEN);
+            for (const auto &host : hostFunctions)
+                emitHostFunction(host);
+
+            llvm::FunctionType *FT = llvm::FunctionType::get(doubleTy, {llvm::PointerType::getUnqual(*TheContext_)}, false);
+            llvm::Function *theFunction = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, name, TheModule_.get());
+            addTargetAttributes(theFunction);
+            llvm::Argument *vars = theFunction->getArg(0);
+            vars->setName("vars");
+
+            Arrays_.clear();
+            HeapArrays_.clear();
+            Builder_->SetInsertPoint(llvm::BasicBlock::Create(*TheContext_, "entry", theFunction));
+
+            beginScope();
+            std::vector<llvm::AllocaInst *> allocas;
+            for (size_t i = 0; i < variables.size(); ++i)
+            {
+                llvm::AllocaInst *alloca_ = createEntryBlockAlloca(theFunction, symbol::name(variables[i].Name), variables[i].Ty);
+                llvm::Value *value = Builder_->CreateLoad(doubleTy, Builder_->CreateConstGEP1_64(doubleTy, vars, i));
+                Builder_->CreateStore(convert(value, variables[i].Ty), alloca_);
+                currentScope()[variables[i].Name] = alloca_;
+                allocas.push_back(alloca_);
+            }
+
+            ResumedLoop_ = &loop;
+            ResumedStart_ = Builder_->CreateLoad(doubleTy, Builder_->CreateConstGEP1_64(doubleTy, vars, variables.size()), loop.VarName.lexeme);
+            ok = visitForStmt(loop) != nullptr;
+            ResumedLoop_ = nullptr;
+            ResumedStart_ = nullptr;
+
+            if (ok)
+            {
+                // The loop ran to its end, hand the variables back to the interpreter.
+                for (size_t i = 0; i < allocas.size(); ++i)
+                {
+                    llvm::Value *value = Builder_->CreateLoad(allocas[i]->getAllocatedType(), allocas[i]);
+                    Builder_->CreateStore(convert(value, ast::Type::DOUBLE), Builder_->CreateConstGEP1_64(doubleTy, vars, i));
+                }
+                Builder_->CreateStore(llvm::ConstantFP::get(doubleTy, 1.0),
+                                      Builder_->CreateConstGEP1_64(doubleTy, vars, variables.size() + 1));
+                Builder_->CreateRet(llvm::ConstantFP::get(doubleTy, 0.0));
+            }
+            endScope();
+
+            ok = ok && !error::hasError() && !llvm::verifyFunction(*theFunction, &llvm::errs());
+        }
+        if (!ok)
+        {
+            startNextModule();
+            return nullptr;
+        }
+
+        optimizeModule();
+        {
+            timing::ScopedPhase phase(timing::Phase::JIT_LINK);
+            auto TSM = llvm::orc::ThreadSafeModule(std::move(TheModule_), std::move(TheContext_));
+            ExitOnErr(TheJIT_->addModule(std::move(TSM)));
+        }
+        startNextModule();
+
+        return lookupFunction(name);
+    }
+
+    llvm::orc::ResourceTrackerSP RuntimeLLVM::createResourceTracker()
+    {
+        return TheJIT_->getMainJITDylib().createResourceTracker();
+    }
+
+    bool RuntimeLLVM::removeFunctions(const llvm::orc::ResourceTrackerSP &RT, const std::vector<std::string> &names)
+    {
+        if (auto err = RT->remove())
+        {
+            logError(llvm::toString(std::move(err)));
+            return false;
+        }
+
+        for (const auto &name : names)
+            FunctionProtos_.erase(name);
+        return true;
+    }
+
+    std::optional<unsigned> RuntimeLLVM::getFunctionArity(const std::string &name) const
+    {
+        auto proto = FunctionProtos_.find(name);
+        if (proto == FunctionProtos_.end())
+            return std::nullopt;
+        return proto->second;
+    }
+
+    void RuntimeLLVM::emitBatchEntry(llvm::Function *fn)
+    {
+        llvm::Type *doubleTy = llvm::Type::getDoubleTy(*TheContext_);
+        llvm::Type *ptrTy = llvm::PointerType::getUnqual(*TheContext_);
+        llvm::Type *i64Ty = llvm::Type::getInt64Ty(*TheContext_);
+
+        llvm::FunctionType *FT = llvm::FunctionType::get(llvm::Type::getVoidTy(*TheContext_), {ptrTy, ptrTy, i64Ty}, false);
+        llvm::Function *batch = llvm::Function::Create(FT,
+                                                       llvm::Function::ExternalLinkage,
+                                                       fn->getName() + BatchSuffix,
+                                                       TheModule_.get());
+        llvm::Argument *args = batch->getArg(0);
+        llvm::Argument *out = batch->getArg(1);
+        llvm::Argument *n = batch->getArg(2);
+        // The output never overlaps the inputs, which lets the loop vectorizer work without runtime checks.
+        out->addAttr(llvm::Attribute::NoAlias);
+
+        llvm::BasicBlock *entryBB = llvm::BasicBlock::Create(*TheContext_, "entry", batch);
+        llvm::BasicBlock *loopBB = llvm::BasicBlock::Create(*TheContext_, "loop", batch);
+        llvm::BasicBlock *exitBB = llvm::BasicBlock::Create(*TheContext_, "exit", batch);
+
+        // Load the column of every parameter once, outside of the loop.
+        Builder_->SetInsertPoint(entryBB);
+        std::vector<llvm::Value *> columns;
+        for (unsigned i = 0; i < fn->arg_size(); ++i)
+            columns.push_back(Builder_->CreateLoad(ptrTy, Builder_->CreateConstGEP1_64(ptrTy, args, i), "column"));
+        Builder_->CreateCondBr(Builder_->CreateICmpSGT(n, llvm::ConstantInt::get(i64Ty, 0)), loopBB, exitBB);
+
+        Builder_->SetInsertPoint(loopBB);
+        llvm::PHINode *idx = Builder_->CreatePHI(i64Ty, 2, "i");
+        idx->addIncoming(llvm::ConstantInt::get(i64Ty, 0), entryBB);
+
+        std::vector<llvm::Value *> argsV;
+        for (llvm::Value *column : columns)
+            argsV.push_back(Builder_->CreateLoad(doubleTy, Builder_->CreateGEP(doubleTy, column, idx)));
+        llvm::Value *result = Builder_->CreateCall(fn, argsV, "calltmp");
+        Builder_->CreateStore(result, Builder_->CreateGEP(doubleTy, out, idx));
+
+        llvm::Value *next = Builder_->CreateAdd(idx, llvm::ConstantInt::get(i64Ty, 1), "next", /* HasNUW */ true, /* HasNSW */ true);
+        idx->addIncoming(next, loopBB);
+        Builder_->CreateCondBr(Builder_->CreateICmpSLT(next, n), loopBB, exitBB);
+
+        Builder_->SetInsertPoint(exitBB);
+        Builder_->CreateRetVoid();
+    }
+
+    /// @details The native code is loaded from `*Native` on every call, a function compiled after
+    /// this module still gets called directly, only through a load and an indirect call.
+    void RuntimeLLVM::emitHostFunction(const HostFunction &host)
+    {
+        llvm::Type *doubleTy = llvm::Type::getDoubleTy(*TheContext_);
+        llvm::Type *ptrTy = llvm::PointerType::getUnqual(*TheContext_);
+        llvm::Type *i64Ty = llvm::Type::getInt64Ty(*TheContext_);
+        auto address = [&](const void *ptr)
+        {
+            return llvm::ConstantExpr::getIntToPtr(llvm::ConstantInt::get(i64Ty, (uint64_t)ptr), ptrTy);
+        };
+
+        std::vector<llvm::Type *> Doubles(host.Arity, doubleTy);
+        llvm::FunctionType *FT = llvm::FunctionType::get(doubleTy, Doubles, false);
+        llvm::Function *fn = llvm::Function::Create(FT, llvm::Function::InternalLinkage, host.Name, TheModule_.get());
+        std::vector<llvm::Value *> args;
+        for (auto &arg : fn->args())
+            args.push_back(&arg);
+
+        llvm::BasicBlock *entryBB = llvm::BasicBlock::Create(*TheContext_, "entry", fn);
+        llvm::BasicBlock *nativeBB = llvm::BasicBlock::Create(*TheContext_, "native", fn);
+        llvm::BasicBlock *hostBB = llvm::BasicBlock::Create(*TheContext_, "host", fn);
+
+        Builder_->SetInsertPoint(entryBB);
+        llvm::Value *native = Builder_->CreateLoad(ptrTy, address(host.Native), "native");
+        Builder_->CreateCondBr(Builder_->CreateIsNotNull(native), nativeBB, hostBB);
+
+        Builder_->SetInsertPoint(nativeBB);
+        llvm::CallInst *result = Builder_->CreateCall(FT, native, args, "calltmp");
+        result->setTailCallKind(llvm::CallInst::TCK_MustTail);
+        Builder_->CreateRet(result);
+
+        Builder_->SetInsertPoint(hostBB);
+        llvm::AllocaInst *argv = Builder_->CreateAlloca(llvm::ArrayType::get(doubleTy, host.Arity), nullptr, "args");
+        for (unsigned i = 0; i < host.Arity; ++i)
+            Builder_->CreateStore(args[i], Builder_->CreateConstGEP2_64(argv->getAllocatedType(), argv, 0, i));
+        llvm::FunctionType *callFT = llvm::FunctionType::get(doubleTy, {ptrTy, ptrTy, ptrTy}, false);
+        Builder_->CreateRet(Builder_->CreateCall(callFT,
+                                                 address(reinterpret_cast<const void *>(host.Call)),
+                                                 {address(host.Host), address(host.Function), argv},
+                                                 "hosttmp"));
+    }
+
+    std::optional<double> RuntimeLLVM::evalTopLevel(const ast::Arena &nodes, ast::statement::StmtRef stmt)
+    {
+        nodes_ = &nodes;
+
+        // Always the same name, the previous anonymous function is gone by the time the next one is added.
+        static const std::string AnonName = "__anon_expr";
+
+        bool ok;
+        {
+            timing::ScopedPhase phase(timing::Phase::CODEGEN);
+
+            llvm::Function *anon = declareFunction(AnonName, 0);
+            Builder_->SetInsertPoint(llvm::BasicBlock::Create(*TheContext_, "entry", anon));
+            Arrays_.clear();
+            HeapArrays_.clear();
+
+            beginScope();
+            llvm::Value *value = visit(stmt);
+            bool isExpr = nodes.is<ast::statement::Expression>(stmt);
+            freeHeapArrays(0, true);
+            if (!Builder_->GetInsertBlock()->getTerminator())
+                Builder_->CreateRet(isExpr && value ? convert(value, ast::Type::DOUBLE) : llvm::ConstantFP::get(*TheContext_, llvm::APFloat(0.0)));
+            endScope();
+
+            ok = (!isExpr || value) && !error::hasError() && !llvm::verifyFunction(*anon, &llvm::errs());
+        }
+        if (!ok)
+        {
+            startNextModule();
+            return std::nullopt;
+        }
+
+        optimizeModule();
+
+        auto RT = TheJIT_->getMainJITDylib().createResourceTracker();
+        double (*FP)();
+        {
+            timing::ScopedPhase phase(timing::Phase::JIT_LINK);
+            auto TSM = llvm::orc::ThreadSafeModule(std::move(TheModule_), std::move(TheContext_));
+            ExitOnErr(TheJIT_->addModule(std::move(TSM), RT));
+            FP = ExitOnErr(TheJIT_->lookup(AnonName)).getAddress().toPtr<double (*)()>();
+        }
+        startNextModule();
+
+        double result;
+        {
+            timing::ScopedPhase phase(timing::Phase::EXECUTE);
+            result = FP();
+            output::flush();
+        }
+
+        // Only definitions outlive their entry, free the code and memory of the anonymous function.
+        ExitOnErr(RT->remove());
+        return result;
+    }
+
+    void *RuntimeLLVM::lookupFunction(const std::string &name)
+    {
+        // Non-lazy modules are compiled and linked on their first lookup.
+        timing::ScopedPhase phase(timing::Phase::JIT_LINK);
+        auto symbol = TheJIT_->lookup(name);
+        if (!symbol)
+        {
+            llvm::consumeError(symbol.takeError());
+            return nullptr;
+        }
+
+        return symbol->getAddress().toPtr<void *>();
+    }
+
+    const ObjectCache *RuntimeLLVM::getObjectCache() const
+    {
+        return TheJIT_ ? TheJIT_->getObjectCache() : nullptr;
     }
 
 #else
@@ -181,12 +631,14 @@ namespace hypertk
             return false;
         }
 
+        optimizeModule();
+        timing::ScopedPhase phase(timing::Phase::EMIT);
         pass.run(*TheModule_);
         dest.flush();
         return true;
     }
 
-    bool RuntimeLLVM::initializeAOT()
+    bool RuntimeLLVM::initializeAOT(const std::string &cpu, const std::string &features)
     {
         llvm::InitializeAllTargetInfos();
         llvm::InitializeAllTargets();
@@ -205,15 +657,16 @@ namespace hypertk
             return false;
         }
 
-        auto cpu_ = "generic";
-        auto features_ = "";
+        hypertk::TargetSpec spec = hypertk::resolveTarget(cpu, features);
 
         llvm::TargetOptions opt;
         TargetMachine_ = target_->createTargetMachine(TargetTriple_,
-                                                      cpu_,
-                                                      features_,
+                                                      spec.CPU,
+                                                      spec.featureString(),
                                                       opt,
-                                                      llvm::Reloc::PIC_);
+                                                      llvm::Reloc::PIC_,
+                                                      std::nullopt,
+                                                      toCodeGenOptLevel(OptLevel_));
 
         return true;
     }
@@ -232,6 +685,11 @@ namespace hypertk
         llvm::FunctionType *printdFT = llvm::FunctionType::get(llvm::Type::getDoubleTy(*TheContext_), llvm::Type::getDoubleTy(*TheContext_), false);
         llvm::Function::Create(printdFT, llvm::Function::ExternalLinkage, "printd", TheModule_.get());
         //>
+
+        //> define `double @flushd()`
+        llvm::FunctionType *flushdFT = llvm::FunctionType::get(llvm::Type::getDoubleTy(*TheContext_), false);
+        llvm::Function::Create(flushdFT, llvm::Function::ExternalLinkage, "flushd", TheModule_.get());
+        //>
     }
 #endif
 
@@ -240,20 +698,40 @@ namespace hypertk
         const ast::statement::Block &stmt)
     {
         beginScope();
+        const size_t heapMark = HeapArrays_.size();
+        for (const auto &stmt_ : nodes()[stmt.Statements])
+        {
+            // Nothing after a `return` is reachable.
+            if (Builder_->GetInsertBlock()->getTerminator())
+                break;
+
+            if (!visit(stmt_))
+            {
+                freeHeapArrays(heapMark, true);
+                endScope();
+                return nullptr;
+            }
+        }
+        freeHeapArrays(heapMark, true);
         endScope();
-        return nullptr;
+
+        // Statements have no value, only signal success like `for` does.
+        return llvm::Constant::getNullValue(llvm::Type::getDoubleTy(*TheContext_));
     }
 
     llvm::Value *RuntimeLLVM::visitVarDeclStmt(
         const ast::statement::VarDecl &stmt)
     {
         ScopeTable &curScope = currentScope();
-        if (curScope.find(stmt.VarName.lexeme) != curScope.end())
+        if (curScope.find(stmt.VarName.symbol) != curScope.end())
         {
             logError("Already a variable with this name in this scope.");
             return nullptr;
         }
 
+        if (stmt.isArray())
+            return declareArray(stmt);
+
         llvm::Function *theFunction = Builder_->GetInsertBlock()->getParent();
 
         llvm::Value *initializer = nullptr;
@@ -261,32 +739,90 @@ namespace hypertk
             if (initializer = visit(stmt.Initializer.value()), !initializer)
                 return nullptr;
 
-        llvm::AllocaInst *alloca_ = createEntryBlockAlloca(theFunction, stmt.VarName.lexeme);
-        curScope[stmt.VarName.lexeme] = alloca_;
-        if (initializer)
-            Builder_->CreateStore(initializer, alloca_);
+        llvm::AllocaInst *alloca_ = createEntryBlockAlloca(theFunction, stmt.VarName.lexeme, stmt.Ty);
+        curScope[stmt.VarName.symbol] = alloca_;
+        // Variables without initializer start as `0`, like in the interpreter.
+        Builder_->CreateStore(initializer
+                                  ? convert(initializer, stmt.Ty)
+                                  : llvm::Constant::getNullValue(alloca_->getAllocatedType()),
+                              alloca_);
 
         return alloca_;
     }
 
+    /// @details An array sized by a small literal is an alloca in the entry block, which costs
+    /// nothing to allocate. Any other array is `calloc`ed where it is declared and freed when its
+    /// scope ends or the function returns, its slot stays `null` while it is not allocated so a
+    /// `return` can free every heap array of the function without knowing which ones are live.
+    llvm::Value *RuntimeLLVM::declareArray(const ast::statement::VarDecl &stmt)
+    {
+        llvm::Function *theFunction = Builder_->GetInsertBlock()->getParent();
+        llvm::Type *doubleTy = llvm::Type::getDoubleTy(*TheContext_);
+        llvm::Type *i64Ty = llvm::Type::getInt64Ty(*TheContext_);
+        llvm::Type *ptrTy = llvm::PointerType::getUnqual(*TheContext_);
+        std::string_view name = stmt.VarName.lexeme;
+
+        ArrayInfo array;
+        if (auto fixed = stmt.fixedLength(nodes()); fixed && *fixed <= MaxStackArrayLength)
+        {
+            llvm::AllocaInst *alloca_ = createEntryBlockAlloca(theFunction, name, llvm::ArrayType::get(doubleTy, *fixed));
+            // Zeroed on every execution of the declaration, like a fresh heap array.
+            Builder_->CreateMemSet(alloca_, Builder_->getInt8(0), *fixed * sizeof(double), alloca_->getAlign());
+            array = {alloca_, llvm::ConstantInt::get(i64Ty, *fixed)};
+        }
+        else
+        {
+            llvm::Value *size = visit(stmt.Size.value());
+            if (!size)
+                return nullptr;
+            // A negative size gives an empty array.
+            llvm::Value *length = Builder_->CreateBinaryIntrinsic(llvm::Intrinsic::smax,
+                                                                  toIndex(size),
+                                                                  llvm::ConstantInt::get(i64Ty, 0),
+                                                                  nullptr,
+                                                                  "len");
+
+            llvm::AllocaInst *slot = createEntryBlockAlloca(theFunction, std::string(name) + ".heap", ptrTy);
+            llvm::IRBuilder<> entryB(slot->getParent(), std::next(slot->getIterator()));
+            entryB.CreateStore(llvm::ConstantPointerNull::get(llvm::PointerType::getUnqual(*TheContext_)), slot);
+
+            llvm::Function *calloc_ = getRuntimeFunction("calloc", llvm::FunctionType::get(ptrTy, {i64Ty, i64Ty}, false));
+            // Fresh memory no other pointer refers to, loads and stores to it never alias other arrays.
+            calloc_->addRetAttr(llvm::Attribute::NoAlias);
+            llvm::Value *data = Builder_->CreateCall(calloc_, {length, llvm::ConstantInt::get(i64Ty, sizeof(double))}, name);
+            Builder_->CreateStore(data, slot);
+            HeapArrays_.push_back(slot);
+            array = {data, length};
+        }
+
+        Arrays_[array.Data] = array;
+        currentScope()[stmt.VarName.symbol] = array.Data;
+        return array.Data;
+    }
+
     llvm::Value *RuntimeLLVM::visitFunctionStmt(
         const ast::statement::Function &stmt)
     {
         llvm::Function *theFunction = TheModule_->getFunction(stmt.Name.lexeme);
-        if (theFunction && !theFunction->empty())
+        if ((theFunction && !theFunction->empty()) || FunctionProtos_.count(std::string(stmt.Name.lexeme)))
         {
             logError("Function cannot be redefined.");
             return nullptr;
         }
 
-        std::vector<llvm::Type *> Doubles(stmt.Params.size(), llvm::Type::getDoubleTy(*TheContext_));
-        llvm::FunctionType *FT = llvm::FunctionType::get(llvm::Type::getDoubleTy(*TheContext_), Doubles, false);
-        theFunction = llvm::Function::Create(FT, llvm::Function::ExternalLinkage, stmt.Name.lexeme, TheModule_.get());
+        // Reuse the declaration if the function was forward declared.
+        if (!theFunction)
+            theFunction = declareFunction(std::string(stmt.Name.lexeme), stmt.Params.Size);
+
+        addTargetAttributes(theFunction);
 
         // Set argument names
-        unsigned idx = 0;
+        auto params = nodes()[stmt.Params];
         for (auto &arg : theFunction->args())
-            arg.setName(stmt.Params[idx++].lexeme);
+            arg.setName(params[arg.getArgNo()].lexeme);
+
+        Arrays_.clear();
+        HeapArrays_.clear();
 
         // Create a new basic block to start insertion into.
         // Basic blocks in LLVM are an important part of functions that define the Control Flow Graph.
@@ -309,14 +845,15 @@ namespace hypertk
 
             // Add arguments to variable symbol table
             // NamedValues_[std::string(arg.getName())] = alloca_;
-            curScope[std::string(arg.getName())] = alloca_;
+            curScope[params[arg.getArgNo()].symbol] = alloca_;
         }
 
-        for (const auto &fStmt : stmt.Body)
+        for (const auto &fStmt : nodes()[stmt.Body])
             visit(fStmt);
 
         if (!Builder_->GetInsertBlock()->getTerminator())
         {
+            freeHeapArrays(0, false);
             if (theFunction->getReturnType()->isVoidTy())
                 Builder_->CreateRetVoid();
             else
@@ -335,28 +872,45 @@ namespace hypertk
             errStream.flush();
             logError(errMsg);
 
-            theFunction->eraseFromParent();
+            // A forward declared function may already have callers, keep its declaration for them.
+            if (theFunction->use_empty())
+                theFunction->eraseFromParent();
+            else
+                theFunction->deleteBody();
             return nullptr;
         }
 
-#ifdef ENABLE_COMPILER_OPTIMIZATION_PASS
-        // Run the optimizer on the function.
-        TheFPM_->run(*theFunction, *TheFAM_);
-#endif
-
         return theFunction;
     }
 
+    void RuntimeLLVM::addTargetAttributes(llvm::Function *fn)
+    {
+        // Let the backend and the inliner see the selected CPU on the definition itself.
+        llvm::TargetMachine *TM = getTargetMachine();
+        if (!TM->getTargetCPU().empty())
+            fn->addFnAttr("target-cpu", TM->getTargetCPU());
+        if (!TM->getTargetFeatureString().empty())
+            fn->addFnAttr("target-features", TM->getTargetFeatureString());
+    }
+
     llvm::Value *RuntimeLLVM::visitBinOpDefStmt(
         const ast::statement::BinOpDef &stmt)
     {
-        return visitFunctionStmt(stmt);
+        return markOperator(visitFunctionStmt(stmt));
     }
 
     llvm::Value *RuntimeLLVM::visitUnaryOpDefStmt(
         const ast::statement::UnaryOpDef &stmt)
     {
-        return visitFunctionStmt(stmt);
+        return markOperator(visitFunctionStmt(stmt));
+    }
+
+    llvm::Value *RuntimeLLVM::markOperator(llvm::Value *fn)
+    {
+        // Operators are tiny and used like builtins, a call costs more than their body.
+        if (WholeProgram_ && fn)
+            llvm::cast<llvm::Function>(fn)->addFnAttr(llvm::Attribute::AlwaysInline);
+        return fn;
     }
 
     llvm::Value *RuntimeLLVM::visitExpressionStmt(
@@ -368,12 +922,63 @@ namespace hypertk
     llvm::Value *RuntimeLLVM::visitReturnStmt(
         const ast::statement::Return &stmt)
     {
-        if (llvm::Value *expr = visit(stmt.Expr))
+        return emitReturn(stmt.Expr);
+    }
+
+    /// @details A call in tail position is marked `musttail` when the callee has the caller's
+    /// prototype, which self recursion always has, so the backend turns it into a jump at every
+    /// optimization level. Other tail calls are marked `tail` for the TailCallElim pass.
+    llvm::Value *RuntimeLLVM::emitReturn(ast::expression::ExprRef expr)
+    {
+        // Both arms of `?:` are in tail position, return from each arm instead of merging them.
+        if (const auto *cond = nodes().getIf<ast::expression::Conditional>(expr))
         {
-            return Builder_->CreateRet(expr);
+            llvm::Value *condV = visit(cond->Cond);
+            if (!condV)
+                return nullptr;
+            condV = toCondition(condV, "ifcond");
+
+            llvm::Function *theFunction = Builder_->GetInsertBlock()->getParent();
+            llvm::BasicBlock *thenBB = llvm::BasicBlock::Create(*TheContext_, "then", theFunction);
+            llvm::BasicBlock *elseBB = llvm::BasicBlock::Create(*TheContext_, "else", theFunction);
+            Builder_->CreateCondBr(condV, thenBB, elseBB);
+
+            Builder_->SetInsertPoint(thenBB);
+            if (!emitReturn(cond->Then))
+                return nullptr;
+
+            Builder_->SetInsertPoint(elseBB);
+            return emitReturn(cond->Else);
         }
 
-        return nullptr;
+        llvm::Value *value = visit(expr);
+        if (!value)
+            return nullptr;
+        // Functions return doubles, a call already does.
+        value = convert(value, ast::Type::DOUBLE);
+
+        auto *call = nodes().is<ast::expression::Call>(expr) ? llvm::dyn_cast<llvm::CallInst>(value) : nullptr;
+        // Math builtins lower to intrinsics, e.g. `sqrt` to `llvm.sqrt.f64`, which are no calls to tail.
+        if (call && (!call->getCalledFunction() || call->getCalledFunction()->isIntrinsic()))
+            call = nullptr;
+        {
+            // A tail call must be followed by the `ret`, free the heap arrays before it. Its
+            // arguments are doubles, the callee cannot see the arrays.
+            llvm::IRBuilderBase::InsertPointGuard guard(*Builder_);
+            if (call)
+                Builder_->SetInsertPoint(call);
+            freeHeapArrays(0, false);
+        }
+
+        if (call)
+        {
+            llvm::Function *caller = Builder_->GetInsertBlock()->getParent();
+            call->setTailCallKind(call->getFunctionType() == caller->getFunctionType()
+                                      ? llvm::CallInst::TCK_MustTail
+                                      : llvm::CallInst::TCK_Tail);
+        }
+
+        return Builder_->CreateRet(value);
     }
 
     /// @details Implement an important SSA operation: the `Phi operation`
@@ -383,10 +988,8 @@ namespace hypertk
         llvm::Value *condV = visit(stmt.Cond);
         if (!condV)
             return nullptr;
-        // Convert condition to a bool by comparing non-equal to 0.0
-        condV = Builder_->CreateFCmpONE(condV,
-                                        llvm::ConstantFP::get(*TheContext_, llvm::APFloat(0.0)),
-                                        "ifcond");
+        // Convert condition to a bool by comparing non-equal to 0
+        condV = toCondition(condV, "ifcond");
 
         llvm::Function *theFunction = Builder_->GetInsertBlock()->getParent();
 
@@ -436,91 +1039,364 @@ namespace hypertk
         return condV;
     }
 
+    /// @details The loop is emitted in the canonical form the loop passes expect, tested at the
+    /// top with a single latch:
+    ///
+    ///     preheader:  i = start, hoisted step and bound
+    ///     header:     br i < bound, body, afterloop
+    ///     body:       ...
+    ///     latch:      i = i + step, br header
+    ///     afterloop:
+    ///
+    /// A step or a `i < bound` whose operands the body leaves alone is computed once in the
+    /// preheader, so the trip count is known when the loop is entered.
     llvm::Value *RuntimeLLVM::visitForStmt(
         const ast::statement::For &stmt)
     {
+        if (stmt.Parallel)
+            return emitParallelFor(stmt);
+
         llvm::Function *theFunction = Builder_->GetInsertBlock()->getParent();
 
         // Create an alloca for the variable in the entry block.
-        llvm::AllocaInst *alloca_ = createEntryBlockAlloca(theFunction, stmt.VarName.lexeme);
+        llvm::AllocaInst *alloca_ = createEntryBlockAlloca(theFunction, stmt.VarName.lexeme, stmt.Ty);
 
-        // Emit the start code first, without `variable` in scope.
-        llvm::Value *startVal = visit(stmt.Start);
+        // Emit the start code first, without `variable` in scope. A loop entered by `compileLoop`
+        // resumes where the interpreter left it.
+        llvm::Value *startVal = &stmt == ResumedLoop_ ? ResumedStart_ : visit(stmt.Start);
         if (!startVal)
             return nullptr;
 
         // Store the value into the alloca
-        Builder_->CreateStore(startVal, alloca_);
+        Builder_->CreateStore(convert(startVal, stmt.Ty), alloca_);
+
+        // The invariant step and bound do not read the variable, they are emitted without it in scope as well.
+        llvm::Value *stepVal = nullptr;
+        if (stmt.StepInvariant)
+        {
+            stepVal = visit(stmt.Step);
+            if (!stepVal)
+                return nullptr;
+            stepVal = convert(stepVal, stmt.Ty);
+        }
 
-        // Make the new basic block for the loop header, inserting after current block.
-        llvm::BasicBlock *loopBB = llvm::BasicBlock::Create(*TheContext_, "loop", theFunction);
+        const ast::expression::Binary *bound = nullptr;
+        llvm::Value *boundVal = nullptr;
+        if (stmt.BoundInvariant)
+        {
+            bound = &nodes()[stmt.End.as<ast::expression::Binary>()];
+            boundVal = visit(bound->RHS);
+            if (!boundVal)
+                return nullptr;
+        }
 
-        // Insert an explicit fall through from the current block to the loopBB
-        Builder_->CreateBr(loopBB);
+        llvm::BasicBlock *headerBB = llvm::BasicBlock::Create(*TheContext_, "loop.header", theFunction);
+        llvm::BasicBlock *bodyBB = llvm::BasicBlock::Create(*TheContext_, "loop.body");
+        llvm::BasicBlock *latchBB = llvm::BasicBlock::Create(*TheContext_, "loop.latch");
+        llvm::BasicBlock *afterBB = llvm::BasicBlock::Create(*TheContext_, "afterloop");
 
-        // Start insertion in loopBB
-        Builder_->SetInsertPoint(loopBB);
+        // Insert an explicit fall through from the preheader to the header
+        Builder_->CreateBr(headerBB);
+        Builder_->SetInsertPoint(headerBB);
 
         beginScope();
-        // Within the loop, the variable is defined equal to the PHI node.  If it
-        // shadows an existing variable, we have to restore it, so save it now.
-        // llvm::AllocaInst *oldVal = NamedValues_[stmt.VarName.lexeme];
-        // NamedValues_[stmt.VarName.lexeme] = alloca_;
-        currentScope()[stmt.VarName.lexeme] = alloca_;
+        currentScope()[stmt.VarName.symbol] = alloca_;
 
-        // Emit the body of the loop.  This, like any other expr, can change the
-        // current BB.  Note that we ignore the value computed by the body, but don't
-        // allow an error.
-        if (!visit(stmt.Body))
+        // Compute the end condition.
+        llvm::Value *endCond;
+        if (bound)
+        {
+            llvm::Value *curVar = Builder_->CreateLoad(alloca_->getAllocatedType(),
+                                                       alloca_,
+                                                       stmt.VarName.lexeme);
+            endCond = emitLess(curVar, boundVal, stmt.Ty, nodes().typeOf(bound->RHS));
+        }
+        else
+            endCond = visit(stmt.End);
+        if (!endCond)
         {
             endScope();
             return nullptr;
         }
+        Builder_->CreateCondBr(toCondition(endCond, "loopcond"), bodyBB, afterBB);
 
-        // Emit the step values.
-        llvm::Value *stepVal = visit(stmt.Step);
-        if (!stepVal)
+        // Emit the body of the loop.  This, like any other expr, can change the
+        // current BB.  Note that we ignore the value computed by the body, but don't
+        // allow an error.
+        theFunction->insert(theFunction->end(), bodyBB);
+        Builder_->SetInsertPoint(bodyBB);
+        const size_t heapMark = HeapArrays_.size();
+        bool bodyOk = visit(stmt.Body) != nullptr;
+        // An array declared as the whole body is allocated again by the next iteration.
+        freeHeapArrays(heapMark, true);
+        if (!bodyOk)
         {
             endScope();
             return nullptr;
         }
+        if (!Builder_->GetInsertBlock()->getTerminator())
+            Builder_->CreateBr(latchBB);
 
-        // Compute the end condition.
-        llvm::Value *endCond = visit(stmt.End);
-        if (!endCond)
+        // Emit the step values.
+        theFunction->insert(theFunction->end(), latchBB);
+        Builder_->SetInsertPoint(latchBB);
+        if (!stepVal)
         {
-            endScope();
-            return nullptr;
+            stepVal = visit(stmt.Step);
+            if (!stepVal)
+            {
+                endScope();
+                return nullptr;
+            }
+            stepVal = convert(stepVal, stmt.Ty);
         }
 
         // Reload, increment and restore the alloca. This handles the case where
         // the body of the loop mutates the variable.
         llvm::Value *curVar = Builder_->CreateLoad(alloca_->getAllocatedType(),
                                                    alloca_,
-                                                   stmt.VarName.lexeme.c_str());
-        llvm::Value *nextVar = Builder_->CreateFAdd(curVar, stepVal, "nextvar");
+                                                   stmt.VarName.lexeme);
+        // An integer counter never wraps, which lets loop passes compute the trip count.
+        llvm::Value *nextVar = stmt.Ty == ast::Type::DOUBLE
+                                   ? Builder_->CreateFAdd(curVar, stepVal, "nextvar")
+                                   : Builder_->CreateNSWAdd(curVar, stepVal, "nextvar");
         Builder_->CreateStore(nextVar, alloca_);
+        Builder_->CreateBr(headerBB);
 
-        // Convert condition to a bool by comparing non-equal to 0.0.
-        endCond = Builder_->CreateFCmpONE(endCond, llvm::ConstantFP::get(*TheContext_, llvm::APFloat(0.0)), "loopcond");
+        // any new code will be inserted in afterBB;
+        theFunction->insert(theFunction->end(), afterBB);
+        Builder_->SetInsertPoint(afterBB);
+        endScope();
 
-        // Create the `after loop` block and insert it.
-        llvm::BasicBlock *afterBB = llvm::BasicBlock::Create(*TheContext_, "afterloop", theFunction);
+        // `for` always returns 0.0, a `nullptr` is reserved for errors so loops can nest.
+        return llvm::Constant::getNullValue(llvm::Type::getDoubleTy(*TheContext_));
+    }
 
-        // Insert the conditional branch into the end of loopEndBB
-        Builder_->CreateCondBr(endCond, loopBB, afterBB);
+    /// @details The body is outlined into `double body(i64 first, i64 last, ptr env)`, which runs the
+    /// iterations `first` to `last - 1` with the variable at `start + k * step` and returns the sum of
+    /// the reduced expression over them, or `0`. Every variable in scope is copied into `env` first,
+    /// an array as its data pointer and length so the iterations share its elements. The semantic
+    /// analyzer made sure the body assigns none of them, nor returns. `hypertk_parallel_for` then
+    /// runs chunks of the iterations on the thread pool and adds their sums up in chunk order.
+    llvm::Value *RuntimeLLVM::emitParallelFor(const ast::statement::For &stmt)
+    {
+        llvm::Function *theFunction = Builder_->GetInsertBlock()->getParent();
+        llvm::Type *doubleTy = llvm::Type::getDoubleTy(*TheContext_);
+        llvm::Type *i64Ty = llvm::Type::getInt64Ty(*TheContext_);
+        llvm::Type *ptrTy = llvm::PointerType::getUnqual(*TheContext_);
 
-        // any new code will be inserted in afterBB;
-        Builder_->SetInsertPoint(afterBB);
+        const auto *cond = nodes().getIf<ast::expression::Binary>(stmt.End);
+        if (!cond || cond->Op != ast::BinaryOp::LESS)
+        {
+            logError("A parallel loop needs the condition `" + std::string(stmt.VarName.lexeme) + " < bound`.");
+            return nullptr;
+        }
+
+        //> start, step and bound, evaluated once without the variable in scope
+        llvm::Value *startVal = visit(stmt.Start);
+        llvm::Value *stepVal = startVal ? visit(stmt.Step) : nullptr;
+        llvm::Value *boundVal = stepVal ? visit(cond->RHS) : nullptr;
+        if (!boundVal)
+            return nullptr;
+        startVal = convert(startVal, stmt.Ty);
+        stepVal = convert(stepVal, stmt.Ty);
+
+        // Trip count `ceil((bound - start) / step)`, no iteration unless both the step and the span are positive.
+        llvm::Value *start = convert(startVal, ast::Type::DOUBLE);
+        llvm::Value *step = convert(stepVal, ast::Type::DOUBLE);
+        llvm::Value *span = Builder_->CreateFSub(convert(boundVal, ast::Type::DOUBLE), start, "span");
+        llvm::Value *trips = Builder_->CreateUnaryIntrinsic(llvm::Intrinsic::ceil, Builder_->CreateFDiv(span, step), nullptr, "trips");
+        llvm::Value *positive = Builder_->CreateAnd(Builder_->CreateFCmpOGT(step, llvm::ConstantFP::get(doubleTy, 0.0)),
+                                                    Builder_->CreateFCmpOGT(span, llvm::ConstantFP::get(doubleTy, 0.0)));
+        llvm::Value *count = Builder_->CreateSelect(positive, toIndex(trips), llvm::ConstantInt::get(i64Ty, 0), "count");
+        //<
+
+        //> environment: start, step, then every variable in scope, the innermost one of each name
+        std::vector<Capture> captures;
+        std::vector<llvm::Type *> fields{getType(stmt.Ty), getType(stmt.Ty)};
+        std::unordered_map<symbol::Symbol, bool> seen;
+        for (auto scope = scopes_.rbegin(); scope != scopes_.rend(); ++scope)
+            for (const auto &[name, var] : *scope)
+            {
+                if (!seen.emplace(name, true).second)
+                    continue;
+                if (auto array = Arrays_.find(var); array != Arrays_.end())
+                {
+                    captures.push_back({name, var, &array->second});
+                    fields.push_back(ptrTy);
+                    fields.push_back(i64Ty);
+                }
+                else if (auto *alloca_ = llvm::dyn_cast<llvm::AllocaInst>(var))
+                {
+                    captures.push_back({name, var, nullptr});
+                    fields.push_back(alloca_->getAllocatedType());
+                }
+            }
+
+        llvm::StructType *envTy = llvm::StructType::get(*TheContext_, fields);
+        llvm::AllocaInst *env = createEntryBlockAlloca(theFunction, "parallel.env", envTy);
+        unsigned field = 0;
+        Builder_->CreateStore(startVal, Builder_->CreateStructGEP(envTy, env, field++));
+        Builder_->CreateStore(stepVal, Builder_->CreateStructGEP(envTy, env, field++));
+        for (const Capture &capture : captures)
+            if (capture.Array)
+            {
+                Builder_->CreateStore(capture.Array->Data, Builder_->CreateStructGEP(envTy, env, field++));
+                Builder_->CreateStore(capture.Array->Length, Builder_->CreateStructGEP(envTy, env, field++));
+            }
+            else
+            {
+                llvm::Type *type = llvm::cast<llvm::AllocaInst>(capture.Var)->getAllocatedType();
+                Builder_->CreateStore(Builder_->CreateLoad(type, capture.Var, symbol::name(capture.Name)),
+                                      Builder_->CreateStructGEP(envTy, env, field++));
+            }
+        //<
+
+        llvm::Function *body = emitParallelBody(stmt, theFunction->getName(), envTy, captures);
+        if (!body)
+            return nullptr;
+
+        llvm::Function *parallelFor = getRuntimeFunction("hypertk_parallel_for",
+                                                         llvm::FunctionType::get(doubleTy, {ptrTy, ptrTy, i64Ty}, false));
+        llvm::Value *sum = Builder_->CreateCall(parallelFor, {body, env, count}, "sum");
+
+        if (stmt.Reduce.has_value())
+        {
+            auto *target = llvm::dyn_cast_or_null<llvm::AllocaInst>(resolveVariable(nodes()[stmt.Reduce.value()].Name.symbol));
+            if (!target || Arrays_.count(target))
+            {
+                logError("Unknown variable to reduce into.");
+                return nullptr;
+            }
+            llvm::Value *total = Builder_->CreateFAdd(convert(Builder_->CreateLoad(target->getAllocatedType(), target), ast::Type::DOUBLE),
+                                                      sum, "total");
+            Builder_->CreateStore(convert(total, target->getAllocatedType()), target);
+        }
+
+        return llvm::Constant::getNullValue(doubleTy);
+    }
+
+    llvm::Function *RuntimeLLVM::emitParallelBody(const ast::statement::For &stmt, llvm::StringRef parent,
+                                                  llvm::StructType *envTy, const std::vector<Capture> &captures)
+    {
+        llvm::Type *doubleTy = llvm::Type::getDoubleTy(*TheContext_);
+        llvm::Type *i64Ty = llvm::Type::getInt64Ty(*TheContext_);
+        llvm::Type *ptrTy = llvm::PointerType::getUnqual(*TheContext_);
+
+        llvm::FunctionType *FT = llvm::FunctionType::get(doubleTy, {i64Ty, i64Ty, ptrTy}, false);
+        llvm::Function *body = llvm::Function::Create(FT, llvm::Function::InternalLinkage, parent + ".parallel", TheModule_.get());
+        addTargetAttributes(body);
+        llvm::Argument *first = body->getArg(0), *last = body->getArg(1), *env = body->getArg(2);
+        first->setName("first"), last->setName("last"), env->setName("env");
+
+        // The body is emitted on its own, the scopes and heap arrays of the enclosing function are set aside.
+        llvm::IRBuilderBase::InsertPointGuard guard(*Builder_);
+        std::vector<ScopeTable> outerScopes = std::move(scopes_);
+        std::vector<llvm::AllocaInst *> outerHeapArrays = std::move(HeapArrays_);
+        scopes_.clear();
+        HeapArrays_.clear();
+
+        Builder_->SetInsertPoint(llvm::BasicBlock::Create(*TheContext_, "entry", body));
+        beginScope();
+
+        //> load the environment in the order `emitParallelFor` stored it
+        unsigned field = 0;
+        auto load = [&](const llvm::Twine &name)
+        {
+            llvm::Value *ptr = Builder_->CreateStructGEP(envTy, env, field);
+            return Builder_->CreateLoad(envTy->getElementType(field++), ptr, name);
+        };
+        llvm::Value *start = load("start");
+        llvm::Value *step = load("step");
+        for (const Capture &capture : captures)
+            if (capture.Array)
+            {
+                llvm::Value *data = load(symbol::name(capture.Name));
+                llvm::Value *length = load(llvm::Twine(symbol::name(capture.Name)) + ".len");
+                Arrays_[data] = {data, length};
+                currentScope()[capture.Name] = data;
+            }
+            else
+            {
+                llvm::Value *value = load(symbol::name(capture.Name));
+                llvm::AllocaInst *alloca_ = createEntryBlockAlloca(body, symbol::name(capture.Name), value->getType());
+                Builder_->CreateStore(value, alloca_);
+                currentScope()[capture.Name] = alloca_;
+            }
+        //<
+
+        //> for k = first, k < last, 1: the variable is `start + k * step`
+        llvm::AllocaInst *k = createEntryBlockAlloca(body, "k", i64Ty);
+        llvm::AllocaInst *var = createEntryBlockAlloca(body, stmt.VarName.lexeme, stmt.Ty);
+        llvm::AllocaInst *acc = createEntryBlockAlloca(body, "acc", doubleTy);
+        Builder_->CreateStore(first, k);
+        Builder_->CreateStore(llvm::ConstantFP::get(doubleTy, 0.0), acc);
+
+        llvm::BasicBlock *headerBB = llvm::BasicBlock::Create(*TheContext_, "loop.header", body);
+        llvm::BasicBlock *bodyBB = llvm::BasicBlock::Create(*TheContext_, "loop.body", body);
+        llvm::BasicBlock *latchBB = llvm::BasicBlock::Create(*TheContext_, "loop.latch");
+        llvm::BasicBlock *afterBB = llvm::BasicBlock::Create(*TheContext_, "afterloop");
+        Builder_->CreateBr(headerBB);
+
+        Builder_->SetInsertPoint(headerBB);
+        llvm::Value *kVal = Builder_->CreateLoad(i64Ty, k, "k");
+        Builder_->CreateCondBr(Builder_->CreateICmpSLT(kVal, last, "loopcond"), bodyBB, afterBB);
+
+        Builder_->SetInsertPoint(bodyBB);
+        llvm::Value *varVal;
+        if (stmt.Ty == ast::Type::DOUBLE)
+            varVal = Builder_->CreateFAdd(start, Builder_->CreateFMul(Builder_->CreateSIToFP(kVal, doubleTy), step));
+        else
+            varVal = Builder_->CreateNSWAdd(convert(start, i64Ty), Builder_->CreateNSWMul(kVal, convert(step, i64Ty)));
+        Builder_->CreateStore(convert(varVal, stmt.Ty), var);
 
-        // // Restore the unshadowed variable.
-        // if (oldVal)
-        //     NamedValues_[stmt.VarName.lexeme] = oldVal;
-        // else
-        //     NamedValues_.erase(stmt.VarName.lexeme);
+        beginScope();
+        currentScope()[stmt.VarName.symbol] = var;
+        bool bodyOk;
+        if (stmt.Reduce.has_value())
+        {
+            llvm::Value *value = visit(nodes().getIf<ast::statement::Expression>(stmt.Body)->Expr);
+            bodyOk = value != nullptr;
+            if (bodyOk)
+                Builder_->CreateStore(Builder_->CreateFAdd(Builder_->CreateLoad(doubleTy, acc), convert(value, ast::Type::DOUBLE)), acc);
+        }
+        else
+            bodyOk = visit(stmt.Body) != nullptr;
+        freeHeapArrays(0, true);
         endScope();
 
-        return nullptr;
+        if (bodyOk)
+        {
+            if (!Builder_->GetInsertBlock()->getTerminator())
+                Builder_->CreateBr(latchBB);
+
+            body->insert(body->end(), latchBB);
+            Builder_->SetInsertPoint(latchBB);
+            Builder_->CreateStore(Builder_->CreateNSWAdd(Builder_->CreateLoad(i64Ty, k), llvm::ConstantInt::get(i64Ty, 1), "nextk"), k);
+            Builder_->CreateBr(headerBB);
+
+            body->insert(body->end(), afterBB);
+            Builder_->SetInsertPoint(afterBB);
+            Builder_->CreateRet(Builder_->CreateLoad(doubleTy, acc, "sum"));
+        }
+        //<
+
+        endScope();
+        scopes_ = std::move(outerScopes);
+        HeapArrays_ = std::move(outerHeapArrays);
+
+        std::string errMsg;
+        llvm::raw_string_ostream errStream(errMsg);
+        if (!bodyOk || llvm::verifyFunction(*body, &errStream))
+        {
+            errStream.flush();
+            if (!errMsg.empty())
+                logError(errMsg);
+            body->eraseFromParent();
+            return nullptr;
+        }
+
+        return body;
     }
     //<
 
@@ -528,6 +1404,8 @@ namespace hypertk
     llvm::Value *RuntimeLLVM::visitNumberExpr(
         const ast::expression::Number &expr)
     {
+        if (expr.Ty == ast::Type::INT)
+            return llvm::ConstantInt::get(getType(ast::Type::INT), (int64_t)expr.Val, /* isSigned */ true);
         return llvm::ConstantFP::get(*TheContext_, llvm::APFloat(expr.Val));
     }
 
@@ -535,18 +1413,23 @@ namespace hypertk
         const ast::expression::Variable &expr)
     {
         // llvm::AllocaInst *a = NamedValues_[expr.Name.lexeme];
-        llvm::Value *v_ = resolveVariable(expr.Name.lexeme);
+        llvm::Value *v_ = resolveVariable(expr.Name.symbol);
         if (!v_)
         {
             logError("Unknown variable name");
             return nullptr;
         }
+        if (Arrays_.count(v_))
+        {
+            logError("An array is not a value, index it or take its len().");
+            return nullptr;
+        }
 
         if (llvm::AllocaInst *a_ = llvm::dyn_cast<llvm::AllocaInst>(v_))
             // Load value
             return Builder_->CreateLoad(a_->getAllocatedType(),
                                         a_,
-                                        expr.Name.lexeme.c_str());
+                                        expr.Name.lexeme);
 
         logError("Wrong type");
         return nullptr;
@@ -558,31 +1441,57 @@ namespace hypertk
         // Special case '=' because we don't want to emit the LHS as an expression.
         if (expr.Op == ast::BinaryOp::EQUAL)
         {
+            if (const auto *element = nodes().getIf<ast::expression::Index>(expr.LHS))
+            {
+                llvm::Value *ptr = emitElementPtr(*element);
+                if (!ptr)
+                    return nullptr;
+
+                llvm::Value *RHS = visit(expr.RHS);
+                if (!RHS)
+                    return nullptr;
+
+                RHS = convert(RHS, ast::Type::DOUBLE);
+                Builder_->CreateStore(RHS, ptr);
+                return RHS;
+            }
+
             // This assume we're building without RTTI because LLVM builds that way by
             // default. If you build LLVM with RTTI this can be changed to a
             // dynamic_cast for automatic error checking.
-            if (!std::holds_alternative<ast::expression::VariablePtr>(expr.LHS))
+            const auto *LHSE = nodes().getIf<ast::expression::Variable>(expr.LHS);
+            if (!LHSE)
             {
-                logError("destination of '=' must be a variable");
+                logError("destination of '=' must be a variable or an array element");
                 return nullptr;
             }
 
-            auto LHSE = std::get_if<ast::expression::VariablePtr>(&expr.LHS);
-            // llvm::Value *variable = NamedValues_[LHSE->get()->Name.lexeme];
-            llvm::Value *variable = resolveVariable(LHSE->get()->Name.lexeme);
+            // llvm::Value *variable = NamedValues_[LHSE->Name.lexeme];
+            llvm::Value *variable = resolveVariable(LHSE->Name.symbol);
             if (!variable)
             {
                 logError("Unknown variable name.");
                 return nullptr;
             }
+            if (Arrays_.count(variable))
+            {
+                logError("Cannot assign to an array, assign to its elements.");
+                return nullptr;
+            }
 
             llvm::Value *RHS = visit(expr.RHS);
             if (!RHS)
                 return nullptr;
 
-            return Builder_->CreateStore(RHS, variable);
+            // The value of an assignment is the value stored.
+            RHS = convert(RHS, llvm::cast<llvm::AllocaInst>(variable)->getAllocatedType());
+            Builder_->CreateStore(RHS, variable);
+            return RHS;
         }
 
+        if (expr.Op == ast::BinaryOp::AND || expr.Op == ast::BinaryOp::OR)
+            return emitShortCircuit(expr);
+
         llvm::Value *L = visit(expr.LHS);
         if (!L)
             return nullptr;
@@ -591,29 +1500,33 @@ namespace hypertk
         if (!R)
             return nullptr;
 
+        // Integer arithmetic was inferred from integer operands, it is exact as long as it does not overflow.
+        bool isInt = expr.Ty == ast::Type::INT;
         switch (expr.Op)
         {
         case ast::BinaryOp::ADD:
-            return Builder_->CreateFAdd(L, R, "addtmp");
+            L = convert(L, expr.Ty), R = convert(R, expr.Ty);
+            return isInt ? Builder_->CreateNSWAdd(L, R, "addtmp") : Builder_->CreateFAdd(L, R, "addtmp");
         case ast::BinaryOp::SUB:
-            return Builder_->CreateFSub(L, R, "subtmp");
+            L = convert(L, expr.Ty), R = convert(R, expr.Ty);
+            return isInt ? Builder_->CreateNSWSub(L, R, "subtmp") : Builder_->CreateFSub(L, R, "subtmp");
         case ast::BinaryOp::MUL:
-            return Builder_->CreateFMul(L, R, "multmp");
+            L = convert(L, expr.Ty), R = convert(R, expr.Ty);
+            return isInt ? Builder_->CreateNSWMul(L, R, "multmp") : Builder_->CreateFMul(L, R, "multmp");
         case ast::BinaryOp::DIV:
+            L = convert(L, ast::Type::DOUBLE), R = convert(R, ast::Type::DOUBLE);
             return Builder_->CreateFDiv(L, R, "divtmp");
         case ast::BinaryOp::LESS:
-            L = Builder_->CreateFCmpULT(L, R, "cmptmp");
-            // Convert bool 0/1 to double 0.0 or 1.0
-            return Builder_->CreateUIToFP(L, llvm::Type::getDoubleTy(*TheContext_), "booltmp");
+            return emitLess(L, R, nodes().typeOf(expr.LHS), nodes().typeOf(expr.RHS));
         default:
             break;
         }
 
         // If it wasn't a builtin binary operator, it must be a user defined one.
         // Emit a call to it.
-        if (llvm::Function *func = TheModule_->getFunction(std::string("binary") + ast::BinaryOp2Char(expr.Op)))
+        if (llvm::Function *func = getFunction(std::string("binary") + ast::BinaryOp2Char(expr.Op)))
         {
-            llvm::Value *ops[2] = {L, R};
+            llvm::Value *ops[2] = {convert(L, ast::Type::DOUBLE), convert(R, ast::Type::DOUBLE)};
             return Builder_->CreateCall(func, ops, "binop");
         }
 
@@ -621,10 +1534,67 @@ namespace hypertk
         return nullptr;
     }
 
+    llvm::Value *RuntimeLLVM::emitLess(llvm::Value *L, llvm::Value *R, ast::Type lhs, ast::Type rhs)
+    {
+        // Compare in the wider operand type, the result stays an `i1` until it is used as a number.
+        ast::Type operands = ast::join(ast::Type::INT, ast::join(lhs, rhs));
+        L = convert(L, operands), R = convert(R, operands);
+        return operands == ast::Type::INT ? Builder_->CreateICmpSLT(L, R, "cmptmp")
+                                          : Builder_->CreateFCmpULT(L, R, "cmptmp");
+    }
+
+    /// @details `a && b` branches around `b` when `a` is false and `a || b` when `a` is true,
+    /// the result is a `i1` merged from both paths.
+    llvm::Value *RuntimeLLVM::emitShortCircuit(const ast::expression::Binary &expr)
+    {
+        bool isOr = expr.Op == ast::BinaryOp::OR;
+
+        llvm::Value *L = visit(expr.LHS);
+        if (!L)
+            return nullptr;
+        L = toCondition(L, "lhscond");
+
+        llvm::Function *theFunction = Builder_->GetInsertBlock()->getParent();
+        llvm::BasicBlock *lhsBB = Builder_->GetInsertBlock();
+        llvm::BasicBlock *rhsBB = llvm::BasicBlock::Create(*TheContext_, isOr ? "or.rhs" : "and.rhs", theFunction);
+        llvm::BasicBlock *mergeBB = llvm::BasicBlock::Create(*TheContext_, isOr ? "or.end" : "and.end");
+
+        if (isOr)
+            Builder_->CreateCondBr(L, mergeBB, rhsBB);
+        else
+            Builder_->CreateCondBr(L, rhsBB, mergeBB);
+
+        Builder_->SetInsertPoint(rhsBB);
+        llvm::Value *R = visit(expr.RHS);
+        if (!R)
+            return nullptr;
+        R = toCondition(R, "rhscond");
+        Builder_->CreateBr(mergeBB);
+        // Codegen of the RHS can change the current block, update rhsBB for the PHI.
+        rhsBB = Builder_->GetInsertBlock();
+
+        theFunction->insert(theFunction->end(), mergeBB);
+        Builder_->SetInsertPoint(mergeBB);
+        llvm::PHINode *pn = Builder_->CreatePHI(getType(ast::Type::BOOL), 2, isOr ? "ortmp" : "andtmp");
+        // Skipping the RHS means the LHS already decided: true for `||`, false for `&&`.
+        pn->addIncoming(Builder_->getInt1(isOr), lhsBB);
+        pn->addIncoming(R, rhsBB);
+
+        return pn;
+    }
+
     llvm::Value *RuntimeLLVM::visitUnaryExpr(
         const ast::expression::Unary &expr)
     {
-        llvm::Function *func = TheModule_->getFunction(std::string("unary") + ast::UnaryOp2Char(expr.Op));
+        if (expr.Op == ast::UnaryOp::NOT)
+        {
+            llvm::Value *operandV = visit(expr.Operand);
+            if (!operandV)
+                return nullptr;
+            return Builder_->CreateNot(toCondition(operandV, "notcond"), "nottmp");
+        }
+
+        llvm::Function *func = getFunction(std::string("unary") + ast::UnaryOp2Char(expr.Op));
         if (!func)
         {
             logError("Unsupported unary operator.");
@@ -635,7 +1605,7 @@ namespace hypertk
         if (!operandV)
             return nullptr;
 
-        return Builder_->CreateCall(func, operandV, "unop");
+        return Builder_->CreateCall(func, convert(operandV, ast::Type::DOUBLE), "unop");
     }
 
     /// @details Using SSA `Phi operation`
@@ -645,10 +1615,8 @@ namespace hypertk
         llvm::Value *condV = visit(expr.Cond);
         if (!condV)
             return nullptr;
-        // Convert condition to a bool by comparing non-equal to 0.0
-        condV = Builder_->CreateFCmpONE(condV,
-                                        llvm::ConstantFP::get(*TheContext_, llvm::APFloat(0.0)),
-                                        "ifcond");
+        // Convert condition to a bool by comparing non-equal to 0
+        condV = toCondition(condV, "ifcond");
 
         llvm::Function *theFunction = Builder_->GetInsertBlock()->getParent();
 
@@ -666,6 +1634,7 @@ namespace hypertk
         llvm::Value *thenV = visit(expr.Then);
         if (!thenV)
             return nullptr;
+        thenV = convert(thenV, expr.Ty);
 
         Builder_->CreateBr(mergeBB); // create an unconditional branch to the merge block to finish `then` block.
         // Codegen of 'Then' can change the current block, update ThenBB for the PHI.
@@ -679,6 +1648,7 @@ namespace hypertk
         llvm::Value *elseV = visit(expr.Else);
         if (!elseV)
             return nullptr;
+        elseV = convert(elseV, expr.Ty);
 
         Builder_->CreateBr(mergeBB);
         // codegen of 'Else' can change the current block, update ElseBB for the PHI.
@@ -688,7 +1658,7 @@ namespace hypertk
         //> Emit merge block
         theFunction->insert(theFunction->end(), mergeBB);
         Builder_->SetInsertPoint(mergeBB);
-        llvm::PHINode *pn = Builder_->CreatePHI(llvm::Type::getDoubleTy(*TheContext_), 2, "iftmp");
+        llvm::PHINode *pn = Builder_->CreatePHI(getType(expr.Ty), 2, "iftmp");
         pn->addIncoming(thenV, thenBB);
         pn->addIncoming(elseV, elseBB);
         //<
@@ -700,37 +1670,202 @@ namespace hypertk
         const ast::expression::Call &expr)
     {
         // Look up the name in the global module table.
-        llvm::Function *calleeF = TheModule_->getFunction(expr.Callee->Name.lexeme);
+        std::string_view callee = nodes()[expr.Callee].Name.lexeme;
+        llvm::Function *calleeF = getFunction(std::string(callee));
+#ifdef ENABLE_BUILTIN_FUNCTIONS
+        if (!calleeF)
+            if (const builtin::MathFunction *math = builtin::findMathFunction(callee))
+                return emitMathCall(*math, expr);
+#endif
         if (!calleeF)
         {
-            logError(std::string("Unknown referenced function [ ") + expr.Callee->Name.lexeme + " ]");
+            logError("Unknown referenced function [ " + std::string(callee) + " ]");
             return nullptr;
         }
 
-        if (calleeF->arg_size() != expr.Args.size())
+        if (calleeF->arg_size() != expr.Args.Size)
         {
             logError(std::string("Expected ") + std::to_string(calleeF->arg_size()) +
-                     " arguments, got " + std::to_string(expr.Args.size()) + " arguments");
+                     " arguments, got " + std::to_string(expr.Args.Size) + " arguments");
             return nullptr;
         }
 
         std::vector<llvm::Value *> argsV;
-        for (unsigned i = 0, e = expr.Args.size(); i != e; ++i)
+        auto args = nodes()[expr.Args];
+        for (unsigned i = 0, e = args.size(); i != e; ++i)
         {
-            auto arg = visit(expr.Args[i]);
+            auto arg = visit(args[i]);
             if (!arg)
                 return nullptr;
-            argsV.push_back(arg);
+            argsV.push_back(convert(arg, ast::Type::DOUBLE));
         }
 
         return Builder_->CreateCall(calleeF, argsV, "calltmp");
     }
+
+#ifdef ENABLE_BUILTIN_FUNCTIONS
+    static llvm::Intrinsic::ID mathIntrinsic(builtin::Math op)
+    {
+        switch (op)
+        {
+        case builtin::Math::SQRT:
+            return llvm::Intrinsic::sqrt;
+        case builtin::Math::SIN:
+            return llvm::Intrinsic::sin;
+        case builtin::Math::COS:
+            return llvm::Intrinsic::cos;
+        case builtin::Math::EXP:
+            return llvm::Intrinsic::exp;
+        case builtin::Math::LOG:
+            return llvm::Intrinsic::log;
+        case builtin::Math::FABS:
+            return llvm::Intrinsic::fabs;
+        case builtin::Math::FLOOR:
+            return llvm::Intrinsic::floor;
+        case builtin::Math::CEIL:
+            return llvm::Intrinsic::ceil;
+        case builtin::Math::POW:
+            return llvm::Intrinsic::pow;
+        case builtin::Math::FMA:
+            return llvm::Intrinsic::fma;
+        }
+        return llvm::Intrinsic::not_intrinsic;
+    }
+
+    /// @details The intrinsics do not touch memory or `errno`, unlike a call to an external function
+    /// they are folded when their operands are constants and widened by the vectorizers.
+    llvm::Value *RuntimeLLVM::emitMathCall(const builtin::MathFunction &fn, const ast::expression::Call &expr)
+    {
+        if (fn.Arity != expr.Args.Size)
+        {
+            logError(std::string("Expected ") + std::to_string(fn.Arity) +
+                     " arguments, got " + std::to_string(expr.Args.Size) + " arguments");
+            return nullptr;
+        }
+
+        std::vector<llvm::Value *> argsV;
+        for (const auto &arg : nodes()[expr.Args])
+        {
+            llvm::Value *argV = visit(arg);
+            if (!argV)
+                return nullptr;
+            argsV.push_back(convert(argV, ast::Type::DOUBLE));
+        }
+
+        return Builder_->CreateIntrinsic(mathIntrinsic(fn.Op), {llvm::Type::getDoubleTy(*TheContext_)}, argsV,
+                                         nullptr, fn.Name);
+    }
+#endif
+
+    llvm::Value *RuntimeLLVM::visitIndexExpr(
+        const ast::expression::Index &expr)
+    {
+        llvm::Value *ptr = emitElementPtr(expr);
+        if (!ptr)
+            return nullptr;
+        return Builder_->CreateLoad(llvm::Type::getDoubleTy(*TheContext_), ptr, "elem");
+    }
+
+    llvm::Value *RuntimeLLVM::visitLengthExpr(
+        const ast::expression::Length &expr)
+    {
+        const ArrayInfo *array = resolveArray(nodes()[expr.Array].Name.symbol);
+        if (!array)
+            return nullptr;
+        return convert(array->Length, expr.Ty);
+    }
     //<
 
+    const RuntimeLLVM::ArrayInfo *RuntimeLLVM::resolveArray(symbol::Symbol name)
+    {
+        llvm::Value *data = resolveVariable(name);
+        auto array = data ? Arrays_.find(data) : Arrays_.end();
+        if (array == Arrays_.end())
+        {
+            logError("Unknown array [ " + std::string(symbol::name(name)) + " ]");
+            return nullptr;
+        }
+        return &array->second;
+    }
+
+    /// @details The check is a single unsigned compare, which catches negative indices as well.
+    /// The failing branch calls `hypertk_index_error`, which does not return, the optimizer keeps
+    /// it out of the hot path and can still vectorize a loop around a checked access.
+    llvm::Value *RuntimeLLVM::emitElementPtr(const ast::expression::Index &expr)
+    {
+        const ArrayInfo *array = resolveArray(nodes()[expr.Array].Name.symbol);
+        if (!array)
+            return nullptr;
+        llvm::Value *data = array->Data;
+        llvm::Value *length = array->Length;
+
+        llvm::Value *idx = visit(expr.Idx);
+        if (!idx)
+            return nullptr;
+        idx = toIndex(idx);
+
+        if (expr.Checked)
+        {
+            llvm::Function *theFunction = Builder_->GetInsertBlock()->getParent();
+            llvm::BasicBlock *failBB = llvm::BasicBlock::Create(*TheContext_, "outofbounds", theFunction);
+            llvm::BasicBlock *okBB = llvm::BasicBlock::Create(*TheContext_, "inbounds", theFunction);
+
+            llvm::Value *outOfBounds = Builder_->CreateICmpUGE(idx, length, "oob");
+            Builder_->CreateCondBr(outOfBounds, failBB, okBB, llvm::MDBuilder(*TheContext_).createBranchWeights(1, 1 << 20));
+
+            Builder_->SetInsertPoint(failBB);
+            llvm::Type *i64Ty = llvm::Type::getInt64Ty(*TheContext_);
+            llvm::Function *indexError = getRuntimeFunction("hypertk_index_error",
+                                                            llvm::FunctionType::get(llvm::Type::getVoidTy(*TheContext_), {i64Ty, i64Ty}, false));
+            indexError->setDoesNotReturn();
+            indexError->addFnAttr(llvm::Attribute::Cold);
+            Builder_->CreateCall(indexError, {idx, length});
+            Builder_->CreateUnreachable();
+
+            Builder_->SetInsertPoint(okBB);
+        }
+
+        return Builder_->CreateInBoundsGEP(llvm::Type::getDoubleTy(*TheContext_), data, idx, "elemptr");
+    }
+
+    llvm::Value *RuntimeLLVM::toIndex(llvm::Value *value)
+    {
+        llvm::Type *i64Ty = llvm::Type::getInt64Ty(*TheContext_);
+        // Unlike `fptosi`, the saturating conversion is defined for every double.
+        if (value->getType()->isDoubleTy())
+            return Builder_->CreateIntrinsic(llvm::Intrinsic::fptosi_sat, {i64Ty, value->getType()}, {value}, nullptr, "idx");
+        return convert(value, i64Ty);
+    }
+
+    void RuntimeLLVM::freeHeapArrays(size_t mark, bool pop)
+    {
+        if (!Builder_->GetInsertBlock()->getTerminator() && HeapArrays_.size() > mark)
+        {
+            llvm::Type *ptrTy = llvm::PointerType::getUnqual(*TheContext_);
+            llvm::Function *free_ = getRuntimeFunction("free", llvm::FunctionType::get(llvm::Type::getVoidTy(*TheContext_), {ptrTy}, false));
+            for (size_t i = HeapArrays_.size(); i > mark; --i)
+            {
+                llvm::AllocaInst *slot = HeapArrays_[i - 1];
+                Builder_->CreateCall(free_, Builder_->CreateLoad(ptrTy, slot));
+                // A later `return` in a loop running the declaration again must not free it twice.
+                if (pop)
+                    Builder_->CreateStore(llvm::ConstantPointerNull::get(llvm::PointerType::getUnqual(*TheContext_)), slot);
+            }
+        }
+
+        if (pop)
+            HeapArrays_.resize(mark);
+    }
+
+    llvm::Function *RuntimeLLVM::getRuntimeFunction(llvm::StringRef name, llvm::FunctionType *type)
+    {
+        return llvm::cast<llvm::Function>(TheModule_->getOrInsertFunction(name, type).getCallee());
+    }
+
     __attribute__((always_inline)) inline void RuntimeLLVM::beginScope() { scopes_.emplace_back(); }
     __attribute__((always_inline)) inline void RuntimeLLVM::endScope() { scopes_.pop_back(); }
     __attribute__((always_inline)) inline ScopeTable &RuntimeLLVM::currentScope() { return scopes_.back(); }
-    llvm::Value *RuntimeLLVM::resolveVariable(const std::string &varName)
+    llvm::Value *RuntimeLLVM::resolveVariable(symbol::Symbol varName)
     {
         if (!scopes_.empty())
             for (auto scope = scopes_.crbegin(); scope != scopes_.crend(); ++scope)
@@ -741,16 +1876,106 @@ namespace hypertk
             }
         return nullptr;
     }
+    llvm::Function *RuntimeLLVM::getFunction(const std::string &name)
+    {
+        if (llvm::Function *func = TheModule_->getFunction(name))
+            return func;
+
+        // The function was compiled into an earlier module, emit a declaration
+        // and let the JIT linker resolve it.
+        auto proto = FunctionProtos_.find(name);
+        if (proto != FunctionProtos_.end())
+            return declareFunction(name, proto->second);
+
+        return nullptr;
+    }
+    void RuntimeLLVM::startNextModule()
+    {
+        initializeModuleAndManagers();
+#ifdef ENABLE_BUILTIN_FUNCTIONS
+        declareBuiltInFunctions();
+#endif
+    }
+
+    llvm::TargetMachine *RuntimeLLVM::getTargetMachine() const
+    {
+#ifdef ENABLE_BASIC_JIT_COMPILER
+        return TheJIT_->getTargetMachine();
+#else
+        return TargetMachine_;
+#endif
+    }
+
+    llvm::Function *RuntimeLLVM::declareFunction(const std::string &name, unsigned arity)
+    {
+        if (llvm::Function *func = TheModule_->getFunction(name))
+            return func;
+
+        std::vector<llvm::Type *> Doubles(arity, llvm::Type::getDoubleTy(*TheContext_));
+        llvm::FunctionType *FT = llvm::FunctionType::get(llvm::Type::getDoubleTy(*TheContext_), Doubles, false);
+        return llvm::Function::Create(FT, llvm::Function::ExternalLinkage, name, TheModule_.get());
+    }
     llvm::AllocaInst *RuntimeLLVM::createEntryBlockAlloca(
         llvm::Function *theFunction,
-        llvm::StringRef varName)
+        llvm::StringRef varName,
+        ast::Type type)
+    {
+        return createEntryBlockAlloca(theFunction, varName, getType(type));
+    }
+    llvm::AllocaInst *RuntimeLLVM::createEntryBlockAlloca(
+        llvm::Function *theFunction,
+        llvm::StringRef varName,
+        llvm::Type *type)
     {
         llvm::IRBuilder<> tmpB(&theFunction->getEntryBlock(),
                                theFunction->getEntryBlock().begin());
-        return tmpB.CreateAlloca(llvm::Type::getDoubleTy(*TheContext_),
+        return tmpB.CreateAlloca(type,
                                  nullptr,
                                  varName);
     }
+    llvm::Type *RuntimeLLVM::getType(ast::Type type)
+    {
+        switch (type)
+        {
+        case ast::Type::BOOL:
+            return llvm::Type::getInt1Ty(*TheContext_);
+        case ast::Type::INT:
+            return llvm::Type::getInt64Ty(*TheContext_);
+        default:
+            return llvm::Type::getDoubleTy(*TheContext_);
+        }
+    }
+    llvm::Value *RuntimeLLVM::convert(llvm::Value *value, llvm::Type *type)
+    {
+        llvm::Type *from = value->getType();
+        if (from == type)
+            return value;
+
+        if (type->isIntegerTy(1))
+            return toCondition(value, "tobool");
+        if (type->isIntegerTy())
+        {
+            if (from->isIntegerTy())
+                return Builder_->CreateZExt(value, type, "toint");
+            return Builder_->CreateFPToSI(value, type, "toint");
+        }
+        // Booleans are 0 or 1, integers are signed.
+        if (from->isIntegerTy(1))
+            return Builder_->CreateUIToFP(value, type, "booltmp");
+        return Builder_->CreateSIToFP(value, type, "todouble");
+    }
+    __attribute__((always_inline)) inline llvm::Value *RuntimeLLVM::convert(llvm::Value *value, ast::Type type)
+    {
+        return convert(value, getType(type));
+    }
+    __attribute__((always_inline)) inline llvm::Value *RuntimeLLVM::toCondition(llvm::Value *value, const llvm::Twine &name)
+    {
+        if (value->getType()->isIntegerTy(1))
+            return value;
+        if (value->getType()->isIntegerTy())
+            return Builder_->CreateICmpNE(value, llvm::ConstantInt::get(value->getType(), 0), name);
+        return Builder_->CreateFCmpONE(value, llvm::ConstantFP::get(value->getType(), 0.0), name);
+    }
     __attribute__((always_inline)) inline void RuntimeLLVM::logError(const std::string &msg)
     {
         error::error(0, msg);
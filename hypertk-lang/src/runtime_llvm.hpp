@@ -3,12 +3,17 @@
 
 #include <memory>
 #include <map>
+#include <optional>
 #include <string>
 #include <vector>
 #include <unordered_map>
 
 #include "common.hpp"
 #include "ast.hpp"
+#include "symbol.hpp"
+#ifdef ENABLE_BUILTIN_FUNCTIONS
+#include "builtin.hpp"
+#endif
 #ifdef ENABLE_BASIC_JIT_COMPILER
 #include "jit.hpp"
 #endif
@@ -31,7 +36,7 @@
 
 namespace hypertk
 {
-    using ScopeTable = std::unordered_map<std::string, llvm::Value *>;
+    using ScopeTable = std::unordered_map<symbol::Symbol, llvm::Value *>;
 
     class RuntimeLLVM
         : private Uncopyable,
@@ -39,23 +44,112 @@ namespace hypertk
           protected ast::expression::Visitor<llvm::Value *>
     {
     public:
-        RuntimeLLVM();
+        /** @param optLevel optimization level 0..3, `0` skips the optimizer entirely */
+        explicit RuntimeLLVM(unsigned optLevel = 2);
 
         /** @brief Print LLVM IR */
         void printIR();
         /** @brief Compile AST to LLVM IR */
         llvm::Value *genIR(const ast::Program &program);
 
+        /**
+         * @brief Treat the program passed to `genIR` as the whole program.
+         * @details Every function but `main` and `exported` gets internal linkage, operator definitions are
+         * always inlined, and functions left without callers are dropped, also at `-O0`.
+         * @note Must be called before `initializeModuleAndManagers`.
+         */
+        void setWholeProgram(const std::vector<std::string> &exported);
         /** @brief Initialize module, compiler pass, ... */
         void initializeModuleAndManagers();
+        /** @brief Run the module optimization pipeline of the selected level on the current module, after instrumenting it or attaching the loaded profile */
+        void optimizeModule();
 #ifdef ENABLE_BASIC_JIT_COMPILER
         /** Eval the program */
         bool eval();
         /** Initialize JIT compiler */
-        void initializeJIT();
+        void initializeJIT(const JITOptions &opts = {});
+        /** @brief Suffix of the batch entry point of a function, see `compileFunctions` */
+        static constexpr const char *BatchSuffix = ".batch";
+
+        /**
+         * @brief Function the compiled code calls back into the host for, as long as it has no native code.
+         * @details The module gets an internal `double name(double, ...)` that calls `*Native` once it is
+         * set, and `Call(Host, Function, args)` with its arguments stored at `args` until then. Its name
+         * stays free, the function can be compiled later on.
+         */
+        struct HostFunction
+        {
+            std::string Name;
+            unsigned Arity;
+            /** @brief Native code of the function, `nullptr` while there is none */
+            void *const *Native;
+            double (*Call)(void *host, void *function, const double *args);
+            void *Host;
+            void *Function;
+        };
+
+        /**
+         * @brief Compile the given function definitions, whose nodes live in `nodes`, into their own module and hand it to the JIT.
+         * @note Functions already handed to the JIT by earlier calls are only declared in the new module.
+         * @param RT tracker owning the compiled code, the JIT dylib's default tracker when `nullptr`.
+         * @param batchEntries also emit `void <name>.batch(const double *const *args, double *out, int64_t n)`
+         * for every function, which computes `out[i] = name(args[0][i], ..., args[arity - 1][i])` for `i < n`.
+         * @param hostFunctions callees neither in `defs` nor compiled before.
+         */
+        bool compileFunctions(const ast::Arena &nodes,
+                              const std::vector<const ast::statement::Function *> &defs,
+                              llvm::orc::ResourceTrackerSP RT = nullptr,
+                              bool batchEntries = false,
+                              const std::vector<HostFunction> &hostFunctions = {});
+
+        /** @brief Variable in scope of a loop given to `compileLoop` */
+        struct LoopVariable
+        {
+            symbol::Symbol Name;
+            ast::Type Ty;
+        };
+
+        /**
+         * @brief Compile the rest of a loop running in the interpreter into `double name(double *vars)`, for on-stack replacement.
+         * @details `vars` holds the values of `variables`, then the loop variable after its step, then
+         * a flag. The code starts at the loop's end test and runs the loop to its end, stores the values
+         * of `variables` back and sets the flag to `1`. When the body returns instead, it returns the
+         * value and leaves the flag alone.
+         * @param hostFunctions callees not compiled yet, see `compileFunctions`.
+         * @return native address of the code, `nullptr` on error.
+         */
+        void *compileLoop(const ast::Arena &nodes,
+                          const ast::statement::For &loop,
+                          const std::string &name,
+                          const std::vector<LoopVariable> &variables,
+                          const std::vector<HostFunction> &hostFunctions);
+        /** @brief Create a resource tracker for `compileFunctions`, code compiled under it can be freed */
+        llvm::orc::ResourceTrackerSP createResourceTracker();
+        /**
+         * @brief Free the code compiled under `RT`, the functions `names` can be defined again afterwards.
+         * @warning Code still calling into the freed functions must not run anymore.
+         */
+        bool removeFunctions(const llvm::orc::ResourceTrackerSP &RT, const std::vector<std::string> &names);
+        /** @brief Number of parameters of a JIT compiled function, `std::nullopt` if not compiled */
+        std::optional<unsigned> getFunctionArity(const std::string &name) const;
+        /** @brief Return native address of a JIT compiled function, `nullptr` if not found */
+        void *lookupFunction(const std::string &name);
+        /** @brief Return the JIT object cache, `nullptr` if caching is disabled */
+        const ObjectCache *getObjectCache() const;
+        /**
+         * @brief Compile a top-level statement into an anonymous function of its own module and run it.
+         * @details The code of the anonymous function is freed right after it ran, so evaluating
+         * statements does not grow the JIT.
+         * @return value of an expression statement, `0` for other statements, `std::nullopt` on error.
+         */
+        std::optional<double> evalTopLevel(const ast::Arena &nodes, ast::statement::StmtRef stmt);
 #else
-        /// @brief Initialize AOT compiler
-        bool initializeAOT();
+        /**
+         * @brief Initialize AOT compiler
+         * @param cpu CPU to generate code for, `native` is the host CPU with all of its features.
+         * @param features comma separated CPU features added on top of the CPU's, e.g. `+avx2,-fma`.
+         */
+        bool initializeAOT(const std::string &cpu = "generic", const std::string &features = "");
 #endif
 #ifdef ENABLE_BUILTIN_FUNCTIONS
         /// @brief Compile code to .o file
@@ -67,6 +161,7 @@ namespace hypertk
         std::unique_ptr<llvm::LLVMContext> TheContext_ = nullptr;
         std::unique_ptr<llvm::IRBuilder<>> Builder_ = nullptr;
         std::unique_ptr<llvm::Module> TheModule_ = nullptr;
+        const unsigned OptLevel_;
         // std::map<std::string, llvm::AllocaInst *> NamedValues_;
         llvm::ExitOnError ExitOnErr;
 #ifdef ENABLE_BASIC_JIT_COMPILER
@@ -79,8 +174,8 @@ namespace hypertk
         llvm::TargetMachine *TargetMachine_ = nullptr;
 #endif
 #ifdef ENABLE_COMPILER_OPTIMIZATION_PASS
-        /** @brief the function pass manager */
-        std::unique_ptr<llvm::FunctionPassManager> TheFPM_ = nullptr;
+        /** @brief the module pass manager, `nullptr` at `-O0` */
+        std::unique_ptr<llvm::ModulePassManager> TheMPM_ = nullptr;
         /** @brief the loop analysis manager */
         std::unique_ptr<llvm::LoopAnalysisManager> TheLAM_ = nullptr;
         /** @brief function analysis manager */
@@ -95,11 +190,48 @@ namespace hypertk
         std::unique_ptr<llvm::StandardInstrumentations> TheSI_ = nullptr;
 #endif
         std::vector<ScopeTable> scopes_;
+        /** @brief Nodes of the statements being emitted */
+        const ast::Arena *nodes_ = nullptr;
+        /** @brief See `setWholeProgram` */
+        bool WholeProgram_ = false;
+        /** @brief Functions keeping external linkage in whole-program mode, besides `main` */
+        std::vector<std::string> Exported_;
+        /** @brief Loop `compileLoop` emits, it starts at `ResumedStart_` instead of its start expression */
+        const ast::statement::For *ResumedLoop_ = nullptr;
+        llvm::Value *ResumedStart_ = nullptr;
+        /** @brief Arity of functions living in modules that were already handed over to the JIT */
+        std::unordered_map<std::string, unsigned> FunctionProtos_;
+
+        /** @brief Arrays sized by a literal up to this many elements live on the stack, others on the heap */
+        static constexpr int64_t MaxStackArrayLength = 4096;
+        /** @brief Storage of an array variable, the scope maps its name to `Data` */
+        struct ArrayInfo
+        {
+            /** @brief Pointer to the first element */
+            llvm::Value *Data;
+            /** @brief Number of elements as `i64` */
+            llvm::Value *Length;
+        };
+        /** @brief Arrays of the function being emitted, keyed by their `Data` */
+        std::unordered_map<const llvm::Value *, ArrayInfo> Arrays_;
+        /** @brief Slots holding the heap arrays declared in the open scopes, `null` while not allocated */
+        std::vector<llvm::AllocaInst *> HeapArrays_;
+        /** @brief Variable a `parallel for` copies into the environment of its outlined body */
+        struct Capture
+        {
+            symbol::Symbol Name;
+            /** @brief Alloca of a scalar, `Data` of an array */
+            llvm::Value *Var;
+            /** @brief Storage of an array, `nullptr` for a scalar */
+            const ArrayInfo *Array;
+        };
 
     protected:
         using ast::expression::Visitor<llvm::Value *>::visit;
         using ast::statement::Visitor<llvm::Value *>::visit;
 
+        const ast::Arena &nodes() const override { return *nodes_; }
+
         //> statements
         llvm::Value *visitBlockStmt(const ast::statement::Block &stmt);
         llvm::Value *visitVarDeclStmt(const ast::statement::VarDecl &stmt);
@@ -119,16 +251,76 @@ namespace hypertk
         llvm::Value *visitUnaryExpr(const ast::expression::Unary &expr);
         llvm::Value *visitConditionalExpr(const ast::expression::Conditional &expr);
         llvm::Value *visitCallExpr(const ast::expression::Call &expr);
+        llvm::Value *visitIndexExpr(const ast::expression::Index &expr);
+        llvm::Value *visitLengthExpr(const ast::expression::Length &expr);
         //<
 
         inline void beginScope();
         inline void endScope();
         inline ScopeTable &currentScope();
-        llvm::Value *resolveVariable(const std::string &varName);
+        llvm::Value *resolveVariable(symbol::Symbol varName);
+        /** @brief Look up function in current module, declare it if it was compiled in an earlier module */
+        llvm::Function *getFunction(const std::string &name);
+        /** @brief Declare `double name(double, ...)` in current module */
+        llvm::Function *declareFunction(const std::string &name, unsigned arity);
         /// @brief Create an alloca instruction in the entry block of the function. This is used for mutable variables etc.
         llvm::AllocaInst *createEntryBlockAlloca(llvm::Function *theFunction,
-                                                 llvm::StringRef varName);
+                                                 llvm::StringRef varName,
+                                                 ast::Type type = ast::Type::DOUBLE);
+        llvm::AllocaInst *createEntryBlockAlloca(llvm::Function *theFunction,
+                                                 llvm::StringRef varName,
+                                                 llvm::Type *type);
+        /** @brief `i1`, `i64` or `double` */
+        llvm::Type *getType(ast::Type type);
+        /** @brief Convert a `i1`, `i64` or `double` value to another of these types */
+        llvm::Value *convert(llvm::Value *value, llvm::Type *type);
+        inline llvm::Value *convert(llvm::Value *value, ast::Type type);
+        /** @brief Convert a value to the `i1` a branch takes, any non-zero value is true */
+        inline llvm::Value *toCondition(llvm::Value *value, const llvm::Twine &name);
         inline void logError(const std::string &msg);
+#ifdef ENABLE_BASIC_JIT_COMPILER
+        /** @brief Emit the batch entry point of `fn`, see `compileFunctions` */
+        void emitBatchEntry(llvm::Function *fn);
+        /** @brief Emit the internal function calling `host`, see `HostFunction` */
+        void emitHostFunction(const HostFunction &host);
+#endif
+        /** @brief Allocate a zeroed array, on the stack if its length is a small literal, else on the heap */
+        llvm::Value *declareArray(const ast::statement::VarDecl &stmt);
+        /** @brief Look up the storage of an array variable, `nullptr` for unknown names and scalars */
+        const ArrayInfo *resolveArray(symbol::Symbol name);
+        /** @brief Emit the address of an array element, behind a bounds check unless the analyzer proved it in bounds */
+        llvm::Value *emitElementPtr(const ast::expression::Index &expr);
+        /** @brief Convert an index or array size to `i64`, fractions are truncated and NaN is `0` */
+        llvm::Value *toIndex(llvm::Value *value);
+        /** @brief Free the heap arrays declared since `HeapArrays_` had `mark` slots, forget them if `pop` */
+        void freeHeapArrays(size_t mark, bool pop);
+        /** @brief Declare a C runtime function used by the generated code, such as `calloc` */
+        llvm::Function *getRuntimeFunction(llvm::StringRef name, llvm::FunctionType *type);
+        /** @brief Emit a `parallel for` as a call of `hypertk_parallel_for` with its outlined body */
+        llvm::Value *emitParallelFor(const ast::statement::For &stmt);
+        /** @brief Outline the body of a `parallel for` into a function running a range of its iterations */
+        llvm::Function *emitParallelBody(const ast::statement::For &stmt, llvm::StringRef parent,
+                                         llvm::StructType *envTy, const std::vector<Capture> &captures);
+        /** @brief Set the target CPU and features of the module on a function definition */
+        void addTargetAttributes(llvm::Function *fn);
+        /** @brief Emit `&&` and `||`, evaluating the RHS only when the LHS does not decide the result */
+        llvm::Value *emitShortCircuit(const ast::expression::Binary &expr);
+        /** @brief Emit `L < R` compared in the wider of the operand types, as a `i1` */
+        llvm::Value *emitLess(llvm::Value *L, llvm::Value *R, ast::Type lhs, ast::Type rhs);
+#ifdef ENABLE_BUILTIN_FUNCTIONS
+        /** @brief Emit a call to a builtin math function as the LLVM intrinsic of the same name */
+        llvm::Value *emitMathCall(const builtin::MathFunction &fn, const ast::expression::Call &expr);
+#endif
+        /** @brief Emit `ret expr`, marking calls in tail position as tail calls */
+        llvm::Value *emitReturn(ast::expression::ExprRef expr);
+        /** @brief Give every function defined in the module but the exported ones internal linkage */
+        void internalizeModule();
+        /** @brief Let the inliner always inline an operator definition in whole-program mode */
+        llvm::Value *markOperator(llvm::Value *fn);
+        /** @brief Open a fresh module once the current one was handed to the JIT or dropped */
+        void startNextModule();
+        /** @brief Target machine code is generated for, by the JIT or the AOT compiler */
+        llvm::TargetMachine *getTargetMachine() const;
     };
 } // namespace codegen
 
@@ -1,28 +1,104 @@
+#include <algorithm>
+
 #include "semantic_analyzer.hpp"
 #include "error.hpp"
+#ifdef ENABLE_PARALLEL_FRONTEND
+#include "parallel.hpp"
+#endif
 
 namespace semantic_analysis
 {
+    /** @brief Largest magnitude up to which a double holds every integer exactly */
+    static constexpr int64_t MaxExactInteger = (int64_t)1 << 53;
+    /** @brief Bound of `len`, the elements of an allocated array fit in the 48-bit address space */
+    static constexpr int64_t MaxArrayLength = (int64_t)1 << 45;
+    /** @brief Passes a variable's values may grow in, then it is counting in a loop and unbounded */
+    static constexpr unsigned WideningPasses = 3;
+
     BasicSemanticAnalyzer::BasicSemanticAnalyzer(const ast::Program &program)
-        : program_{program} {}
+        : program_{program}, nodes_{program.Nodes} {}
 
     bool BasicSemanticAnalyzer::analyze()
+    {
+#ifdef ENABLE_PARALLEL_FRONTEND
+        // An error is found again in order, and reported as only the first one is.
+        if (analyzeInParallel())
+            return true;
+#endif
+
+        return inferTypes(
+            [this]
+            {
+                beginScope();
+                for (const auto &stmt : program_.Statements)
+                    if (!visit(stmt))
+                        return false;
+                endScope();
+
+                return true;
+            });
+    }
+
+#ifdef ENABLE_PARALLEL_FRONTEND
+    /** @brief Fewest top level functions analyzed on the thread pool */
+    static constexpr size_t ParallelMinFunctions = 256;
+
+    /// @details Functions only share the names of the top level functions, which hold no type.
+    /// Each chunk of the pool analyzes its functions with an analyzer of its own, which declares
+    /// a function above the analyzed one when its name is first used, so none is declared twice
+    /// and no binding is shared between threads.
+    bool BasicSemanticAnalyzer::analyzeInParallel()
+    {
+        const auto &stmts = program_.Statements;
+        if (stmts.size() < ParallelMinFunctions || parallel::threadCount() < 2)
+            return false;
+
+        std::unordered_map<symbol::Symbol, size_t> functions;
+        for (size_t i = 0; i < stmts.size(); ++i)
+        {
+            const auto *fn = ast::statement::functionOf(nodes_, stmts[i]);
+            // A function defined twice is reported in order.
+            if (!fn || !functions.emplace(fn->Name.symbol, i).second)
+                return false;
+        }
+
+        struct Job
+        {
+            const ast::Program *Program;
+            const std::unordered_map<symbol::Symbol, size_t> *Functions;
+        } job{&program_, &functions};
+
+        double failures = parallel::run(
+            [](int64_t first, int64_t last, void *env) -> double
+            {
+                const Job &job = *(const Job *)env;
+                error::Capture capture;
+                BasicSemanticAnalyzer analyzer(*job.Program);
+                analyzer.functions_ = job.Functions;
+                return analyzer.analyzeFunctions(first, last) && !capture.caught() ? 0 : 1;
+            },
+            &job, (int64_t)stmts.size());
+        return failures == 0;
+    }
+
+    bool BasicSemanticAnalyzer::analyzeFunctions(size_t first, size_t last)
     {
         beginScope();
-        for (const auto &stmt : program_)
-            if (!visit(stmt))
+        for (function_ = first; function_ < last; ++function_)
+            if (!visit(program_.Statements[function_]))
                 return false;
         endScope();
 
         return true;
     }
+#endif
 
     //> Print statements
     bool BasicSemanticAnalyzer::visitBlockStmt(
         const ast::statement::Block &stmt)
     {
         beginScope();
-        for (const auto &stmt_ : stmt.Statements)
+        for (const auto &stmt_ : nodes_[stmt.Statements])
             if (!visit(stmt_))
                 return false;
         endScope();
@@ -33,10 +109,34 @@ namespace semantic_analysis
     bool BasicSemanticAnalyzer::visitVarDeclStmt(
         const ast::statement::VarDecl &stmt)
     {
-        if (!declare(stmt.VarName))
-            return false;
-        if (stmt.Initializer.has_value() && !visit(stmt.Initializer.value()))
+        if (stmt.isArray())
+        {
+            if (!declare(stmt.VarName) || !visit(stmt.Size.value()))
+                return false;
+            scopes_.back()[stmt.VarName.symbol].Array = &stmt;
+            return define(stmt.VarName);
+        }
+
+        // A variable without initializer starts as the narrowest type, its assignments widen it.
+        if (pass_ == 0)
+        {
+            stmt.Ty = ast::Type::BOOL;
+            values_.erase(&stmt.Ty);
+        }
+
+        if (!declare(stmt.VarName, &stmt.Ty))
             return false;
+        if (stmt.Initializer.has_value())
+        {
+            if (!visit(stmt.Initializer.value()))
+                return false;
+            store(stmt.Ty, nodes_.typeOf(stmt.Initializer.value()), range_);
+        }
+        else
+        {
+            // It starts as `0`.
+            store(stmt.Ty, ast::Type::BOOL, ValueRange{0, 0});
+        }
         if (!define(stmt.VarName))
             return false;
 
@@ -58,7 +158,7 @@ namespace semantic_analysis
         if (!declare(stmt.Name) || !define(stmt.Name))
             return false;
 
-        if (stmt.Params.size() != 2)
+        if (stmt.Params.Size != 2)
         {
             error::error(stmt.Name, "Binary operator must have 2 operands");
             return false;
@@ -73,7 +173,7 @@ namespace semantic_analysis
         if (!declare(stmt.Name) || !define(stmt.Name))
             return false;
 
-        if (stmt.Params.size() != 1)
+        if (stmt.Params.Size != 1)
         {
             error::error(stmt.Name, "Unary operator must have 1 operand");
             return false;
@@ -91,6 +191,11 @@ namespace semantic_analysis
     bool BasicSemanticAnalyzer::visitReturnStmt(
         const ast::statement::Return &stmt)
     {
+        if (parallelLoop_)
+        {
+            error::error(parallelLoop_->VarName, "Cannot return from the body of a parallel loop.");
+            return false;
+        }
         return visit(stmt.Expr);
     }
 
@@ -109,14 +214,66 @@ namespace semantic_analysis
     bool BasicSemanticAnalyzer::visitForStmt(
         const ast::statement::For &stmt)
     {
+        if (pass_ == 0)
+        {
+            stmt.Ty = ast::Type::BOOL;
+            stmt.VarAssigned = false;
+            values_.erase(&stmt.Ty);
+        }
+
         beginScope();
-        if (!declare(stmt.VarName) ||
+        if (!declare(stmt.VarName, &stmt.Ty) ||
             !define(stmt.VarName) ||
-            !visit(stmt.Start) ||
-            !visit(stmt.End) ||
-            !visit(stmt.Step) ||
-            !visit(stmt.Body))
+            !visit(stmt.Start))
+            return false;
+        widen(stmt.Ty, nodes_.typeOf(stmt.Start));
+
+        Binding &counter = scopes_.back()[stmt.VarName.symbol];
+        counter.Loop = &stmt;
+        counter.Range = counterRange(stmt);
+        // The counter is an integer only while its values are known, not with a bound read from a
+        // variable, nor when the body assigns it.
+        std::optional<ValueRange> values;
+        if (counter.Range && !stmt.VarAssigned)
+            values = counterValues(*counter.Range, constantValue(stmt.Step).value());
+        store(stmt.Ty, ast::Type::INT, values);
+
+        // Whatever the step and the bound read must keep its value through the whole loop to be hoisted.
+        std::vector<std::pair<const Binding *, unsigned>> stepReads, boundReads;
+        bool stepPure = collectReads(stmt.Step, stepReads);
+        const auto *cond = nodes_.getIf<ast::expression::Binary>(stmt.End);
+        const auto *condVar = cond && cond->Op == ast::BinaryOp::LESS
+                                  ? nodes_.getIf<ast::expression::Variable>(cond->LHS)
+                                  : nullptr;
+        bool boundPure = condVar && condVar->Name.symbol == stmt.VarName.symbol &&
+                         collectReads(cond->RHS, boundReads);
+
+        if (!visit(stmt.End) || !visit(stmt.Step))
+            return false;
+        // The variable is incremented by the step.
+        widen(stmt.Ty, nodes_.typeOf(stmt.Step));
+
+        if (stmt.Reduce.has_value() && !reduceInto(stmt))
+            return false;
+
+        // Iterations of a parallel loop run concurrently, they may only assign their own variables.
+        const auto *outerLoop = parallelLoop_;
+        const size_t outerDepth = parallelDepth_;
+        if (stmt.Parallel)
+            parallelLoop_ = &stmt, parallelDepth_ = counter.Depth;
+        bool bodyOk = visit(stmt.Body);
+        parallelLoop_ = outerLoop, parallelDepth_ = outerDepth;
+        if (!bodyOk)
+            return false;
+
+        stmt.StepInvariant = stepPure && unchanged(stepReads, counter);
+        stmt.BoundInvariant = boundPure && unchanged(boundReads, counter);
+        if (stmt.Parallel && (!stmt.StepInvariant || !stmt.BoundInvariant || stmt.VarAssigned))
+        {
+            error::error(stmt.VarName, "A parallel loop needs the condition `" + std::string(stmt.VarName.lexeme) +
+                                           " < bound`, with a bound and step the loop does not change, and cannot assign its variable.");
             return false;
+        }
         endScope();
         return true;
     }
@@ -124,15 +281,27 @@ namespace semantic_analysis
 
     //> Print expressions
     bool BasicSemanticAnalyzer::visitNumberExpr(
-        const ast::expression::Number &expr) { return true; }
+        const ast::expression::Number &expr)
+    {
+        setInteger(expr.Ty, expr.IsInteger ? std::optional<ValueRange>({(int64_t)expr.Val, (int64_t)expr.Val}) : std::nullopt);
+        return true;
+    }
 
     bool BasicSemanticAnalyzer::visitVariableExpr(
         const ast::expression::Variable &expr)
     {
-        if (!scopes_.empty())
-            for (auto scope = scopes_.crbegin(); scope != scopes_.crend(); ++scope)
-                if (scope->find(expr.Name.lexeme) != scope->end())
-                    return true;
+        if (Binding *binding = resolve(expr.Name.symbol))
+        {
+            if (binding->Array)
+            {
+                error::error(expr.Name, "An array is not a value, index it or take its len().");
+                return false;
+            }
+
+            expr.Ty = binding->Ty ? *binding->Ty : ast::Type::DOUBLE;
+            range_ = valuesOf(*binding);
+            return true;
+        }
 
         error::error(expr.Name, "Unknown variable");
         return false;
@@ -141,19 +310,96 @@ namespace semantic_analysis
     bool BasicSemanticAnalyzer::visitBinaryExpr(
         const ast::expression::Binary &expr)
     {
-        return visit(expr.LHS) && visit(expr.RHS);
+        if (!visit(expr.LHS))
+            return false;
+        std::optional<ValueRange> lhsValues = range_;
+        if (!visit(expr.RHS))
+            return false;
+        std::optional<ValueRange> rhsValues = range_;
+
+        ast::Type rhs = nodes_.typeOf(expr.RHS);
+        range_ = std::nullopt;
+        switch (expr.Op)
+        {
+        case ast::BinaryOp::ADD:
+        case ast::BinaryOp::SUB:
+        case ast::BinaryOp::MUL:
+            // Booleans are added as `0` and `1`.
+            setInteger(expr.Ty, arithmetic(expr.Op, lhsValues, rhsValues));
+            break;
+        case ast::BinaryOp::DIV:
+            // `1 / 2` is `0.5`, never an integer division.
+            expr.Ty = ast::Type::DOUBLE;
+            break;
+        case ast::BinaryOp::LESS:
+        case ast::BinaryOp::AND:
+        case ast::BinaryOp::OR:
+            expr.Ty = ast::Type::BOOL;
+            range_ = ValueRange{0, 1};
+            break;
+        case ast::BinaryOp::EQUAL:
+        {
+            expr.Ty = ast::Type::DOUBLE;
+            // A non-variable destination is reported by the code generator, array elements are doubles.
+            if (const auto *var = nodes_.getIf<ast::expression::Variable>(expr.LHS))
+                if (Binding *binding = resolve(var->Name.symbol))
+                {
+                    if (binding->Depth < parallelDepth_)
+                    {
+                        error::error(var->Name, "The body of a parallel loop cannot assign a variable declared outside of it, sum into one with `reduce`.");
+                        return false;
+                    }
+                    binding->Stores++;
+                    if (binding->Ty)
+                    {
+                        store(*binding->Ty, rhs, rhsValues);
+                        expr.Ty = *binding->Ty;
+                        range_ = valuesOf(*binding);
+                    }
+                    // Like a type, the flag only goes one way, another pass sees it before the body reads the counter.
+                    if (binding->Loop && !binding->Loop->VarAssigned)
+                    {
+                        binding->Loop->VarAssigned = true;
+                        changed_ = true;
+                    }
+                }
+            break;
+        }
+        default:
+            // User defined operators are functions, which take and return doubles.
+            expr.Ty = ast::Type::DOUBLE;
+            break;
+        }
+
+        return true;
     }
 
     bool BasicSemanticAnalyzer::visitUnaryExpr(
         const ast::expression::Unary &expr)
     {
-        return visit(expr.Operand);
+        if (!visit(expr.Operand))
+            return false;
+
+        expr.Ty = expr.Op == ast::UnaryOp::NOT ? ast::Type::BOOL : ast::Type::DOUBLE;
+        range_ = expr.Op == ast::UnaryOp::NOT ? std::optional<ValueRange>({0, 1}) : std::nullopt;
+        return true;
     }
 
     bool BasicSemanticAnalyzer::visitConditionalExpr(
         const ast::expression::Conditional &expr)
     {
-        return visit(expr.Cond) && visit(expr.Then) && visit(expr.Else);
+        if (!visit(expr.Cond) || !visit(expr.Then))
+            return false;
+        std::optional<ValueRange> thenValues = range_;
+        if (!visit(expr.Else))
+            return false;
+        std::optional<ValueRange> elseValues = range_;
+
+        expr.Ty = ast::join(nodes_.typeOf(expr.Then), nodes_.typeOf(expr.Else));
+        range_ = std::nullopt;
+        if (thenValues && elseValues)
+            range_ = ValueRange{std::min(thenValues->Min, elseValues->Min), std::max(thenValues->Max, elseValues->Max)};
+        return true;
     }
 
     bool BasicSemanticAnalyzer::visitCallExpr(
@@ -161,44 +407,395 @@ namespace semantic_analysis
     {
         // if (!visitVariableExpr(*expr.Callee))
         //     return false;
+        expr.Ty = ast::Type::DOUBLE;
 
-        for (const auto &expr_ : expr.Args)
+        for (const auto &expr_ : nodes_[expr.Args])
             if (!visit(expr_))
                 return false;
 
+        range_ = std::nullopt;
         return true;
     }
+
+    bool BasicSemanticAnalyzer::visitIndexExpr(
+        const ast::expression::Index &expr)
+    {
+        Binding *array = resolveArray(nodes_[expr.Array]);
+        if (!array || !visit(expr.Idx))
+            return false;
+
+        expr.Ty = ast::Type::DOUBLE;
+        expr.Checked = !provenInBounds(expr.Idx, *array->Array);
+        range_ = std::nullopt;
+        return true;
+    }
+
+    bool BasicSemanticAnalyzer::visitLengthExpr(
+        const ast::expression::Length &expr)
+    {
+        expr.Ty = ast::Type::INT;
+        range_ = ValueRange{0, MaxArrayLength};
+        return resolveArray(nodes_[expr.Array]) != nullptr;
+    }
     //<
 
+    BasicSemanticAnalyzer::Binding *BasicSemanticAnalyzer::resolveArray(const ast::expression::Variable &name)
+    {
+        Binding *binding = resolve(name.Name.symbol);
+        if (!binding)
+        {
+            error::error(name.Name, "Unknown variable");
+            return nullptr;
+        }
+        if (!binding->Array)
+        {
+            error::error(name.Name, "Only an array can be indexed or have a len().");
+            return nullptr;
+        }
+
+        return binding;
+    }
+
+    std::optional<int64_t> BasicSemanticAnalyzer::constantValue(ast::expression::ExprRef expr)
+    {
+        if (const auto *number = nodes_.getIf<ast::expression::Number>(expr))
+            return number->IsInteger ? std::optional<int64_t>((int64_t)number->Val) : std::nullopt;
+
+        if (const auto *length = nodes_.getIf<ast::expression::Length>(expr))
+        {
+            Binding *array = resolve(nodes_[length->Array].Name.symbol);
+            return array && array->Array ? array->Array->fixedLength(nodes_) : std::nullopt;
+        }
+
+        if (const auto *binary = nodes_.getIf<ast::expression::Binary>(expr))
+        {
+            auto lhs = constantValue(binary->LHS);
+            auto rhs = lhs ? constantValue(binary->RHS) : std::nullopt;
+            if (!rhs)
+                return std::nullopt;
+
+            int64_t result;
+            bool overflow;
+            switch (binary->Op)
+            {
+            case ast::BinaryOp::ADD:
+                overflow = __builtin_add_overflow(*lhs, *rhs, &result);
+                break;
+            case ast::BinaryOp::SUB:
+                overflow = __builtin_sub_overflow(*lhs, *rhs, &result);
+                break;
+            case ast::BinaryOp::MUL:
+                overflow = __builtin_mul_overflow(*lhs, *rhs, &result);
+                break;
+            default:
+                return std::nullopt;
+            }
+            return overflow ? std::nullopt : std::optional<int64_t>(result);
+        }
+
+        return std::nullopt;
+    }
+
+    /// @details A loop `for i = start, i < bound, step` runs its body while the counter is below
+    /// the bound, with a step that is not negative the body sees the values `start` to `bound - 1`.
+    std::optional<BasicSemanticAnalyzer::CounterRange> BasicSemanticAnalyzer::counterRange(const ast::statement::For &loop)
+    {
+        const auto *cond = nodes_.getIf<ast::expression::Binary>(loop.End);
+        if (!cond || cond->Op != ast::BinaryOp::LESS)
+            return std::nullopt;
+        const auto *var = nodes_.getIf<ast::expression::Variable>(cond->LHS);
+        if (!var || var->Name.symbol != loop.VarName.symbol)
+            return std::nullopt;
+
+        auto start = constantValue(loop.Start);
+        auto step = constantValue(loop.Step);
+        if (!start || !step || *step < 0)
+            return std::nullopt;
+
+        ast::expression::ExprRef bound = cond->RHS;
+        int64_t last;
+        if (auto value = constantValue(bound))
+        {
+            if (__builtin_sub_overflow(*value, 1, &last))
+                return std::nullopt;
+            return CounterRange{*start, last};
+        }
+
+        // `len(a)` or `len(a) - c` of an array sized at run time
+        ast::expression::ExprRef length = bound;
+        int64_t offset = 0;
+        if (const auto *sub = nodes_.getIf<ast::expression::Binary>(bound); sub && sub->Op == ast::BinaryOp::SUB)
+        {
+            auto c = constantValue(sub->RHS);
+            if (!c || __builtin_sub_overflow(0, *c, &offset))
+                return std::nullopt;
+            length = sub->LHS;
+        }
+        const auto *len = nodes_.getIf<ast::expression::Length>(length);
+        if (!len || __builtin_sub_overflow(offset, 1, &last))
+            return std::nullopt;
+        const Binding *array = resolve(nodes_[len->Array].Name.symbol);
+        if (!array || !array->Array)
+            return std::nullopt;
+        return CounterRange{*start, last, array->Array};
+    }
+
+    bool BasicSemanticAnalyzer::provenInBounds(ast::expression::ExprRef idx, const ast::statement::VarDecl &array)
+    {
+        const auto *var = nodes_.getIf<ast::expression::Variable>(idx);
+        if (!var)
+            return false;
+
+        // The counter only takes the values of its range as long as the body leaves it alone.
+        const Binding *counter = resolve(var->Name.symbol);
+        if (!counter || !counter->Loop || counter->Loop->VarAssigned || !counter->Range || counter->Range->First < 0)
+            return false;
+
+        if (counter->Range->Array)
+            return counter->Range->Array == &array && counter->Range->Last < 0;
+        auto length = array.fixedLength(nodes_);
+        return length && counter->Range->Last < *length;
+    }
+
+    /// @details The sum is added to the variable after the loop, as a `double`.
+    bool BasicSemanticAnalyzer::reduceInto(const ast::statement::For &loop)
+    {
+        const ast::expression::Variable &target = nodes_[loop.Reduce.value()];
+        Binding *binding = resolve(target.Name.symbol);
+        if (!binding || binding->Array || binding->Loop == &loop || binding->Depth < parallelDepth_)
+        {
+            error::error(target.Name, "Can only reduce into a variable declared outside of the loop, which is not an array.");
+            return false;
+        }
+
+        binding->Stores++;
+        if (binding->Ty)
+            widen(*binding->Ty, ast::Type::DOUBLE);
+        target.Ty = ast::Type::DOUBLE;
+        return true;
+    }
+
+    bool BasicSemanticAnalyzer::collectReads(ast::expression::ExprRef expr,
+                                             std::vector<std::pair<const Binding *, unsigned>> &reads)
+    {
+        if (nodes_.is<ast::expression::Number>(expr) || nodes_.is<ast::expression::Length>(expr))
+            return true;
+
+        if (const auto *var = nodes_.getIf<ast::expression::Variable>(expr))
+        {
+            const Binding *binding = resolve(var->Name.symbol);
+            if (!binding || binding->Array)
+                return false;
+            reads.emplace_back(binding, binding->Stores);
+            return true;
+        }
+
+        if (const auto *binary = nodes_.getIf<ast::expression::Binary>(expr))
+        {
+            switch (binary->Op)
+            {
+            case ast::BinaryOp::ADD:
+            case ast::BinaryOp::SUB:
+            case ast::BinaryOp::MUL:
+            case ast::BinaryOp::DIV:
+            case ast::BinaryOp::LESS:
+            case ast::BinaryOp::AND:
+            case ast::BinaryOp::OR:
+                return collectReads(binary->LHS, reads) && collectReads(binary->RHS, reads);
+            default:
+                // Assignments and user defined operators, which are calls.
+                return false;
+            }
+        }
+
+        if (const auto *unary = nodes_.getIf<ast::expression::Unary>(expr))
+            return ast::isBuiltinUnaryOp(unary->Op) && collectReads(unary->Operand, reads);
+
+        if (const auto *conditional = nodes_.getIf<ast::expression::Conditional>(expr))
+            return collectReads(conditional->Cond, reads) &&
+                   collectReads(conditional->Then, reads) &&
+                   collectReads(conditional->Else, reads);
+
+        // Calls may have side effects, array elements may be stored to.
+        return false;
+    }
+
+    bool BasicSemanticAnalyzer::unchanged(const std::vector<std::pair<const Binding *, unsigned>> &reads,
+                                          const Binding &counter)
+    {
+        return std::all_of(reads.begin(), reads.end(),
+                           [&](const auto &read)
+                           {
+                               return read.first != &counter && read.first->Stores == read.second;
+                           });
+    }
+
     inline bool BasicSemanticAnalyzer::resolveFunctionBody(
         const ast::statement::Function &stmt)
     {
-        beginScope();
-        for (const auto &param : stmt.Params)
-            if (!declare(param) || !define(param))
-                return false;
-        for (const auto &stmt_ : stmt.Body)
-            if (!visit(stmt_))
+        return inferTypes(
+            [&]
+            {
+                beginScope();
+                for (const auto &param : nodes_[stmt.Params])
+                    if (!declare(param) || !define(param))
+                        return false;
+                for (const auto &stmt_ : nodes_[stmt.Body])
+                    if (!visit(stmt_))
+                        return false;
+                endScope();
+
+                return true;
+            });
+    }
+    template <class Visit>
+    bool BasicSemanticAnalyzer::inferTypes(Visit visitAll)
+    {
+        // Function bodies are inferred on their own while the enclosing program is.
+        unsigned outerPass = pass_;
+        bool outerChanged = changed_;
+
+        pass_ = 0;
+        do
+        {
+            changed_ = false;
+            if (!visitAll())
                 return false;
-        endScope();
+            ++pass_;
+        } while (changed_);
 
+        pass_ = outerPass;
+        changed_ = outerChanged;
         return true;
     }
+    inline void BasicSemanticAnalyzer::widen(ast::Type &slot, ast::Type ty)
+    {
+        ast::Type joined = ast::join(slot, ty);
+        if (joined != slot)
+        {
+            slot = joined;
+            changed_ = true;
+        }
+    }
+    /// @details A variable whose values still grow after `WideningPasses` passes is counted up or
+    /// down by a loop, its values are not bounded and it becomes a `DOUBLE`.
+    void BasicSemanticAnalyzer::store(ast::Type &slot, ast::Type ty, std::optional<ValueRange> range)
+    {
+        widen(slot, range ? ty : ast::Type::DOUBLE);
+        if (slot == ast::Type::DOUBLE)
+            return;
+
+        auto [values, inserted] = values_.try_emplace(&slot, *range);
+        if (inserted)
+            return;
+        ValueRange joined{std::min(values->second.Min, range->Min), std::max(values->second.Max, range->Max)};
+        if (joined.Min == values->second.Min && joined.Max == values->second.Max)
+            return;
+        if (pass_ >= WideningPasses || joined.Min < -MaxExactInteger || joined.Max > MaxExactInteger)
+        {
+            widen(slot, ast::Type::DOUBLE);
+            return;
+        }
+        values->second = joined;
+        changed_ = true;
+    }
+    std::optional<BasicSemanticAnalyzer::ValueRange> BasicSemanticAnalyzer::valuesOf(const Binding &binding) const
+    {
+        if (!binding.Ty || *binding.Ty == ast::Type::DOUBLE)
+            return std::nullopt;
+        auto values = values_.find(binding.Ty);
+        return values != values_.end() ? std::optional<ValueRange>(values->second) : std::nullopt;
+    }
+    inline void BasicSemanticAnalyzer::setInteger(ast::Type &ty, std::optional<ValueRange> range)
+    {
+        if (range && range->Min >= -MaxExactInteger && range->Max <= MaxExactInteger)
+        {
+            ty = ast::Type::INT;
+            range_ = range;
+        }
+        else
+        {
+            ty = ast::Type::DOUBLE;
+            range_ = std::nullopt;
+        }
+    }
+    std::optional<BasicSemanticAnalyzer::ValueRange> BasicSemanticAnalyzer::arithmetic(ast::BinaryOp op,
+                                                                                      std::optional<ValueRange> lhs,
+                                                                                      std::optional<ValueRange> rhs)
+    {
+        if (!lhs || !rhs)
+            return std::nullopt;
+
+        int64_t bounds[4];
+        bool overflow = false;
+        switch (op)
+        {
+        case ast::BinaryOp::ADD:
+            overflow |= __builtin_add_overflow(lhs->Min, rhs->Min, &bounds[0]);
+            overflow |= __builtin_add_overflow(lhs->Max, rhs->Max, &bounds[1]);
+            return overflow ? std::nullopt : std::optional<ValueRange>({bounds[0], bounds[1]});
+        case ast::BinaryOp::SUB:
+            overflow |= __builtin_sub_overflow(lhs->Min, rhs->Max, &bounds[0]);
+            overflow |= __builtin_sub_overflow(lhs->Max, rhs->Min, &bounds[1]);
+            return overflow ? std::nullopt : std::optional<ValueRange>({bounds[0], bounds[1]});
+        case ast::BinaryOp::MUL:
+            // Either bound of the product is one of the products of the bounds.
+            overflow |= __builtin_mul_overflow(lhs->Min, rhs->Min, &bounds[0]);
+            overflow |= __builtin_mul_overflow(lhs->Min, rhs->Max, &bounds[1]);
+            overflow |= __builtin_mul_overflow(lhs->Max, rhs->Min, &bounds[2]);
+            overflow |= __builtin_mul_overflow(lhs->Max, rhs->Max, &bounds[3]);
+            if (overflow)
+                return std::nullopt;
+            return ValueRange{*std::min_element(bounds, bounds + 4), *std::max_element(bounds, bounds + 4)};
+        default:
+            return std::nullopt;
+        }
+    }
+    /// @details The body sees `First` to `Last`, the condition also sees `First` and the value
+    /// stepped past `Last`.
+    std::optional<BasicSemanticAnalyzer::ValueRange> BasicSemanticAnalyzer::counterValues(const CounterRange &range,
+                                                                                         int64_t step)
+    {
+        int64_t last = range.Last;
+        if (range.Array && __builtin_add_overflow(last, MaxArrayLength, &last))
+            return std::nullopt;
+        int64_t max;
+        if (__builtin_add_overflow(last, step, &max))
+            return std::nullopt;
+        return ValueRange{range.First, std::max(range.First, max)};
+    }
+    inline BasicSemanticAnalyzer::Binding *BasicSemanticAnalyzer::resolve(symbol::Symbol name)
+    {
+        for (auto scope = scopes_.rbegin(); scope != scopes_.rend(); ++scope)
+            if (auto binding = scope->find(name); binding != scope->end())
+                return &binding->second;
+#ifdef ENABLE_PARALLEL_FRONTEND
+        if (functions_)
+            if (auto fn = functions_->find(name); fn != functions_->end() && fn->second < function_)
+            {
+                Binding &binding = scopes_.front()[name] = {true, nullptr};
+                binding.Depth = 1;
+                return &binding;
+            }
+#endif
+        return nullptr;
+    }
     inline void BasicSemanticAnalyzer::beginScope() { scopes_.emplace_back(); }
     inline void BasicSemanticAnalyzer::endScope() { scopes_.pop_back(); }
-    inline bool BasicSemanticAnalyzer::declare(const token::Token &name)
+    inline bool BasicSemanticAnalyzer::declare(const token::Token &name, ast::Type *ty)
     {
         if (scopes_.empty())
             return false;
 
         auto &scope = scopes_.back();
-        if (scope.find(name.lexeme) != scope.end())
+        if (scope.find(name.symbol) != scope.end())
         {
             error::error(name.line, "Already a variable with this name in this scope.");
             return false;
         }
 
-        scope[name.lexeme] = false;
+        Binding &binding = scope[name.symbol] = {false, ty};
+        binding.Depth = scopes_.size();
         return true;
     }
     inline bool BasicSemanticAnalyzer::define(const token::Token &name)
@@ -206,7 +803,7 @@ namespace semantic_analysis
         if (scopes_.empty())
             return false;
 
-        scopes_.back()[name.lexeme] = true;
+        scopes_.back()[name.symbol].Defined = true;
         return true;
     }
 } // namespace hypertk
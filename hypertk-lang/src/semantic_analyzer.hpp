@@ -1,15 +1,31 @@
 #ifndef HYPERTK_SEMANTIC_ANALYZER_HPP
 #define HYPERTK_SEMANTIC_ANALYZER_HPP
 
+#include <cstdint>
+#include <optional>
+#include <utility>
 #include <vector>
 #include <unordered_map>
 #include <string>
 
 #include "common.hpp"
 #include "ast.hpp"
+#include "symbol.hpp"
 
 namespace semantic_analysis
 {
+    /**
+     * @brief Resolve names and infer the static type of every variable and expression.
+     * @details Types are written into the `Ty` annotations of the AST. A variable gets the join of
+     * its initializer and of every value assigned to it, since an assignment further down a loop
+     * body can widen a variable read above it, each function body is analyzed until no variable
+     * type changes anymore. The types only ever widen, so this takes at most a few passes.
+     *
+     * An expression is an `INT` only when the values it can take are known and a double holds each
+     * of them exactly, so integer code computes what the interpreter computes in doubles and never
+     * overflows. Literals, `len`, loop counters with a constant start, step and bound, and the sums,
+     * differences and products of those qualify, so do the variables only assigned such values.
+     */
     class BasicSemanticAnalyzer
         : private Uncopyable,
           protected ast::statement::Visitor<bool>,
@@ -22,13 +38,79 @@ namespace semantic_analysis
         bool analyze();
 
     private:
+        /**
+         * @brief Values a loop body sees its counter take: `First` to `Last`, or to `len(Array) + Last`
+         * when the bound is the length of an array sized at run time.
+         */
+        struct CounterRange
+        {
+            int64_t First;
+            int64_t Last;
+            const ast::statement::VarDecl *Array = nullptr;
+        };
+
+        /** @brief Values an `INT` or `BOOL` expression or variable can take */
+        struct ValueRange
+        {
+            int64_t Min;
+            int64_t Max;
+        };
+
+        struct Binding
+        {
+            bool Defined;
+            /** @brief Type annotation of the declaration, `nullptr` for parameters and functions which are always `DOUBLE` */
+            ast::Type *Ty;
+            /** @brief Declaration of an array, `nullptr` for scalars */
+            const ast::statement::VarDecl *Array = nullptr;
+            /** @brief Loop the variable counts, `nullptr` for other variables */
+            const ast::statement::For *Loop = nullptr;
+            /** @brief Range of a loop counter, if start and step are constant and the bound is constant or a `len` */
+            std::optional<CounterRange> Range;
+            /** @brief Assignments to the variable seen so far in the current pass */
+            unsigned Stores = 0;
+            /** @brief Number of scopes open where the variable is declared */
+            size_t Depth = 0;
+        };
+
         const ast::Program &program_;
-        std::vector<std::unordered_map<std::string, bool>> scopes_;
+        const ast::Arena &nodes_;
+        std::vector<std::unordered_map<symbol::Symbol, Binding>> scopes_;
+        /** @brief Inference pass over the current function body, annotations are reset in pass `0` */
+        unsigned pass_ = 0;
+        /** @brief A variable type or the values of a variable were widened during the current pass */
+        bool changed_ = false;
+        /** @brief Values of the expression visited last, `std::nullopt` for a `DOUBLE` */
+        std::optional<ValueRange> range_;
+        /** @brief Values of every `INT` or `BOOL` variable by its type annotation, joined over the passes */
+        std::unordered_map<const ast::Type *, ValueRange> values_;
+        /** @brief Innermost `parallel for` whose body is being visited */
+        const ast::statement::For *parallelLoop_ = nullptr;
+        /** @brief Depth of the counter of `parallelLoop_`, `0` outside of a parallel loop */
+        size_t parallelDepth_ = 0;
+#ifdef ENABLE_PARALLEL_FRONTEND
+        /** @brief Index of the top level function of each name while functions are analyzed apart, `nullptr` otherwise */
+        const std::unordered_map<symbol::Symbol, size_t> *functions_ = nullptr;
+        /** @brief Index of the top level function being analyzed apart */
+        size_t function_ = 0;
+#endif
+
+#ifdef ENABLE_PARALLEL_FRONTEND
+        /**
+         * @brief Analyze the functions of a program made only of function definitions on the thread pool.
+         * @return `false` if the program is small, holds anything else or has an error.
+         */
+        bool analyzeInParallel();
+        /** @brief Analyze the top level functions `first` to `last - 1`, the names of the ones above each are declared on use */
+        bool analyzeFunctions(size_t first, size_t last);
+#endif
 
     protected:
         using ast::statement::Visitor<bool>::visit;
         using ast::expression::Visitor<bool>::visit;
 
+        const ast::Arena &nodes() const override { return nodes_; }
+
         //> Print statements
         bool visitBlockStmt(const ast::statement::Block &stmt);
         bool visitVarDeclStmt(const ast::statement::VarDecl &stmt);
@@ -48,12 +130,47 @@ namespace semantic_analysis
         bool visitUnaryExpr(const ast::expression::Unary &expr);
         bool visitConditionalExpr(const ast::expression::Conditional &expr);
         bool visitCallExpr(const ast::expression::Call &expr);
+        bool visitIndexExpr(const ast::expression::Index &expr);
+        bool visitLengthExpr(const ast::expression::Length &expr);
         //<
 
         inline bool resolveFunctionBody(const ast::statement::Function &stmt);
+        /** @brief Run `visitAll` until the variable types it infers do not change anymore */
+        template <class Visit>
+        bool inferTypes(Visit visitAll);
+        /** @brief Widen the type of a variable to hold `ty` too */
+        inline void widen(ast::Type &slot, ast::Type ty);
+        /** @brief Widen the type and the values of a variable to hold a value of type `ty` taking the values `range` */
+        void store(ast::Type &slot, ast::Type ty, std::optional<ValueRange> range);
+        /** @brief Values of a variable, `std::nullopt` if it is a `DOUBLE` */
+        std::optional<ValueRange> valuesOf(const Binding &binding) const;
+        /** @brief Type an arithmetic expression taking the values `range`: an `INT` if they are known and exact in a double */
+        inline void setInteger(ast::Type &ty, std::optional<ValueRange> range);
+        /** @brief Values of `lhs op rhs` for `+`, `-` and `*`, `std::nullopt` if either is unknown or it overflows */
+        static std::optional<ValueRange> arithmetic(ast::BinaryOp op, std::optional<ValueRange> lhs, std::optional<ValueRange> rhs);
+        /** @brief Values the counter of a loop takes, in its body and in its condition once stepped past the bound */
+        static std::optional<ValueRange> counterValues(const CounterRange &range, int64_t step);
+        inline Binding *resolve(symbol::Symbol name);
+        /** @brief Resolve the array an index or `len` refers to, report an error if it is not one */
+        Binding *resolveArray(const ast::expression::Variable &name);
+        /** @brief Value of an integer constant: a literal, `len` of a fixed-size array or `+`, `-`, `*` of those */
+        std::optional<int64_t> constantValue(ast::expression::ExprRef expr);
+        /** @brief Values the body of a loop sees its counter take, see `CounterRange` */
+        std::optional<CounterRange> counterRange(const ast::statement::For &loop);
+        /**
+         * @brief Collect the variables a side effect free expression reads along with their store counts.
+         * @return `false` if the expression calls, assigns, indexes an array or names an unknown variable.
+         */
+        bool collectReads(ast::expression::ExprRef expr, std::vector<std::pair<const Binding *, unsigned>> &reads);
+        /** @brief None of the variables in `reads` was assigned since they were collected, nor is it `counter` */
+        static bool unchanged(const std::vector<std::pair<const Binding *, unsigned>> &reads, const Binding &counter);
+        /** @brief Check and widen the variable a `parallel for ... reduce` sums into */
+        bool reduceInto(const ast::statement::For &loop);
+        /** @brief The index is a loop counter which provably stays within the array */
+        bool provenInBounds(ast::expression::ExprRef idx, const ast::statement::VarDecl &array);
         inline void beginScope();
         inline void endScope();
-        inline bool declare(const token::Token &name);
+        inline bool declare(const token::Token &name, ast::Type *ty = nullptr);
         inline bool define(const token::Token &name);
     };
 } // namespace hypertk
@@ -0,0 +1,71 @@
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "symbol.hpp"
+
+namespace symbol
+{
+    /** @brief Interned names of the process or of a `Table` */
+    struct Names
+    {
+        /** @brief Text of every symbol, indexed by `Symbol - 1`. A deque never moves its elements, the views stay valid. */
+        std::deque<std::string> Texts;
+        /** @brief Keys are views into `Texts` */
+        std::unordered_map<std::string_view, Symbol> Symbols;
+
+        Symbol intern(std::string_view name)
+        {
+            if (auto sym = Symbols.find(name); sym != Symbols.end())
+                return sym->second;
+
+            const std::string &text = Texts.emplace_back(name);
+            Symbol sym = (Symbol)Texts.size();
+            Symbols.emplace(text, sym);
+            return sym;
+        }
+
+        std::string_view name(Symbol sym) const
+        {
+            return sym == None ? std::string_view{} : Texts[sym - 1];
+        }
+    };
+
+    static Names process_;
+    /** @brief Table the thread interns into, `nullptr` for the one of the process */
+    static thread_local Names *table_ = nullptr;
+
+    Symbol intern(std::string_view name)
+    {
+        return (table_ ? *table_ : process_).intern(name);
+    }
+
+    std::string_view name(Symbol sym)
+    {
+        return (table_ ? *table_ : process_).name(sym);
+    }
+
+    Table::Table() : names_{std::make_unique<Names>()} {}
+
+    Table::~Table() = default;
+
+    std::vector<Symbol> Table::publish() const
+    {
+        std::vector<Symbol> symbols{None};
+        symbols.reserve(names_->Texts.size() + 1);
+        for (const std::string &text : names_->Texts)
+            symbols.push_back(intern(text));
+        return symbols;
+    }
+
+    InternInto::InternInto(Table &table) : outer_{table_}
+    {
+        table_ = table.names_.get();
+    }
+
+    InternInto::~InternInto()
+    {
+        table_ = outer_;
+    }
+} // namespace symbol
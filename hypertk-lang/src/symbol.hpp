@@ -0,0 +1,67 @@
+#ifndef HYPERTK_SYMBOL_HPP
+#define HYPERTK_SYMBOL_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "common.hpp"
+
+/**
+ * @brief Interned identifiers.
+ * @details Every distinct name gets a small integer the first time it is seen, the lexer interns
+ * each identifier once and the parser, analyzer, interpreter and code generator key their scopes
+ * by it, so a name is hashed and compared as a string only in the lexer. The text of an interned
+ * name lives as long as the process, tokens and AST nodes refer to it without owning a copy.
+ * @note The names of the process are not thread-safe, they are interned on the thread parsing
+ * the program. A thread parsing part of a program interns into a `Table` of its own instead.
+ */
+namespace symbol
+{
+    using Symbol = uint32_t;
+
+    /** @brief No symbol, e.g. of a token which is not an identifier */
+    inline constexpr Symbol None = 0;
+
+    /** @brief Symbol of `name`, interning it on its first use */
+    Symbol intern(std::string_view name);
+    /** @brief Text of an interned symbol, valid until the process exits */
+    std::string_view name(Symbol sym);
+
+    struct Names;
+
+    /**
+     * @brief Names interned apart from the process, e.g. by a thread parsing part of a program.
+     * @details A table numbers its symbols from 1 in the order the names were first interned into
+     * it, and `publish` interns them into the process in that order. Publishing the tables of the
+     * consecutive parts of a source in order numbers the names as lexing the whole source does.
+     * The texts of a table live as long as the table.
+     */
+    class Table : private Uncopyable
+    {
+    public:
+        Table();
+        ~Table();
+
+        /** @brief Intern the names into the process, return the process symbol of every symbol of the table, indexed by it */
+        std::vector<Symbol> publish() const;
+
+    private:
+        friend class InternInto;
+        std::unique_ptr<Names> names_;
+    };
+
+    /** @brief The thread interns into `table` while it lives, symbols are then those of the table */
+    class InternInto : private Uncopyable
+    {
+    public:
+        explicit InternInto(Table &table);
+        ~InternInto();
+
+    private:
+        Names *outer_;
+    };
+} // namespace symbol
+
+#endif
\ No newline at end of file
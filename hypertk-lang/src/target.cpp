@@ -0,0 +1,57 @@
+#include <string>
+#include <vector>
+
+#include "target.hpp"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/TargetParser/Host.h"
+
+namespace hypertk
+{
+    std::string TargetSpec::featureString() const
+    {
+        std::string out;
+        for (const auto &feature : Features)
+        {
+            if (!out.empty())
+                out += ',';
+            out += feature;
+        }
+        return out;
+    }
+
+    TargetSpec resolveTarget(const std::string &cpu, const std::string &attrs)
+    {
+        TargetSpec spec;
+
+        if (cpu == "native")
+        {
+            spec.CPU = llvm::sys::getHostCPUName().str();
+
+            llvm::StringMap<bool> hostFeatures;
+            if (llvm::sys::getHostCPUFeatures(hostFeatures))
+                for (const auto &feature : hostFeatures)
+                    spec.Features.push_back((feature.second ? "+" : "-") + feature.first().str());
+        }
+        else
+            spec.CPU = cpu;
+
+        // Explicit features come last so they override the ones of the CPU.
+        llvm::SmallVector<llvm::StringRef, 16> userFeatures;
+        llvm::StringRef(attrs).split(userFeatures, ',', -1, /* KeepEmpty */ false);
+        for (auto feature : userFeatures)
+        {
+            feature = feature.trim();
+            if (feature.empty())
+                continue;
+            if (feature[0] == '+' || feature[0] == '-')
+                spec.Features.push_back(feature.str());
+            else
+                spec.Features.push_back("+" + feature.str());
+        }
+
+        return spec;
+    }
+} // namespace hypertk
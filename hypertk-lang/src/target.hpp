@@ -0,0 +1,28 @@
+#ifndef HYPERTK_TARGET_HPP
+#define HYPERTK_TARGET_HPP
+
+#include <string>
+#include <vector>
+
+namespace hypertk
+{
+    /** @brief CPU and CPU features to generate code for */
+    struct TargetSpec
+    {
+        std::string CPU;
+        /** @brief Features in `+name` / `-name` form */
+        std::vector<std::string> Features;
+
+        /** @brief Features joined by `,`, as expected by `llvm::Target::createTargetMachine` */
+        std::string featureString() const;
+    };
+
+    /**
+     * @brief Resolve `--mcpu` / `--mattr` values.
+     * @param cpu CPU name, `native` selects the host CPU together with every feature it supports.
+     * @param attrs comma separated features, e.g. `+avx2,+fma,-avx512f`, applied on top of the CPU's.
+     */
+    TargetSpec resolveTarget(const std::string &cpu, const std::string &attrs);
+} // namespace hypertk
+
+#endif
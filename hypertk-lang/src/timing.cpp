@@ -0,0 +1,350 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "timing.hpp"
+
+#include "llvm/ADT/Any.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Analysis/LazyCallGraph.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+
+namespace timing
+{
+    using Clock = std::chrono::steady_clock;
+
+    namespace detail
+    {
+        bool enabled_ = false;
+    } // namespace detail
+
+    static constexpr const char *PhaseNames[] = {"lex", "parse", "analyze", "codegen", "optimize", "jit-link", "emit", "execute"};
+    static constexpr size_t PhaseCount = sizeof(PhaseNames) / sizeof(PhaseNames[0]);
+
+    struct PassStats
+    {
+        double Seconds = 0;
+        unsigned Runs = 0;
+        uint64_t InstrBefore = 0;
+        uint64_t InstrAfter = 0;
+    };
+
+    struct FunctionStats
+    {
+        /** @brief Time spent in function and loop passes on this function */
+        double Seconds = 0;
+        uint64_t InstrBefore = 0;
+        uint64_t InstrAfter = 0;
+    };
+
+    /** @brief A phase or pass being timed, paused while a nested one runs */
+    template <class T>
+    struct Running
+    {
+        T What;
+        Clock::time_point Start;
+    };
+
+    struct RunningPass
+    {
+        std::string Pass;
+        std::string Function;
+        uint64_t InstrBefore;
+    };
+
+    /** @brief The thread measures phases, the one which enabled timing */
+    static thread_local bool timed_ = false;
+    static double phases_[PhaseCount] = {};
+    static std::vector<Running<Phase>> runningPhases_;
+    static std::map<std::string, PassStats> passes_;
+    static std::map<std::string, FunctionStats> functions_;
+    static std::vector<Running<RunningPass>> runningPasses_;
+    /** @brief Time one clock read takes, taken off every sample of a `SampledPhase` */
+    static double clockOverhead_ = 0;
+
+    static inline double seconds(Clock::time_point from, Clock::time_point to)
+    {
+        return std::chrono::duration<double>(to - from).count();
+    }
+
+    void enable()
+    {
+        detail::enabled_ = true;
+        timed_ = true;
+
+        // Cheapest of a few back to back clock reads, a lower bound of what reading it costs.
+        clockOverhead_ = 1;
+        for (int i = 0; i < 16; ++i)
+        {
+            auto start = Clock::now();
+            clockOverhead_ = std::min(clockOverhead_, seconds(start, Clock::now()));
+        }
+    }
+
+    //> phases
+    void detail::push(Phase phase)
+    {
+        if (!timed_)
+            return;
+
+        auto now = Clock::now();
+        if (!runningPhases_.empty())
+            phases_[(size_t)runningPhases_.back().What] += seconds(runningPhases_.back().Start, now);
+        runningPhases_.push_back({phase, now});
+    }
+
+    void detail::pop()
+    {
+        if (!timed_)
+            return;
+
+        auto now = Clock::now();
+        phases_[(size_t)runningPhases_.back().What] += seconds(runningPhases_.back().Start, now);
+        runningPhases_.pop_back();
+        if (!runningPhases_.empty())
+            runningPhases_.back().Start = now;
+    }
+
+    void detail::charge(Phase phase, Clock::time_point start, unsigned times)
+    {
+        if (!timed_)
+            return;
+
+        auto now = Clock::now();
+        // The clock reads are in the sample too, they would be scaled with it.
+        double estimate = std::max(0.0, seconds(start, now) - clockOverhead_) * times;
+
+        // An estimate may exceed what the running phase has spent so far, e.g. when a cold first
+        // sample is scaled up, keep its time from going negative.
+        if (!runningPhases_.empty())
+        {
+            const Running<Phase> &running = runningPhases_.back();
+            estimate = std::min(estimate, phases_[(size_t)running.What] + seconds(running.Start, now));
+            phases_[(size_t)running.What] -= estimate;
+        }
+        phases_[(size_t)phase] += estimate;
+    }
+    //<
+
+    //> passes
+    /** @brief Pass managers, adaptors and wrappers only run other passes, timing them would count twice */
+    static bool isPassContainer(llvm::StringRef pass)
+    {
+        return pass.contains("PassManager") ||
+               pass.contains("PassAdaptor") ||
+               pass.contains("AnalysisManagerProxy") ||
+               pass.contains("ModuleInlinerWrapperPass") ||
+               pass.contains("DevirtSCCRepeatedPass");
+    }
+
+    static uint64_t countInstructions(const llvm::Any &IR)
+    {
+        if (const auto *M = llvm::any_cast<const llvm::Module *>(&IR))
+            return (*M)->getInstructionCount();
+        if (const auto *F = llvm::any_cast<const llvm::Function *>(&IR))
+            return (*F)->getInstructionCount();
+        if (const auto *C = llvm::any_cast<const llvm::LazyCallGraph::SCC *>(&IR))
+        {
+            uint64_t count = 0;
+            for (const llvm::LazyCallGraph::Node &N : **C)
+                count += N.getFunction().getInstructionCount();
+            return count;
+        }
+        if (const auto *L = llvm::any_cast<const llvm::Loop *>(&IR))
+        {
+            uint64_t count = 0;
+            for (const llvm::BasicBlock *BB : (*L)->blocks())
+                count += BB->size();
+            return count;
+        }
+        return 0;
+    }
+
+    /** @brief Function a function or loop pass runs on, empty for module and CGSCC passes */
+    static std::string functionName(const llvm::Any &IR)
+    {
+        if (const auto *F = llvm::any_cast<const llvm::Function *>(&IR))
+            return (*F)->getName().str();
+        if (const auto *L = llvm::any_cast<const llvm::Loop *>(&IR))
+            return (*L)->getHeader()->getParent()->getName().str();
+        return "";
+    }
+
+    static void beginPass(llvm::StringRef pass, const llvm::Any &IR)
+    {
+        auto now = Clock::now();
+        if (!runningPasses_.empty())
+        {
+            const auto &outer = runningPasses_.back();
+            passes_[outer.What.Pass].Seconds += seconds(outer.Start, now);
+            if (!outer.What.Function.empty())
+                functions_[outer.What.Function].Seconds += seconds(outer.Start, now);
+        }
+        RunningPass running{pass.str(), functionName(IR), countInstructions(IR)};
+        runningPasses_.push_back({std::move(running), Clock::now()});
+    }
+
+    static void endPass(Clock::time_point now, const uint64_t *instrAfter)
+    {
+        const auto &running = runningPasses_.back();
+        double elapsed = seconds(running.Start, now);
+
+        PassStats &stats = passes_[running.What.Pass];
+        stats.Seconds += elapsed;
+        stats.Runs++;
+        stats.InstrBefore += running.What.InstrBefore;
+        // An invalidated IR unit (e.g. a deleted function) has no instructions left.
+        stats.InstrAfter += instrAfter ? *instrAfter : 0;
+        if (!running.What.Function.empty())
+            functions_[running.What.Function].Seconds += elapsed;
+
+        runningPasses_.pop_back();
+        if (!runningPasses_.empty())
+            runningPasses_.back().Start = Clock::now();
+    }
+
+    void registerPassCallbacks(llvm::PassInstrumentationCallbacks &PIC)
+    {
+        PIC.registerBeforeNonSkippedPassCallback(
+            [](llvm::StringRef pass, llvm::Any IR)
+            {
+                if (!isPassContainer(pass))
+                    beginPass(pass, IR);
+            });
+        PIC.registerAfterPassCallback(
+            [](llvm::StringRef pass, llvm::Any IR, const llvm::PreservedAnalyses &)
+            {
+                if (isPassContainer(pass))
+                    return;
+                // Stop the clock first, counting is not part of the pass.
+                auto now = Clock::now();
+                uint64_t instrAfter = countInstructions(IR);
+                endPass(now, &instrAfter);
+            });
+        PIC.registerAfterPassInvalidatedCallback(
+            [](llvm::StringRef pass, const llvm::PreservedAnalyses &)
+            {
+                if (!isPassContainer(pass))
+                    endPass(Clock::now(), nullptr);
+            });
+    }
+
+    void beforeOptimize(const llvm::Module &M)
+    {
+        for (const llvm::Function &F : M)
+            if (!F.isDeclaration())
+                functions_[F.getName().str()].InstrBefore += F.getInstructionCount();
+    }
+
+    void afterOptimize(const llvm::Module &M)
+    {
+        for (const llvm::Function &F : M)
+            if (!F.isDeclaration())
+                functions_[F.getName().str()].InstrAfter += F.getInstructionCount();
+    }
+    //<
+
+    //> report
+    template <class Stats>
+    static std::vector<std::pair<std::string, Stats>> sortedByTime(const std::map<std::string, Stats> &stats)
+    {
+        std::vector<std::pair<std::string, Stats>> sorted(stats.begin(), stats.end());
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const auto &a, const auto &b)
+                         {
+                             return a.second.Seconds > b.second.Seconds;
+                         });
+        return sorted;
+    }
+
+    static void reportText(llvm::raw_ostream &os)
+    {
+        double total = 0;
+        os << "===== Phases =====\n";
+        for (size_t i = 0; i < PhaseCount; ++i)
+        {
+            os << llvm::format("  %-10s %12.3f ms\n", PhaseNames[i], phases_[i] * 1e3);
+            total += phases_[i];
+        }
+        os << llvm::format("  %-10s %12.3f ms\n", (const char *)"total", total * 1e3);
+
+        os << "===== Passes =====\n"
+           << "     time (ms)   runs  instrs in instrs out  pass\n";
+        for (const auto &[name, stats] : sortedByTime(passes_))
+            os << llvm::format("  %12.3f %6u %10llu %10llu  %s\n",
+                               stats.Seconds * 1e3,
+                               stats.Runs,
+                               (unsigned long long)stats.InstrBefore,
+                               (unsigned long long)stats.InstrAfter,
+                               name.c_str());
+
+        os << "===== Functions =====\n"
+           << "     time (ms)  instrs in instrs out  function\n";
+        for (const auto &[name, stats] : sortedByTime(functions_))
+            os << llvm::format("  %12.3f %10llu %10llu  %s\n",
+                               stats.Seconds * 1e3,
+                               (unsigned long long)stats.InstrBefore,
+                               (unsigned long long)stats.InstrAfter,
+                               name.c_str());
+    }
+
+    static void reportJSON(llvm::raw_ostream &os)
+    {
+        llvm::json::OStream J(os, 2);
+        J.object(
+            [&]
+            {
+                J.attributeObject("phases_ms",
+                                  [&]
+                                  {
+                                      for (size_t i = 0; i < PhaseCount; ++i)
+                                          J.attribute(PhaseNames[i], phases_[i] * 1e3);
+                                  });
+                J.attributeArray("passes",
+                                 [&]
+                                 {
+                                     for (const auto &[name, stats] : sortedByTime(passes_))
+                                         J.object(
+                                             [&]
+                                             {
+                                                 J.attribute("name", name);
+                                                 J.attribute("ms", stats.Seconds * 1e3);
+                                                 J.attribute("runs", (int64_t)stats.Runs);
+                                                 J.attribute("instrs_before", (int64_t)stats.InstrBefore);
+                                                 J.attribute("instrs_after", (int64_t)stats.InstrAfter);
+                                             });
+                                 });
+                J.attributeArray("functions",
+                                 [&]
+                                 {
+                                     for (const auto &[name, stats] : sortedByTime(functions_))
+                                         J.object(
+                                             [&]
+                                             {
+                                                 J.attribute("name", name);
+                                                 J.attribute("ms", stats.Seconds * 1e3);
+                                                 J.attribute("instrs_before", (int64_t)stats.InstrBefore);
+                                                 J.attribute("instrs_after", (int64_t)stats.InstrAfter);
+                                             });
+                                 });
+            });
+        os << "\n";
+    }
+
+    void report(llvm::raw_ostream &os, Format format)
+    {
+        if (format == Format::JSON)
+            reportJSON(os);
+        else
+            reportText(os);
+        os.flush();
+    }
+    //<
+} // namespace timing
@@ -0,0 +1,117 @@
+#ifndef HYPERTK_TIMING_HPP
+#define HYPERTK_TIMING_HPP
+
+#include <chrono>
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/Support/raw_ostream.h"
+
+/**
+ * @brief Compile pipeline timing: phase times, per-pass and per-function optimizer statistics.
+ * @details Everything is off until `enable` is called, a disabled `ScopedPhase` only tests
+ * one flag and no pass callbacks are registered. Phases are measured on the thread which called
+ * `enable`, a `ScopedPhase` on another thread, e.g. one parsing functions on the pool, times nothing.
+ */
+namespace timing
+{
+    enum class Phase
+    {
+        LEX,
+        PARSE,
+        ANALYZE,
+        CODEGEN,
+        OPTIMIZE,
+        JIT_LINK,
+        EMIT,
+        EXECUTE,
+    };
+
+    enum class Format
+    {
+        TEXT,
+        JSON,
+    };
+
+    namespace detail
+    {
+        extern bool enabled_;
+
+        void push(Phase phase);
+        void pop();
+        /** @brief Move `times` the time since `start` from the running phase to `phase` */
+        void charge(Phase phase, std::chrono::steady_clock::time_point start, unsigned times);
+    } // namespace detail
+
+    void enable();
+    inline bool enabled() { return detail::enabled_; }
+
+    /**
+     * @brief Charge the wall time of the enclosing scope to a phase.
+     * @note Phases nest: time spent in an inner phase is not charged to the outer one, so the
+     * phase times add up to the measured total.
+     */
+    class ScopedPhase
+    {
+    public:
+        explicit ScopedPhase(Phase phase) : active_{enabled()}
+        {
+            if (active_)
+                detail::push(phase);
+        }
+        ~ScopedPhase()
+        {
+            if (active_)
+                detail::pop();
+        }
+
+        ScopedPhase(const ScopedPhase &) = delete;
+        ScopedPhase &operator=(const ScopedPhase &) = delete;
+
+    private:
+        const bool active_;
+    };
+
+    /**
+     * @brief Charge a scope entered too often to time every entry, e.g. lexing one token, to a phase.
+     * @details One in `Rate` entries is timed and counts `Rate` times, the estimate is taken off the
+     * running phase so the phase times still add up to the total. Other entries only count.
+     */
+    class SampledPhase
+    {
+    public:
+        static constexpr unsigned Rate = 64;
+
+        /** @param entries Entries of the scope so far, kept by its owner */
+        SampledPhase(Phase phase, unsigned &entries) : phase_{phase}, active_{enabled() && ++entries % Rate == 0}
+        {
+            if (active_)
+                start_ = std::chrono::steady_clock::now();
+        }
+        ~SampledPhase()
+        {
+            if (active_)
+                detail::charge(phase_, start_, Rate);
+        }
+
+        SampledPhase(const SampledPhase &) = delete;
+        SampledPhase &operator=(const SampledPhase &) = delete;
+
+    private:
+        const Phase phase_;
+        const bool active_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    /** @brief Time every pass run through the pass manager of `PIC` */
+    void registerPassCallbacks(llvm::PassInstrumentationCallbacks &PIC);
+
+    /** @brief Snapshot the instruction count of every function defined in `M` before it is optimized */
+    void beforeOptimize(const llvm::Module &M);
+    /** @brief Snapshot the instruction count of every function defined in `M` after it was optimized */
+    void afterOptimize(const llvm::Module &M);
+
+    void report(llvm::raw_ostream &os, Format format);
+} // namespace timing
+
+#endif
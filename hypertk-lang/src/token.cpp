@@ -1,29 +1,13 @@
-#include <string>
+#include <string_view>
 
 #include "token.hpp"
 
 namespace token
 {
-    Token::Token() {}
+    Token::Token() : type{TokenType::ERROR}, symbol{symbol::None}, line{0} {}
 
-    Token::Token(TokenType type, int line) : type{type}, line{line} {}
+    Token::Token(TokenType type, int line) : type{type}, symbol{symbol::None}, line{line} {}
 
-    Token::Token(TokenType type, const std::string &lexeme, int line)
-        : type{type}, lexeme{lexeme}, line{line} {}
-
-    /** @brief move constructor */
-    Token::Token(Token &&other) noexcept
-        : type(other.type), lexeme(std::move(other.lexeme)), line(other.line) {}
-
-    Token &Token::operator=(Token &&other) noexcept
-    {
-        if (this != &other)
-        {
-            type = other.type;
-            lexeme = std::move(other.lexeme);
-            line = other.line;
-        }
-
-        return *this;
-    }
+    Token::Token(TokenType type, std::string_view lexeme, int line, symbol::Symbol symbol)
+        : type{type}, lexeme{lexeme}, symbol{symbol}, line{line} {}
 }
\ No newline at end of file
@@ -1,9 +1,11 @@
 #ifndef HYPERTK_TOKEN_HPP
 #define HYPERTK_TOKEN_HPP
 
-#include <string>
+#include <cstddef>
+#include <string_view>
 
 #include "common.hpp"
+#include "symbol.hpp"
 
 namespace token
 {
@@ -14,6 +16,8 @@ namespace token
         RIGHT_PAREN,   // ')'
         LEFT_BRACE,    // `{`
         RIGHT_BRACE,   // `}`
+        LEFT_BRACKET,  // `[`
+        RIGHT_BRACKET, // `]`
         PLUS,          // `+`
         MINUS,         // `-`
         STAR,          // `*`
@@ -28,38 +32,52 @@ namespace token
         COMMA,         // `,`
         VERTICAL_BAR,  // `|`
         AMPERSAND,     // `&`
+        /** two character tokens */
+        AMPERSAND_AMPERSAND,       // `&&`
+        VERTICAL_BAR_VERTICAL_BAR, // `||`
         /** literals */
         IDENTIFIER, // Identifier
         NUMBER,     // float
         /** keywords */
-        FUNC,   // `func`
-        RETURN, // `return`
-        IF,     // `if`
-        THEN,   // `then`
-        ELSE,   // `else`
-        FOR,    // `for`
-        IN,     // `in`
-        UNARY,  // `unary`
-        BINARY, // `binary`
-        VAR,    // `var`
+        FUNC,     // `func`
+        RETURN,   // `return`
+        IF,       // `if`
+        THEN,     // `then`
+        ELSE,     // `else`
+        FOR,      // `for`
+        IN,       // `in`
+        UNARY,    // `unary`
+        BINARY,   // `binary`
+        VAR,      // `var`
+        LEN,      // `len`
+        PARALLEL, // `parallel`
+        REDUCE,   // `reduce`
         /** other */
         ERROR, // Present error
         END_OF_FILE,
     };
 
-    class Token : private Uncopyable
+    /** @brief Number of token types, the size of tables indexed by token type */
+    inline constexpr size_t TokenTypeCount = (size_t)TokenType::END_OF_FILE + 1;
+
+    /**
+     * @brief A token does not own its text, it is cheap to copy.
+     * @details The lexeme of an identifier is its interned name, which lives as long as the
+     * process, so the AST can keep identifier tokens after the source is gone. The lexeme of
+     * any other token is a view into the source, valid while the lexer lives.
+     */
+    class Token
     {
     public:
         TokenType type;
-        std::string lexeme;
+        std::string_view lexeme;
+        /** @brief Interned name of an identifier, `symbol::None` for other tokens */
+        symbol::Symbol symbol;
         int line;
 
-        explicit Token();
+        Token();
         Token(TokenType type, int line);
-        Token(TokenType type, const std::string &lexeme, int line);
-
-        Token(Token &&other) noexcept;
-        Token &operator=(Token &&other) noexcept;
+        Token(TokenType type, std::string_view lexeme, int line, symbol::Symbol symbol = symbol::None);
     };
 }
 